@@ -0,0 +1,64 @@
+/**
+ * @file	bbuf.h
+ * @author	Sunil Beta <betasam@gmail.com>
+ * @date	2010-2012
+ * @brief	reference counted byte buffers and slices
+ *
+ * @details
+ * A t_bbuf is built by appending bytes to it and is then passed
+ * around by reference: bk_buf_ref() for another holder of the
+ * same bytes, bk_buf_slice() for a part of them. Neither copies
+ * anything, and the bytes go back when the last reference to the
+ * buffer and its slices is released. A buffer is a t_ptr like any
+ * other, so it can be queued with queue_add() as it is.
+ */
+
+#ifndef _BBUF_H_INC
+#define _BBUF_H_INC
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_SYS_BUF
+
+#include <btypes.h>
+
+/** @remark buffer flags */
+#define BK_BUF_SEALED		0x01	/* shared, no more appends */
+
+#define BK_BUF_MINCAP		64	/* smallest block a builder grows to */
+
+/**
+ * @struct	s_bbuf
+ * @member	refs		references held, changed atomically
+ * @member	flags		BK_BUF_* of the buffer that owns the bytes
+ * @member	owner		buffer that owns the bytes, NULL for itself
+ * @member	data		first byte of the buffer or slice
+ * @member	len		bytes in the buffer or slice
+ * @member	cap		bytes allocated at data, 0 for slices
+ */
+struct s_bbuf {
+  volatile t_u32 refs;
+  volatile t_u32 flags;
+  struct s_bbuf *owner;
+  t_u8 *data;
+  t_size len;
+  t_size cap;
+};
+
+typedef struct s_bbuf t_bbuf;
+
+/** @remark read only access to the bytes */
+#define bk_buf_data(b)		((const t_u8*)((b)->data))
+#define bk_buf_len(b)		((b)->len)
+
+t_bbuf *bk_buf_new( t_size u_cap );
+t_bbuf *bk_buf_from( const t_ptr src, t_size u_len );
+t_s32   bk_buf_append( t_bbuf *buf, const t_ptr src, t_size u_len );
+t_void  bk_buf_seal( t_bbuf *buf );
+t_bbuf *bk_buf_ref( t_bbuf *buf );
+t_bbuf *bk_buf_slice( t_bbuf *buf, t_size u_off, t_size u_len );
+t_void  bk_buf_release( t_bbuf *buf );
+
+#endif	/* CONFIG_BK_SYS_BUF */
+
+#endif	/* _BBUF_H_INC */
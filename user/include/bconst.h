@@ -39,6 +39,16 @@
 
 #define BK_NUM_BASE	BK_NUM_BASE10
 
+/**
+ * @remark data layout
+ * BK_CACHELINE is the coherency unit of current x86 and ARM cores,
+ * keep data written by different threads BK_CACHELINE apart.
+ */
+#define BK_CACHELINE	64
+#define BK_PAGESIZE	4096
+
+#define BK_CACHELINE_ALIGNED	__attribute__((aligned(BK_CACHELINE)))
+
 /**
  * @remark Test and Set Macro Constants
  * true
@@ -14,6 +14,10 @@
 
 #include <btypes.h>
 
+#ifdef CONFIG_BK_SYS_BUF
+#include <bbuf.h>
+#endif
+
 #ifndef BKIT_NODEFAULTS
 #define BERROR_FLUSHLOG_DEFAULTS	1
 #endif
@@ -113,6 +117,7 @@
 #define BERR_SZ_HDRLEN		256
 
 #define BERR_LOG_SIZE		1 _MB
+#define BERR_LOG_BUFS		64	/* entries held until a flush */
 
 #define BERR_LOGUNDEF		0xFF
 #define BERR_LOGINIT		0x01
@@ -205,6 +210,10 @@ struct szerror_struct {
  * @member	u_loglen	maximum length of string block
  * @member	u_flags		flag indicating status of log
  * @member	flushlog	function to flush log to file or stream
+ * @member	buf_log		entries held by reference until flushed
+ * @member	u_bufs		entries in buf_log
+ * @member	u_buflen	bytes in those entries
+ * @member	flushbuf	function to write one entry out
  * @detail	the idea is to simplify, and enable
  *		a user of bkit to use an error log
  *		and flush it. The error management
@@ -221,6 +230,12 @@ struct berrorlog_struct {
   t_u8  u8_flags;
   t_u32 pid;
   t_s32 (*flushlog)(t_s32 fd, t_str sz);
+#ifdef CONFIG_BK_SYS_BUF
+  t_bbuf *buf_log[ BERR_LOG_BUFS ];
+  t_u32 u_bufs;
+  t_u32 u_buflen;
+  t_s32 (*flushbuf)(t_s32 fd, t_bbuf *buf);
+#endif
 };
 
 typedef struct berror_struct    t_berror;
@@ -231,6 +246,9 @@ typedef struct berrorlog_struct t_berrorlog;
 #if defined(BERROR_FLUSHLOG_DEFAULTS)
 t_s32 _berror_flushlog_default( t_s32 fd, t_str szflush );
 t_s32 _berror_flushlog_open( t_str pathfilename );
+#ifdef CONFIG_BK_SYS_BUF
+t_s32 _berror_flushbuf_default( t_s32 fd, t_bbuf *buf );
+#endif
 #endif
 
 t_s32 _berror_strcpy( t_str sz_dst, const t_str sz_src );
@@ -250,6 +268,9 @@ t_s32 berror_log_init( t_berrorlog *log, t_s32 logfd, t_u32 loglen, t_u8 flags
 t_s32 berror_log_flush( t_berrorlog *log );
 t_s32 berror_log_free( t_berrorlog *log );
 t_s32 berror_log( t_berrorlog *log, t_szerror *szerror, const t_str szprefix );
+#ifdef CONFIG_BK_SYS_BUF
+t_s32 berror_log_buf( t_berrorlog *log, t_bbuf *msg );
+#endif
 
 t_s32 _bk_errlog_init( t_s32 fd );
 t_s32 _bk_errlog_post( t_s32 major, t_s32 minor );
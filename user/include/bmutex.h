@@ -0,0 +1,74 @@
+/**
+ * @file	bmutex.h
+ * @author	Sunil Beta <betasam@gmail.com>
+ * @date	2010-2012
+ * @brief	adaptive mutual exclusion lock for betakit
+ *
+ * @details
+ * A small lock that needs no pthread linkage. The uncontended
+ * case is a single compare and swap, a contended caller spins
+ * for a short while and then parks itself on a futex (linux)
+ * or yields the processor (elsewhere) until the holder leaves.
+ * Acquisitions and waits are counted so that users of the lock
+ * can see how often they had to wait.
+ */
+
+#ifndef _BMUTEX_H_INC
+#define _BMUTEX_H_INC
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_SYSTEM
+
+#include <btypes.h>
+
+/** @remark lock states */
+#define BK_MUTEX_FREE		0
+#define BK_MUTEX_LOCKED		1
+#define BK_MUTEX_WAITERS	2
+
+/** @remark spin iterations before a waiter is parked */
+#define BK_MUTEX_SPIN_DEFAULT	128
+
+/**
+ * @struct	s_bmutex
+ * @member	state		one of BK_MUTEX_FREE/LOCKED/WAITERS
+ * @member	spin		spin iterations before parking
+ * @member	n_acquired	number of times the lock was taken
+ * @member	n_contended	acquisitions that found the lock held
+ * @member	n_parked	number of times a waiter slept
+ * @remark	counters are only written by the lock holder
+ */
+struct s_bmutex {
+  volatile t_s32 state;
+  t_u32 spin;
+  t_u64 n_acquired;
+  t_u64 n_contended;
+  t_u64 n_parked;
+};
+
+/**
+ * @struct	s_bmutex_stats
+ * @brief	copy of the counters of a t_bmutex
+ */
+struct s_bmutex_stats {
+  t_u64 acquired;
+  t_u64 contended;
+  t_u64 parked;
+};
+
+typedef struct s_bmutex       t_bmutex;
+typedef struct s_bmutex_stats t_bmutex_stats;
+
+#define BK_MUTEX_INITIALIZER	{ BK_MUTEX_FREE, BK_MUTEX_SPIN_DEFAULT, 0, 0, 0 }
+
+/* function declarations */
+t_void bk_mutex_init( t_bmutex *mutex );
+t_void bk_mutex_lock( t_bmutex *mutex );
+t_s32  bk_mutex_trylock( t_bmutex *mutex );
+t_void bk_mutex_unlock( t_bmutex *mutex );
+t_void bk_mutex_stats( t_bmutex *mutex, t_bmutex_stats *stats );
+
+#endif	/* CONFIG_BK_SYSTEM */
+
+#endif	/* _BMUTEX_H_INC */
@@ -16,6 +16,10 @@
  *			use with caution. As before, users can
  *			use inttypes.h without namespace
  *			pollution.
+ *	14-MAR-2012	t_size is the compiler's size_t type, so
+ *			allocator callbacks taking t_size match
+ *			malloc() and friends exactly; it is 64-bit
+ *			wherever the address space is.
  */
 
 #ifndef _BTYPES_H_INC
@@ -51,7 +55,6 @@ typedef unsigned int   t_ul32;
 typedef long	       t_s64;
 typedef unsigned long  t_u64;
 typedef unsigned long  t_longword;
-typedef unsigned long long t_size;
 
 #else
 /* types: defined for 32-bit word size */
@@ -62,10 +65,12 @@ typedef unsigned long  t_ul32;
 typedef unsigned long long	t_u64;
 typedef long long		t_s64;
 typedef unsigned long long	t_longword;
-typedef unsigned long long	t_size;
 /* types: end definition for 32-bit word size */
 #endif
 
+/* types: same as size_t without including stddef.h */
+typedef __SIZE_TYPE__	       t_size;
+
 /* types: dependent on WORDSIZE and ARCH */
 typedef unsigned       t_u;
 typedef long	       t_l;
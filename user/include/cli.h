@@ -19,6 +19,10 @@
 #include <btypes.h>
 #include <list.h>
 
+#ifdef CONFIG_BK_SYS_BUF
+#include <bbuf.h>
+#endif
+
 #define BK_MENU_HEADER_PRE	"-=[ "
 #define BK_MENU_HEADER_AFT	" ]=-"
 
@@ -31,6 +35,9 @@ struct menu_s {
   t_s32 (*menu_action)( t_s32 );
   t_s32 menu_count;
   t_string menu_title;
+#ifdef CONFIG_BK_SYS_BUF
+  t_bbuf *menu_title_buf;
+#endif
 
 };
 
@@ -86,6 +93,11 @@ t_s32 cli_menu_addlist( t_menu_ptr menu_ptr, t_string *menuitem_list, t_s32 coun
 t_s32 cli_menu_callback(t_menu_ptr menu_ptr, t_s32 (*menu_callback)(t_s32 choice) );
 t_s32 cli_show_menu( t_menu_ptr menu_ptr );
 t_s32 cli_menu_user( t_menu_ptr menu_ptr );
+t_void cli_menu_free( t_menu_ptr menu_ptr );
+#ifdef CONFIG_BK_SYS_BUF
+t_s32 cli_menu_title_buf( t_menu_ptr menu_ptr, t_bbuf *new_title );
+t_s32 cli_menu_additem_buf( t_menu_ptr menu_ptr, t_bbuf *new_item );
+#endif
 
 #endif	/* CONFIG_BK_UI_CLI */
 
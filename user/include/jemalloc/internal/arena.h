@@ -187,6 +187,14 @@ struct arena_chunk_s {
 	/* Number of dirty pages. */
 	size_t		ndirty;
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	/*
+	 * background_thread_epoch as of when ndirty last became non-zero, which
+	 * makes it the age of the oldest dirty page in the chunk.
+	 */
+	unsigned	dirty_epoch;
+#endif
+
 	/*
 	 * Map of pages within chunk that keeps track of free/large/small.  The
 	 * first map_bias entries are omitted, since the chunk header does not
@@ -424,6 +432,9 @@ extern size_t		sspace_max;
 #define			nlclasses (chunk_npages - map_bias)
 
 void	arena_purge_all(arena_t *arena);
+#ifdef JEMALLOC_BACKGROUND_THREAD
+size_t	arena_purge_background(arena_t *arena, bool decay, unsigned epoch);
+#endif
 #ifdef JEMALLOC_PROF
 void	arena_prof_accum(arena_t *arena, uint64_t accumbytes);
 #endif
@@ -436,6 +447,8 @@ void	arena_tcache_fill_small(arena_t *arena, tcache_bin_t *tbin,
     );
 #endif
 void	*arena_malloc_small(arena_t *arena, size_t size, bool zero);
+size_t	arena_malloc_small_batch(arena_t *arena, size_t size, bool zero,
+    void **ptrs, size_t n);
 void	*arena_malloc_large(arena_t *arena, size_t size, bool zero);
 void	*arena_malloc(size_t size, bool zero);
 void	*arena_palloc(arena_t *arena, size_t size, size_t alloc_size,
@@ -0,0 +1,90 @@
+/******************************************************************************/
+#ifdef JEMALLOC_H_TYPES
+
+#ifdef JEMALLOC_BACKGROUND_THREAD
+typedef struct background_thread_stats_s background_thread_stats_t;
+
+/*
+ * Dirty pages are purged once they have been unused for about this many
+ * milliseconds.
+ */
+#define	DIRTY_DECAY_MS_DEFAULT		10000
+
+/*
+ * Number of wakeups per decay period.  Age is measured in wakeups, so this is
+ * also the precision of the decay: a chunk is purged between 1 and
+ * 1 + 1/BACKGROUND_THREAD_NTICKS decay periods after it first got dirty.
+ */
+#define	BACKGROUND_THREAD_NTICKS	8
+
+/* Shortest interval between wakeups, in milliseconds. */
+#define	BACKGROUND_THREAD_MIN_INTERVAL	1
+
+/*
+ * Longest single wait, in milliseconds.  Wakeups are signalled without
+ * background_thread_mtx, so one can be lost; the thread notices the pending
+ * request after at most this long, however long the decay period is.
+ */
+#define	BACKGROUND_THREAD_MAX_WAIT					\
+    (DIRTY_DECAY_MS_DEFAULT / BACKGROUND_THREAD_NTICKS)
+#endif
+
+#endif /* JEMALLOC_H_TYPES */
+/******************************************************************************/
+#ifdef JEMALLOC_H_STRUCTS
+
+#ifdef JEMALLOC_BACKGROUND_THREAD
+struct background_thread_stats_s {
+	/* Number of passes over the arenas. */
+	uint64_t	nruns;
+
+	/* Number of pages purged. */
+	uint64_t	npurged;
+
+	/* Time spent purging, and the longest single pass, in nanoseconds. */
+	uint64_t	purge_ns;
+	uint64_t	purge_ns_max;
+};
+#endif
+
+#endif /* JEMALLOC_H_STRUCTS */
+/******************************************************************************/
+#ifdef JEMALLOC_H_EXTERNS
+
+#ifdef JEMALLOC_BACKGROUND_THREAD
+extern bool	opt_background_thread;
+extern ssize_t	opt_dirty_decay_ms;
+
+/*
+ * background_thread_mtx protects the following:
+ * - dirty_decay_ms
+ * - background_thread_stats
+ * - writes to background_thread_enabled
+ */
+extern malloc_mutex_t		background_thread_mtx;
+extern ssize_t			dirty_decay_ms;
+extern background_thread_stats_t	background_thread_stats;
+
+/*
+ * True while the thread runs.  Read without locking on the deallocation path;
+ * a stale value only means one more inline purge or one wakeup too many.
+ */
+extern bool		background_thread_enabled;
+
+/* Number of wakeups so far, used as the clock for dirty page decay. */
+extern unsigned		background_thread_epoch;
+
+void	background_thread_wakeup(void);
+bool	background_thread_start(void);
+void	background_thread_stop(void);
+void	background_thread_prefork(void);
+void	background_thread_postfork(void);
+bool	background_thread_boot(void);
+#endif
+
+#endif /* JEMALLOC_H_EXTERNS */
+/******************************************************************************/
+#ifdef JEMALLOC_H_INLINES
+
+#endif /* JEMALLOC_H_INLINES */
+/******************************************************************************/
@@ -7,6 +7,12 @@
  */
 #define	LG_CHUNK_DEFAULT	22
 
+/*
+ * Default maximum number of chunks that chunk_dealloc() keeps mapped, purged
+ * of their contents, for chunk_alloc() to reuse (0: no caching).
+ */
+#define	CHUNK_CACHE_MAX_DEFAULT	16
+
 /* Return the chunk address for allocation address a. */
 #define	CHUNK_ADDR2BASE(a)						\
 	((void *)((uintptr_t)(a) & ~chunksize_mask))
@@ -28,6 +34,7 @@
 #ifdef JEMALLOC_H_EXTERNS
 
 extern size_t		opt_lg_chunk;
+extern size_t		opt_chunk_cache_max;
 #ifdef JEMALLOC_SWAP
 extern bool		opt_overcommit;
 #endif
@@ -39,6 +46,22 @@ extern malloc_mutex_t	chunks_mtx;
 extern chunk_stats_t	stats_chunks;
 #endif
 
+/*
+ * Protects the chunk cache, chunk_cache_max, and the chunk_cache_* counters.
+ * Not to be held while calling base_node_{alloc,dealloc}(), because those may
+ * allocate chunks.
+ */
+extern malloc_mutex_t	chunk_cache_mtx;
+/* Maximum number of cached chunks; opt_chunk_cache_max at boot. */
+extern size_t		chunk_cache_max;
+/* Number of chunks in the cache. */
+extern size_t		chunk_cache_nchunks;
+#ifdef JEMALLOC_STATS
+/* mmap()-backed chunk allocations served from, and missing, the cache. */
+extern uint64_t		chunk_cache_nhits;
+extern uint64_t		chunk_cache_nmisses;
+#endif
+
 #ifdef JEMALLOC_IVSALLOC
 extern rtree_t		*chunks_rtree;
 #endif
@@ -51,6 +74,8 @@ extern size_t		arena_maxclass; /* Max size class for arenas. */
 
 void	*chunk_alloc(size_t size, bool base, bool *zero);
 void	chunk_dealloc(void *chunk, size_t size);
+bool	chunk_extend(void *chunk, size_t oldsize, size_t newsize);
+void	chunk_cache_max_set(size_t max);
 bool	chunk_boot(void);
 
 #endif /* JEMALLOC_H_EXTERNS */
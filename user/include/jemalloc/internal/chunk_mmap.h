@@ -12,6 +12,7 @@
 void	*chunk_alloc_mmap(size_t size);
 void	*chunk_alloc_mmap_noreserve(size_t size);
 void	chunk_dealloc_mmap(void *chunk, size_t size);
+bool	chunk_extend_mmap(void *chunk, size_t oldsize, size_t newsize);
 
 bool	chunk_mmap_boot(void);
 
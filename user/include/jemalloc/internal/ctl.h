@@ -54,6 +54,9 @@ struct ctl_stats_s {
 		size_t		current;	/* stats_chunks.curchunks */
 		uint64_t	total;		/* stats_chunks.nchunks */
 		size_t		high;		/* stats_chunks.highchunks */
+		size_t		cached;		/* chunk_cache_nchunks */
+		uint64_t	cache_nhits;	/* chunk_cache_nhits */
+		uint64_t	cache_nmisses;	/* chunk_cache_nmisses */
 	} chunks;
 	struct {
 		size_t		allocated;	/* huge_allocated */
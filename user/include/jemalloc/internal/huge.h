@@ -1,23 +1,40 @@
 /******************************************************************************/
 #ifdef JEMALLOC_H_TYPES
 
+typedef struct huge_shard_s huge_shard_t;
+
+/*
+ * Huge allocations are tracked in (1U << LG_HUGE_NSHARDS) shards, chosen by a
+ * hash of the allocation address, so that threads allocating and freeing
+ * huge objects at the same time rarely contend for a lock.
+ */
+#define	LG_HUGE_NSHARDS		4
+#define	HUGE_NSHARDS		(1U << LG_HUGE_NSHARDS)
+
 #endif /* JEMALLOC_H_TYPES */
 /******************************************************************************/
 #ifdef JEMALLOC_H_STRUCTS
 
-#endif /* JEMALLOC_H_STRUCTS */
-/******************************************************************************/
-#ifdef JEMALLOC_H_EXTERNS
+struct huge_shard_s {
+	/* Protects all other fields. */
+	malloc_mutex_t	mtx;
+
+	/* Tree of chunks that are stand-alone huge allocations. */
+	extent_tree_t	huge;
 
 #ifdef JEMALLOC_STATS
-/* Huge allocation statistics. */
-extern uint64_t		huge_nmalloc;
-extern uint64_t		huge_ndalloc;
-extern size_t		huge_allocated;
+	/* Huge allocation statistics. */
+	uint64_t	nmalloc;
+	uint64_t	ndalloc;
+	size_t		allocated;
 #endif
+} JEMALLOC_ATTR(aligned(CACHELINE));
 
-/* Protects chunk-related data structures. */
-extern malloc_mutex_t	huge_mtx;
+#endif /* JEMALLOC_H_STRUCTS */
+/******************************************************************************/
+#ifdef JEMALLOC_H_EXTERNS
+
+extern huge_shard_t	huge_shards[HUGE_NSHARDS];
 
 void	*huge_malloc(size_t size, bool zero);
 void	*huge_palloc(size_t size, size_t alignment, bool zero);
@@ -31,6 +48,10 @@ size_t	huge_salloc(const void *ptr);
 prof_ctx_t	*huge_prof_ctx_get(const void *ptr);
 void	huge_prof_ctx_set(const void *ptr, prof_ctx_t *ctx);
 #endif
+#ifdef JEMALLOC_STATS
+void	huge_stats_merge(size_t *allocated, uint64_t *nmalloc,
+    uint64_t *ndalloc);
+#endif
 bool	huge_boot(void);
 
 #endif /* JEMALLOC_H_EXTERNS */
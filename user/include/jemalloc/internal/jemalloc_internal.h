@@ -29,6 +29,7 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <math.h>
+#include <time.h>
 
 #define	JEMALLOC_MANGLE
 #include "../jemalloc.h"
@@ -209,6 +210,7 @@ extern void	(*JEMALLOC_P(malloc_message))(void *wcbopaque, const char *s);
 #include "jemalloc/internal/base.h"
 #include "jemalloc/internal/chunk.h"
 #include "jemalloc/internal/huge.h"
+#include "jemalloc/internal/background_thread.h"
 #include "jemalloc/internal/rtree.h"
 #include "jemalloc/internal/tcache.h"
 #include "jemalloc/internal/hash.h"
@@ -232,6 +234,7 @@ extern void	(*JEMALLOC_P(malloc_message))(void *wcbopaque, const char *s);
 #include "jemalloc/internal/base.h"
 #include "jemalloc/internal/chunk.h"
 #include "jemalloc/internal/huge.h"
+#include "jemalloc/internal/background_thread.h"
 #include "jemalloc/internal/rtree.h"
 #include "jemalloc/internal/tcache.h"
 #include "jemalloc/internal/hash.h"
@@ -258,6 +261,9 @@ extern bool	opt_xmalloc;
 extern bool	opt_zero;
 #endif
 extern size_t	opt_narenas;
+#ifdef JEMALLOC_PERCPU_ARENA
+extern bool	opt_percpu_arena;
+#endif
 
 #ifdef DYNAMIC_PAGE_SHIFT
 extern size_t		pagesize;
@@ -287,6 +293,19 @@ extern pthread_key_t	arenas_tsd;
 } while (0)
 #endif
 
+#ifdef JEMALLOC_PERCPU_ARENA
+/*
+ * Number of choose_arena() calls between checks of which CPU a thread is on
+ * when percpu_arena is enabled.  A tcache also rechecks on its GC events,
+ * since small allocations from it bypass choose_arena().
+ */
+#  define PERCPU_ARENA_RECHECK	256
+#  ifndef NO_TLS
+extern __thread unsigned	percpu_arena_ticks
+    JEMALLOC_ATTR(tls_model("initial-exec"));
+#  endif
+#endif
+
 /*
  * Arenas that are used to service external requests.  Not all elements of the
  * arenas array are necessarily used; arenas are created lazily as needed.
@@ -340,6 +359,9 @@ extern pthread_key_t	thread_allocated_tsd;
 
 arena_t	*arenas_extend(unsigned ind);
 arena_t	*choose_arena_hard(void);
+#ifdef JEMALLOC_PERCPU_ARENA
+arena_t	*choose_arena_percpu(void);
+#endif
 int	buferror(int errnum, char *buf, size_t buflen);
 void	jemalloc_prefork(void);
 void	jemalloc_postfork(void);
@@ -355,6 +377,7 @@ void	jemalloc_postfork(void);
 #include "jemalloc/internal/base.h"
 #include "jemalloc/internal/chunk.h"
 #include "jemalloc/internal/huge.h"
+#include "jemalloc/internal/background_thread.h"
 #include "jemalloc/internal/rtree.h"
 #include "jemalloc/internal/tcache.h"
 #include "jemalloc/internal/hash.h"
@@ -377,6 +400,7 @@ void	jemalloc_postfork(void);
 #include "jemalloc/internal/base.h"
 #include "jemalloc/internal/chunk.h"
 #include "jemalloc/internal/huge.h"
+#include "jemalloc/internal/background_thread.h"
 
 #ifndef JEMALLOC_ENABLE_INLINE
 size_t	pow2_ceil(size_t x);
@@ -536,11 +560,25 @@ choose_arena(void)
 {
 	arena_t *ret;
 
+#if (defined(JEMALLOC_PERCPU_ARENA) && defined(NO_TLS))
+	/*
+	 * Without TLS there is nowhere cheap to count calls, and looking up
+	 * the arena costs a pthread_getspecific() anyway, so ask for the CPU
+	 * every time.
+	 */
+	if (opt_percpu_arena)
+		return (choose_arena_percpu());
+#endif
+
 	ret = ARENA_GET();
 	if (ret == NULL) {
 		ret = choose_arena_hard();
 		assert(ret != NULL);
 	}
+#if (defined(JEMALLOC_PERCPU_ARENA) && !defined(NO_TLS))
+	else if (opt_percpu_arena && percpu_arena_ticks-- == 0)
+		ret = choose_arena_percpu();
+#endif
 
 	return (ret);
 }
@@ -28,6 +28,20 @@ typedef struct tcache_s tcache_t;
  */
 #define	LG_TCACHE_GC_SWEEP_DEFAULT	13
 
+/*
+ * With opt_tcache_adaptive, a small bin that was filled or flushed at least
+ * this many times between two GC visits is hot: it is given a larger fill
+ * count, and then more cache slots.  A bin whose low water mark stayed above
+ * zero is cold, and is shrunk the other way round.
+ */
+#define	TCACHE_NEVENTS_HOT		2
+
+/*
+ * Hot small bins may grow to (1U << LG_TCACHE_NSLOTS_GROW_MAX) times their
+ * initial number of cache slots.
+ */
+#define	LG_TCACHE_NSLOTS_GROW_MAX	2
+
 #endif /* JEMALLOC_H_TYPES */
 /******************************************************************************/
 #ifdef JEMALLOC_H_STRUCTS
@@ -40,6 +54,10 @@ struct tcache_bin_s {
 	unsigned	high_water;	/* Max # cached since last GC. */
 	unsigned	ncached;	/* # of cached objects. */
 	unsigned	ncached_max;	/* Upper limit on ncached. */
+	unsigned	nslots_init;	/* Initial and least ncached_max. */
+	unsigned	lg_fill_div;	/* Fill (ncached_max >> lg_fill_div). */
+	unsigned	nfills;		/* # of fills since last GC. */
+	unsigned	nflushes;	/* # of flushes since last GC. */
 	void		*avail;		/* Chain of available objects. */
 };
 
@@ -61,6 +79,7 @@ struct tcache_s {
 #ifdef JEMALLOC_H_EXTERNS
 
 extern bool	opt_tcache;
+extern bool	opt_tcache_adaptive;
 extern ssize_t	opt_lg_tcache_max;
 extern ssize_t	opt_lg_tcache_gc_sweep;
 
@@ -99,6 +118,11 @@ void	tcache_bin_flush_small(tcache_bin_t *tbin, size_t binind, unsigned rem
 #endif
     );
 void	tcache_bin_flush_large(tcache_bin_t *tbin, size_t binind, unsigned rem
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+    , tcache_t *tcache
+#endif
+    );
+void	tcache_bin_adapt(tcache_bin_t *tbin, size_t binind
 #if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
     , tcache_t *tcache
 #endif
@@ -107,6 +131,9 @@ tcache_t *tcache_create(arena_t *arena);
 void	*tcache_alloc_small_hard(tcache_t *tcache, tcache_bin_t *tbin,
     size_t binind);
 void	tcache_destroy(tcache_t *tcache);
+#ifdef JEMALLOC_PERCPU_ARENA
+void	tcache_arena_reassociate(tcache_t *tcache, arena_t *arena);
+#endif
 #ifdef JEMALLOC_STATS
 void	tcache_stats_merge(tcache_t *tcache, arena_t *arena);
 #endif
@@ -123,6 +150,7 @@ void	*tcache_alloc_easy(tcache_bin_t *tbin);
 void	*tcache_alloc_small(tcache_t *tcache, size_t size, bool zero);
 void	*tcache_alloc_large(tcache_t *tcache, size_t size, bool zero);
 void	tcache_dalloc_small(tcache_t *tcache, void *ptr);
+void	tcache_dalloc_small_bin(tcache_t *tcache, void *ptr, size_t binind);
 void	tcache_dalloc_large(tcache_t *tcache, void *ptr, size_t size);
 #endif
 
@@ -170,6 +198,13 @@ tcache_event(tcache_t *tcache)
 		size_t binind = tcache->next_gc_bin;
 		tcache_bin_t *tbin = &tcache->tbins[binind];
 
+		if (binind < nbins && opt_tcache_adaptive) {
+			tcache_bin_adapt(tbin, binind
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+			    , tcache
+#endif
+			    );
+		}
 		if (tbin->low_water > 0) {
 			/*
 			 * Flush (ceiling) 3/4 of the objects below the low
@@ -200,6 +235,16 @@ tcache_event(tcache_t *tcache)
 		if (tcache->next_gc_bin == nhbins)
 			tcache->next_gc_bin = 0;
 		tcache->ev_cnt = 0;
+
+#ifdef JEMALLOC_PERCPU_ARENA
+		/* Follow the thread if it has migrated to another CPU. */
+		if (opt_percpu_arena) {
+			arena_t *arena = choose_arena_percpu();
+
+			if (arena != tcache->arena)
+				tcache_arena_reassociate(tcache, arena);
+		}
+#endif
 	}
 }
 
@@ -306,34 +351,21 @@ tcache_alloc_large(tcache_t *tcache, size_t size, bool zero)
 	return (ret);
 }
 
+/*
+ * Cache a small region whose bin is already known, as it is to sdallocm().
+ * Nothing about the region is looked up, its chunk map is not read.
+ */
 JEMALLOC_INLINE void
-tcache_dalloc_small(tcache_t *tcache, void *ptr)
+tcache_dalloc_small_bin(tcache_t *tcache, void *ptr, size_t binind)
 {
-	arena_t *arena;
-	arena_chunk_t *chunk;
-	arena_run_t *run;
-	arena_bin_t *bin;
 	tcache_bin_t *tbin;
-	size_t pageind, binind;
-	arena_chunk_map_t *mapelm;
-
-	assert(arena_salloc(ptr) <= small_maxclass);
 
-	chunk = (arena_chunk_t *)CHUNK_ADDR2BASE(ptr);
-	arena = chunk->arena;
-	pageind = ((uintptr_t)ptr - (uintptr_t)chunk) >> PAGE_SHIFT;
-	mapelm = &chunk->map[pageind-map_bias];
-	run = (arena_run_t *)((uintptr_t)chunk + (uintptr_t)((pageind -
-	    (mapelm->bits >> PAGE_SHIFT)) << PAGE_SHIFT));
-	assert(run->magic == ARENA_RUN_MAGIC);
-	bin = run->bin;
-	binind = ((uintptr_t)bin - (uintptr_t)&arena->bins) /
-	    sizeof(arena_bin_t);
 	assert(binind < nbins);
+	assert(arena_salloc(ptr) == tcache->arena->bins[binind].reg_size);
 
 #ifdef JEMALLOC_FILL
 	if (opt_junk)
-		memset(ptr, 0x5a, bin->reg_size);
+		memset(ptr, 0x5a, tcache->arena->bins[binind].reg_size);
 #endif
 
 	tbin = &tcache->tbins[binind];
@@ -354,6 +386,33 @@ tcache_dalloc_small(tcache_t *tcache, void *ptr)
 	tcache_event(tcache);
 }
 
+JEMALLOC_INLINE void
+tcache_dalloc_small(tcache_t *tcache, void *ptr)
+{
+	arena_t *arena;
+	arena_chunk_t *chunk;
+	arena_run_t *run;
+	arena_bin_t *bin;
+	size_t pageind, binind;
+	arena_chunk_map_t *mapelm;
+
+	assert(arena_salloc(ptr) <= small_maxclass);
+
+	chunk = (arena_chunk_t *)CHUNK_ADDR2BASE(ptr);
+	arena = chunk->arena;
+	pageind = ((uintptr_t)ptr - (uintptr_t)chunk) >> PAGE_SHIFT;
+	mapelm = &chunk->map[pageind-map_bias];
+	run = (arena_run_t *)((uintptr_t)chunk + (uintptr_t)((pageind -
+	    (mapelm->bits >> PAGE_SHIFT)) << PAGE_SHIFT));
+	assert(run->magic == ARENA_RUN_MAGIC);
+	bin = run->bin;
+	binind = ((uintptr_t)bin - (uintptr_t)&arena->bins) /
+	    sizeof(arena_bin_t);
+	assert(binind < nbins);
+
+	tcache_dalloc_small_bin(tcache, ptr, binind);
+}
+
 JEMALLOC_INLINE void
 tcache_dalloc_large(tcache_t *tcache, void *ptr, size_t size)
 {
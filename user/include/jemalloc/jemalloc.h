@@ -67,6 +67,10 @@ int	JEMALLOC_P(rallocm)(void **ptr, size_t *rsize, size_t size,
 int	JEMALLOC_P(sallocm)(const void *ptr, size_t *rsize, int flags)
     JEMALLOC_ATTR(nonnull(1));
 int	JEMALLOC_P(dallocm)(void *ptr, int flags) JEMALLOC_ATTR(nonnull(1));
+int	JEMALLOC_P(sdallocm)(void *ptr, size_t size, int flags)
+    JEMALLOC_ATTR(nonnull(1));
+int	JEMALLOC_P(batchallocm)(void **ptrs, size_t *rsize, size_t size,
+    size_t n, int flags) JEMALLOC_ATTR(nonnull(1));
 
 #ifdef __cplusplus
 };
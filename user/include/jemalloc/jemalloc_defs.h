@@ -80,6 +80,19 @@
  */
 /* #undef JEMALLOC_DSS */
 
+/*
+ * JEMALLOC_PERCPU_ARENA enables the percpu_arena option, which picks a thread's
+ * arena by the CPU it is running on (sched_getcpu(3), glibc with _GNU_SOURCE)
+ * rather than round-robin.
+ */
+#define JEMALLOC_PERCPU_ARENA 
+
+/*
+ * JEMALLOC_BACKGROUND_THREAD enables the background_thread option, which moves
+ * dirty page purging off the deallocation path into a thread of its own.
+ */
+#define JEMALLOC_BACKGROUND_THREAD 
+
 /* JEMALLOC_SWAP enables mmap()ed swap file support. */
 /* #undef JEMALLOC_SWAP */
 
@@ -44,6 +44,7 @@ t_list *list_create_node( t_ptr data );
 t_s32 list_add( t_list *head, t_list *node );
 t_s32 list_del( t_list *head, t_list *node );
 t_list *list_find( t_list *head, t_ptr data_to_find, t_s32 (*data_cmp)( t_ptr data_in_list, t_ptr data_sought ) );
+void list_free_node( t_list *node );
 void list_clean( t_list *node );
 t_s32 list_empty( t_list *head );
 
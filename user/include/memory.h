@@ -21,18 +21,160 @@
 #ifdef CONFIG_BK_SYS_MEMORY
 
 #include <btypes.h>
+#include <bmutex.h>
 
 /** @remark define macros */
-#define MEMORY_TRACKER_SIZE	1024
+#define MEMORY_TRACKER_SIZE	1024	/* initial tracker slots, doubles */
 #define BKIT_SZLEN_DEFAULT	256
-#define BKIT_MEM_SLEEP_USECS	100000
+#define BKIT_MEM_GROW_SHIFT	2	/* in place growth asks for 1/4 extra */
+
+/** @remark per-thread caches, classes are powers of two */
+#define BKIT_MEM_TCACHE_MIN	16
+#define BKIT_MEM_TCACHE_MAX	256
+#define BKIT_MEM_TCACHE_CLASSES	5	/* 16 .. 256 */
+#define BKIT_MEM_TCACHE_DEPTH	64	/* blocks per magazine */
+#define BKIT_MEM_TCACHE_BATCH	32	/* blocks per refill/spill */
+#define BKIT_MEM_TCACHE_SLABS	1024	/* slab registry, power of 2 */
+#define BKIT_MEM_SLAB_SIZE	64 _KB
+
+/** @remark object pools */
+#define BKIT_MEM_POOL_SLAB	16 _KB
+#define BKIT_MEM_POOL_MINOBJS	16	/* objects per slab, at least */
+
+/** @remark large allocations, see mem_mmap_config() */
+#define BKIT_MEM_MMAP_THRESHOLD	256 _KB	/* 0 disables the mmap path */
+#define BKIT_MEM_MMAP_CACHE	8	/* released mappings kept for reuse */
+#define BKIT_MEM_MMAP_HUGETLB	0x01	/* try MAP_HUGETLB first */
+#define BKIT_MEM_MMAP_THP	0x02	/* madvise(MADV_HUGEPAGE) */
+#define BKIT_MEM_HUGEPAGE	2 _MB
+
+/** @remark region allocator, see mem_arena_create() */
+#define BKIT_MEM_ARENA_CHUNK	64 _KB
+#define BKIT_MEM_ARENA_ALIGN	16	/* alignment of every block */
+
+/** @remark allocation scopes, see mem_scope_begin() */
+#define BKIT_MEM_SCOPE_SLOTS	64	/* initial block slots, doubles */
+
+/** @remark allocation trace, see mem_trace_start() */
+#define BKIT_MEM_TRACE_MAGIC	0x544D4B42	/* "BKMT" */
+#define BKIT_MEM_TRACE_VERSION	1
+#define BKIT_MEM_TRACE_BUFFER	2048	/* records per write() */
+#define BKIT_MEM_TRACE_ENV	"BKIT_MEM_TRACE"
+
+/** @remark trace operations, allocations sort below REALLOC */
+#define BKIT_MEM_TRACE_ALLOC	1
+#define BKIT_MEM_TRACE_CALLOC	2
+#define BKIT_MEM_TRACE_ALIGNED	3
+#define BKIT_MEM_TRACE_REALLOC	4
+#define BKIT_MEM_TRACE_FREE	5
+
+/** @remark sampling profiler, see mem_prof_start() */
+#define BKIT_MEM_PROF_RATE	512 _KB	/* mean bytes between samples */
+#define BKIT_MEM_PROF_SITES	1024	/* call sites kept, power of 2 */
+
+/** @remark memory budget, see mem_set_limit() */
+#define BKIT_MEM_RECLAIM_MAX	16	/* reclaim callbacks */
+
+/** @remark statistics snapshots, see mem_stats() */
+#define BKIT_MEM_STATS_ARENAS	16	/* backend arenas reported */
+#define BKIT_MEM_STATS_BINS	64	/* backend size classes reported */
+#define BKIT_MEM_STATS_BACKEND	0x01	/* backend filled in arenas, bins */
+#define BKIT_MEM_STATS_COUNTERS	0x02	/* backend keeps byte and bin counters */
 
 #define __new(x)		mem_alloc(sizeof(x))
 #define __new__(x,y)		mem_alloc(sizeof(x) * y)
 #define BKIT_ARRAY_SIZE(x)	(sizeof(x)/sizeof(x[0]))
 
 /** @remark define structures */
+
+/**
+ * @struct	s_mem_stats_bin
+ * @brief	one size class of the backend, all arenas merged
+ * @member	size		bytes per block of the class
+ * @member	allocated	bytes in live blocks of the class
+ * @member	n_malloc	blocks handed out, cumulative
+ * @member	n_dalloc	blocks given back, cumulative
+ * @member	n_fills		thread cache refills from the class
+ * @member	n_flushes	thread cache flushes to the class
+ * @remark	only size is known without BKIT_MEM_STATS_COUNTERS
+ */
+struct s_mem_stats_bin {
+  t_size size;
+  t_size allocated;
+  t_u64 n_malloc;
+  t_u64 n_dalloc;
+  t_u64 n_fills;
+  t_u64 n_flushes;
+};
+
+/**
+ * @struct	s_mem_stats
+ * @brief	snapshot of the memory manager and its backend
+ * @member	time		monotonic nanoseconds the snapshot was taken at
+ * @member	live_bytes	bytes in tracked blocks, as requested
+ * @member	peak_bytes	highest live_bytes seen
+ * @member	live_blocks	blocks not yet freed, thread caches included
+ * @member	n_allocs	blocks handed out, cumulative
+ * @member	n_frees		blocks given back, cumulative
+ * @member	alloc_rate	blocks handed out per second, see mem_stats()
+ * @member	free_rate	blocks given back per second
+ * @member	tc_live		blocks of the thread caches in use
+ * @member	tc_cached	free blocks held by thread caches, per class
+ * @member	tc_slab_bytes	bytes of the slabs behind the thread caches
+ * @member	map_cached	released mappings kept for reuse
+ * @member	flags		BKIT_MEM_STATS_* describing the backend part
+ * @member	allocated	bytes in live backend blocks
+ * @member	active		bytes of backend pages in use
+ * @member	mapped		bytes of backend chunks mapped
+ * @member	page_size	bytes per backend page
+ * @member	pactive		pages in use, per arena
+ * @member	pdirty		pages freed but not yet purged, per arena
+ * @member	bins		size classes of the backend
+ */
+struct s_mem_stats {
+  t_u64 time;
+  t_size live_bytes;
+  t_size peak_bytes;
+  t_u64 live_blocks;
+  t_u64 n_allocs;
+  t_u64 n_frees;
+  double alloc_rate;
+  double free_rate;
+  t_u64 tc_live;
+  t_u32 tc_cached[ BKIT_MEM_TCACHE_CLASSES ];
+  t_size tc_slab_bytes;
+  t_u32 map_cached;
+
+  t_u32 flags;
+  t_size allocated;
+  t_size active;
+  t_size mapped;
+  t_size page_size;
+  t_u32 n_arenas;
+  t_size pactive[ BKIT_MEM_STATS_ARENAS ];
+  t_size pdirty[ BKIT_MEM_STATS_ARENAS ];
+  t_u32 n_bins;
+  struct s_mem_stats_bin bins[ BKIT_MEM_STATS_BINS ];
+};
 struct s_memory_calls {
+  t_ptr  (*malloc)( t_size ubytes );
+  t_void  (*free)( t_ptr ptr );
+  t_ptr (*realloc)( t_ptr ptr, t_size ubytes);
+  t_ptr (*calloc)( t_size nmemb, t_size ubytes);
+  t_size (*expand)( t_ptr ptr, t_size ubytes, t_size extra ); /* optional, in place */
+  t_u32 (*alloc_batch)( t_size ubytes, t_ptr *ptrs, t_u32 count ); /* optional */
+  t_void (*free_sized)( t_ptr ptr, t_size ubytes ); /* optional */
+  t_void (*stats)( struct s_mem_stats *stats ); /* optional, backend part */
+  t_ptr (*memalign)( t_size alignment, t_size ubytes );
+  t_u32 alloc_used;
+};
+
+/**
+ * @struct	s_memory_calls_u32
+ * @brief	callbacks with 32-bit sizes, as betakit took before
+ *		sizes became t_size. see mem_changecalls_u32().
+ */
+struct s_memory_calls_u32 {
   t_ptr  (*malloc)( t_u32 ubytes );
   t_void  (*free)( t_ptr ptr );
   t_ptr (*realloc)( t_ptr ptr, t_u32 ubytes);
@@ -40,22 +182,190 @@ struct s_memory_calls {
   t_u32 alloc_used;
 };
 
+/**
+ * @struct	s_mem_pool
+ * @brief	fixed size object pool, see mempool.c
+ * @member	free_list	chain of free objects
+ * @member	slab_list	chain of slabs owned by the pool
+ * @member	obj_size	object size rounded up to obj_align
+ * @member	slab_objs	objects carved per slab
+ * @member	calls		callbacks the slabs came from
+ */
+struct s_mem_pool {
+  t_ptr free_list;
+  t_ptr slab_list;
+  t_u32 obj_size;
+  t_u32 obj_align;
+  t_u32 slab_objs;
+  t_u32 n_live;
+  t_u32 n_slabs;
+  struct s_memory_calls calls;
+  t_bmutex lock;
+};
+
+/**
+ * @struct	s_mem_arena
+ * @brief	bump pointer region, freed as a whole
+ * @member	used_list	chunks handed out since the last reset
+ * @member	used_tail	last chunk of used_list, for O(1) reset
+ * @member	spare_list	chunks kept over from earlier resets
+ * @member	cur, end	free range of the current chunk
+ * @member	chunk_size	bytes per chunk, headers included
+ * @member	calls		callbacks the chunks came from
+ * @remark	an arena belongs to one thread, it is not locked
+ */
+struct s_mem_arena {
+  t_ptr used_list;
+  t_ptr used_tail;
+  t_ptr spare_list;
+  t_u8 *cur;
+  t_u8 *end;
+  t_u32 chunk_size;
+  t_u32 n_chunks;
+  t_u64 n_bytes;
+  struct s_memory_calls calls;
+};
+
+/**
+ * @struct	s_mem_scope
+ * @brief	blocks owned by an allocation scope, see mem_scope_begin()
+ * @member	blocks		blocks allocated in the scope, NULL once freed
+ * @member	n_blocks	entries in use in blocks
+ * @member	n_slots		entries allocated for blocks
+ * @member	n_live		entries that are not NULL
+ * @member	parent		scope that was current when this one began
+ * @remark	only touched under the memory lock
+ */
+struct s_mem_scope {
+  t_ptr *blocks;
+  t_u32 n_blocks;
+  t_u32 n_slots;
+  t_u32 n_live;
+  struct s_mem_scope *parent;
+};
+
+/**
+ * @struct	s_mem_trace_header
+ * @brief	first bytes of a trace file
+ * @member	magic		BKIT_MEM_TRACE_MAGIC
+ * @member	version		BKIT_MEM_TRACE_VERSION
+ * @member	rec_size	sizeof(struct s_mem_trace_rec)
+ * @member	start		wall clock seconds when recording began
+ */
+struct s_mem_trace_header {
+  t_u32 magic;
+  t_u16 version;
+  t_u16 rec_size;
+  t_u64 start;
+};
+
+/**
+ * @struct	s_mem_trace_rec
+ * @brief	one request in a trace file, in host byte order
+ * @member	time		nanoseconds since recording began
+ * @member	size		bytes requested, 0 for FREE
+ * @member	id		block, numbered from 1 in allocation order
+ * @member	thread		thread, numbered from 1 in order of appearance
+ * @member	op		one of BKIT_MEM_TRACE_*
+ * @member	align_shift	log2 of the alignment of an ALIGNED request
+ * @remark	a block keeps its id across REALLOC
+ */
+struct s_mem_trace_rec {
+  t_u64 time;
+  t_u64 size;
+  t_u32 id;
+  t_u16 thread;
+  t_u8  op;
+  t_u8  align_shift;
+};
+
 /** @remark simply with type definitions */
 typedef struct s_memory_calls t_memory_calls;
+typedef struct s_memory_calls_u32 t_memory_calls_u32;
+typedef struct s_mem_pool     t_mem_pool;
+typedef struct s_mem_arena    t_mem_arena;
+typedef struct s_mem_scope    t_mem_scope;
+typedef struct s_mem_trace_header t_mem_trace_header;
+typedef struct s_mem_trace_rec    t_mem_trace_rec;
+typedef struct s_mem_stats        t_mem_stats;
+typedef struct s_mem_stats_bin    t_mem_stats_bin;
+
+/** @remark reclaim callback, returns the bytes it released */
+typedef t_size (*t_mem_reclaim_fn)( t_ptr arg, t_size ui_wanted );
 
 /** @remark declare functions */
-t_ptr  mem_alloc( t_u32 ui_bytes );
-t_ptr  mem_clearalloc( t_u32 ui_bytes );
+t_ptr  mem_alloc( t_size ui_bytes );
+t_ptr  mem_clearalloc( t_size ui_bytes );
 t_void mem_free( t_ptr ptr_mem );
-t_ptr  mem_realloc( t_ptr ptr_mem, t_u32 ui_bytes );
+t_void mem_free_sized( t_ptr ptr_mem, t_size ui_bytes );
+t_ptr  mem_alloc_aligned( t_size ui_align, t_size ui_bytes );
+t_void mem_free_aligned( t_ptr ptr_mem );
+t_u32  mem_alloc_batch( t_size ui_bytes, t_ptr *ptrs, t_u32 u_count );
+t_void mem_free_batch( t_ptr *ptrs, t_u32 u_count );
+t_ptr  mem_realloc( t_ptr ptr_mem, t_size ui_bytes );
 t_void mem_gc( t_void );
+t_s32  mem_alloc_count( t_void );
 t_void mem_changecalls( t_memory_calls *new_calls );
-t_u32  mem_copy( t_ptr dest_ptr, t_ptr src_ptr, t_u32 u_bytes_to_copy );
+t_void mem_changecalls_u32( t_memory_calls_u32 *old_calls );
+t_size mem_copy( t_ptr dest_ptr, t_ptr src_ptr, t_size u_bytes_to_copy );
+t_size mem_move( t_ptr dest_ptr, t_ptr src_ptr, t_size u_bytes_to_move );
+t_void mem_lock_stats( t_bmutex_stats *stats );
+
+/** @remark allocation scopes */
+t_mem_scope *mem_scope_begin( t_void );
+t_void mem_scope_end( t_mem_scope *scope );
+
+/** @remark object pools, mempool.c */
+t_mem_pool *mem_pool_create( t_u32 obj_size, t_u32 obj_align );
+t_ptr  mem_pool_alloc( t_mem_pool *pool );
+t_void mem_pool_free( t_mem_pool *pool, t_ptr obj );
+t_void mem_pool_destroy( t_mem_pool *pool );
+
+/** @remark region allocator */
+t_mem_arena *mem_arena_create( t_u32 chunk_size );
+t_ptr  mem_arena_alloc( t_mem_arena *arena, t_size ui_bytes );
+t_void mem_arena_reset( t_mem_arena *arena );
+t_void mem_arena_destroy( t_mem_arena *arena );
+
+/** @remark internal: current callbacks, for allocators in bsys */
+t_void _bk_mem_calls( t_memory_calls *calls );
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+t_s32  mem_set_limit( t_size ui_soft, t_size ui_hard );
+t_size mem_usage( t_void );
+t_s32  mem_reclaim_register( t_mem_reclaim_fn fn, t_ptr arg );
+t_void mem_reclaim_unregister( t_mem_reclaim_fn fn, t_ptr arg );
+t_size mem_reclaim( t_size ui_wanted );
+t_size mem_pool_reclaim( t_ptr pool_arg, t_size ui_wanted );
+
+/** @remark internal: budget for slabs and chunks of allocators in bsys */
+t_s32  _bk_mem_charge( t_size ui_bytes );
+t_void _bk_mem_uncharge( t_size ui_bytes );
+#endif	/* CONFIG_BK_SYS_MEM_LIMIT */
+
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+t_s32  mem_stats( t_mem_stats *stats );
+#endif	/* CONFIG_BK_SYS_MEM_STATS */
 
 #if defined(BKIT_DEBUG_MODE)
 t_void mem_stat(t_void);
 #endif	/* BKIT_DEBUG_MODE */
 
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+t_void mem_mmap_config( t_size ui_threshold, t_u32 u_flags );
+#endif	/* CONFIG_BK_SYS_MEM_MMAP */
+
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+t_void mem_prof_start( t_size ui_rate );
+t_void mem_prof_stop( t_void );
+t_s32  mem_prof_dump( const char *path );
+#endif	/* CONFIG_BK_SYS_MEM_PROF */
+
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+t_s32  mem_trace_start( const char *path );
+t_void mem_trace_stop( t_void );
+#endif	/* CONFIG_BK_SYS_MEM_TRACE */
+
 /** @remark call to import jemalloc */
 #if defined(CONFIG_BK_SYS_JEMALLOC)
 t_void bk_jemalloc_calls( t_memory_calls *p );
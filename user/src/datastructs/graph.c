@@ -19,6 +19,44 @@
 #include <list.h>
 #include <graph.h>
 
+/* @remark nodes of all graphs come from one pool */
+static t_mem_pool *graph_node_pool = NULL;
+
+/**
+ * @fn t_mem_pool *_graph_node_pool( void )
+ * @brief pool for graph nodes, created on first use
+ * @return pointer to the pool or NULL on failure
+ */
+static t_mem_pool *_graph_node_pool( void )
+{
+  t_mem_pool *pool;
+
+  if( 0 != graph_node_pool )
+    {
+      return( graph_node_pool );
+    }
+
+  if( 0 == (pool = mem_pool_create( sizeof(t_node), 0 )) )
+    {
+      return( NULL );
+    }
+
+  /* @remark lost the race, use the winner's pool */
+  if( !__sync_bool_compare_and_swap( &graph_node_pool, NULL, pool ) )
+    {
+      mem_pool_destroy( pool );
+    }
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+  else
+    {
+      /* @remark an idle pool gives its slabs back under pressure */
+      mem_reclaim_register( mem_pool_reclaim, pool );
+    }
+#endif
+
+  return( graph_node_pool );
+}
+
 /**
  * @fn t_graph_ptr graph_nodeinit( t_ptr data )
  * @brief creates a node or a subgraph for a graph
@@ -29,7 +67,7 @@ t_node_ptr node_init( t_ptr data )
 {
   t_node_ptr  new_node = NULL;
 
-  if( NULL == (new_node = (t_node_ptr) mem_alloc( sizeof(t_node) )) )
+  if( NULL == (new_node = (t_node_ptr) mem_pool_alloc( _graph_node_pool() )) )
     {
       return( new_node ); /** @TODO - Report error */
     }
@@ -52,7 +90,7 @@ t_node_ptr node_init( t_ptr data )
 t_void node_free( t_node_ptr node_ptr )
 {
   mem_free((t_ptr)node_ptr->node_data);
-  mem_free((t_ptr)node_ptr);
+  mem_pool_free( graph_node_pool, (t_ptr)node_ptr );
 }
 
 
@@ -18,6 +18,45 @@
 
 #include <list.h>
 
+/* @remark nodes of all lists come from one pool */
+static t_mem_pool *list_node_pool = NULL;
+
+/**
+ * @fn t_mem_pool *_list_node_pool( void )
+ * @brief pool for list nodes, created on first use
+ * @return pointer to the pool or NULL on failure
+ */
+static t_mem_pool *_list_node_pool( void )
+{
+  t_mem_pool *pool;
+
+  if( 0 != list_node_pool )
+    {
+      return( list_node_pool );
+    }
+
+  pool = mem_pool_create( sizeof(t_list), 0 );
+  if( 0 == pool )
+    {
+      return( NULL );
+    }
+
+  /* @remark lost the race, use the winner's pool */
+  if( !__sync_bool_compare_and_swap( &list_node_pool, NULL, pool ) )
+    {
+      mem_pool_destroy( pool );
+    }
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+  else
+    {
+      /* @remark an idle pool gives its slabs back under pressure */
+      mem_reclaim_register( mem_pool_reclaim, pool );
+    }
+#endif
+
+  return( list_node_pool );
+}
+
 /**
  * @fn t_list *list_create_node( t_ptr data )
  * @brief create new list nodes
@@ -45,8 +84,13 @@ t_list *list_create_node( t_ptr data )
   if( 0 > i_retval )
     goto prep_exit;
 
-  list_node = mem_alloc( sizeof(t_list) );
+  list_node = mem_pool_alloc( _list_node_pool() );
+  if( 0 == list_node )
+    goto prep_exit;
+
   list_node->data = data;
+  list_node->next = 0;
+  list_node->metadata = 0;
 
  prep_exit:
   return( list_node );
@@ -208,6 +252,28 @@ t_list *list_find( t_list *head, t_ptr data_to_find, t_s32 (*data_cmp)( t_ptr da
 }
 
 
+/**
+ * @fn void list_free_node( t_list *node )
+ * @param node the node to be released.
+ * @brief Returns a node made by list_create_node()
+ * @details
+ * Releases only the node, data and metadata held by
+ * the node are left to the caller.
+ *
+ * @return void/nothing.
+ */
+void list_free_node( t_list *node )
+{
+  if( 0 == node )
+    {
+      return;
+    }
+
+  mem_pool_free( list_node_pool, node );
+
+  return;
+}
+
 /**
  * @fn void list_clean( t_list *node )
  * @param node the node to be freed.
@@ -215,7 +281,8 @@ t_list *list_find( t_list *head, t_ptr data_to_find, t_s32 (*data_cmp)( t_ptr da
  * @see mem_free
  * @details
  * Frees memory used up by a single node using a
- * dynamic memory management tool.
+ * dynamic memory management tool. The node that
+ * follows is left alone.
  *
  * @return void/nothing.
  */
@@ -228,8 +295,8 @@ void list_clean( t_list *node )
     }
 
   mem_free(node->data);
-  mem_free(node->next);
   mem_free(node->metadata);
+  list_free_node(node);
 
   return;
 }
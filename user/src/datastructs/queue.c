@@ -144,7 +144,8 @@ t_void queue_clean( t_queue_ptr queue_ptr )
 
   queue_ptr->queue_flags |= BKIT_QUEUE_UNDEFINED;
 
-  mem_free( queue_ptr->queue_base );
+  mem_free_sized( queue_ptr->queue_base,
+		  sizeof(t_ptr) * (queue_ptr->queue_end - queue_ptr->queue_base + 1) );
   queue_ptr->queue_base = (t_ptr)0; 
   /**
    * @WARNING NULL pointer assignment 
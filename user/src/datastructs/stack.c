@@ -111,7 +111,7 @@ void stack_clean( t_stack *stack_ptr )
 
   if( NULL == stack_ptr ) return;
 
-  mem_free( stack_ptr->stack_base );
+  mem_free_sized( stack_ptr->stack_base, sizeof( t_ptr ) * (stack_ptr->stack_depth) );
   stack_ptr->stack_status = STACK_UNKNOWN;
   stack_ptr->stack_top   = (t_ptr)0; /* @WARNING DANGER! NULL Pointer */ 
   stack_ptr->stack_base  = stack_ptr->stack_top;
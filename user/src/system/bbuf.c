@@ -0,0 +1,252 @@
+/**
+ * @file	bbuf.c
+ * @author	Sunil Beta <betasam@gmail.com>
+ * @date	2010-2012
+ * @brief	reference counted byte buffers and slices
+ * @details
+ * The buffer that owns the bytes keeps them in a block of their
+ * own, so a builder can grow with mem_realloc() while it has a
+ * single holder. Taking a reference or a slice seals the owner:
+ * from then on the bytes neither move nor change, and any number
+ * of threads may read them. A slice holds one reference on the
+ * owner, never on another slice, so slicing a slice costs the
+ * same as slicing the owner.
+ *
+ * @warning	relies on gcc __sync builtins.
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_SYS_BUF
+
+/* @remark Standard Includes : required for NULL */
+#include <stddef.h>
+
+/* @remark bkit Includes */
+#include <btypes.h>
+
+#include <memory.h>
+#include <bbuf.h>
+
+/**
+ * @fn _bk_buf_owner( t_bbuf *buf )
+ * @brief buffer that owns the bytes of buf
+ */
+static inline t_bbuf *_bk_buf_owner( t_bbuf *buf )
+{
+  return( (NULL == buf->owner) ? buf : buf->owner );
+}
+
+/**
+ * @fn t_bbuf *bk_buf_new( t_size u_cap )
+ * @brief create an empty buffer to append to
+ * @param u_cap bytes to allocate up front, 0 to wait for appends
+ * @return new buffer holding one reference, NULL on failure
+ */
+t_bbuf *bk_buf_new( t_size u_cap )
+{
+  t_bbuf *buf;
+
+  buf = (t_bbuf*) mem_alloc( sizeof(t_bbuf) );
+  if( NULL == buf )
+    {
+      return( NULL );
+    }
+
+  buf->data = NULL;
+  if( ZERO != u_cap )
+    {
+      buf->data = (t_u8*) mem_alloc( u_cap );
+      if( NULL == buf->data )
+	{
+	  mem_free( buf );
+	  return( NULL );
+	}
+    }
+
+  buf->refs  = 1;
+  buf->flags = ZERO;
+  buf->owner = NULL;
+  buf->len   = ZERO;
+  buf->cap   = u_cap;
+
+  return( buf );
+}
+
+/**
+ * @fn t_bbuf *bk_buf_from( const t_ptr src, t_size u_len )
+ * @brief create a buffer holding a copy of u_len bytes at src
+ * @remark the one copy a payload needs on its way in
+ * @return new buffer holding one reference, NULL on failure
+ */
+t_bbuf *bk_buf_from( const t_ptr src, t_size u_len )
+{
+  t_bbuf *buf;
+
+  buf = bk_buf_new( u_len );
+  if( (NULL != buf) && (0 > bk_buf_append( buf, src, u_len )) )
+    {
+      bk_buf_release( buf );
+      buf = NULL;
+    }
+
+  return( buf );
+}
+
+/**
+ * @fn t_s32 bk_buf_append( t_bbuf *buf, const t_ptr src, t_size u_len )
+ * @brief add u_len bytes at src to the end of a buffer
+ * @details
+ * Room is doubled when it runs out, so building a buffer a piece
+ * at a time costs amortised constant time per byte. Only a buffer
+ * that owns its bytes and has not been sealed can be appended to.
+ *
+ * @return 0 on success, -1 on failure with the buffer unchanged
+ */
+t_s32 bk_buf_append( t_bbuf *buf, const t_ptr src, t_size u_len )
+{
+  t_u8 *data;
+  t_size u_cap;
+
+  if( (NULL == buf) || ((NULL == src) && (ZERO != u_len)) )
+    {
+      return( -1 );
+    }
+
+  if( (NULL != buf->owner) || (BK_BUF_SEALED & buf->flags) )
+    {
+      return( -1 );
+    }
+
+  if( u_len > buf->cap - buf->len )
+    {
+      if( u_len > ~((t_size) 0) - buf->len )
+	{
+	  return( -1 );		/* @remark overflow */
+	}
+
+      u_cap = (buf->cap < BK_BUF_MINCAP) ? BK_BUF_MINCAP : buf->cap;
+      while( u_cap < buf->len + u_len )
+	{
+	  u_cap = (u_cap > (~((t_size) 0) >> 1)) ? (buf->len + u_len) : (u_cap << 1);
+	}
+
+      data = (t_u8*) mem_realloc( buf->data, u_cap );
+      if( NULL == data )
+	{
+	  return( -1 );
+	}
+      buf->data = data;
+      buf->cap  = u_cap;
+    }
+
+  mem_copy( buf->data + buf->len, src, u_len );
+  buf->len += u_len;
+
+  return( 0 );
+}
+
+/**
+ * @fn t_void bk_buf_seal( t_bbuf *buf )
+ * @brief stop appends to the bytes of a buffer
+ * @remark done by bk_buf_ref() and bk_buf_slice() as well
+ */
+t_void bk_buf_seal( t_bbuf *buf )
+{
+  if( NULL == buf )
+    {
+      return;
+    }
+
+  __sync_fetch_and_or( &(_bk_buf_owner( buf )->flags), BK_BUF_SEALED );
+
+  return;
+}
+
+/**
+ * @fn t_bbuf *bk_buf_ref( t_bbuf *buf )
+ * @brief take another reference to a buffer or slice
+ * @remark each reference is given back with bk_buf_release()
+ * @return buf
+ */
+t_bbuf *bk_buf_ref( t_bbuf *buf )
+{
+  if( NULL == buf )
+    {
+      return( NULL );
+    }
+
+  bk_buf_seal( buf );
+  __sync_add_and_fetch( &buf->refs, 1 );
+
+  return( buf );
+}
+
+/**
+ * @fn t_bbuf *bk_buf_slice( t_bbuf *buf, t_size u_off, t_size u_len )
+ * @brief take u_len bytes from u_off of a buffer or slice
+ * @details
+ * The slice points into the bytes of the buffer and keeps them
+ * alive; only its own small header is allocated. Offsets are
+ * relative to buf, which may itself be a slice.
+ *
+ * @return new slice holding one reference, NULL on failure
+ */
+t_bbuf *bk_buf_slice( t_bbuf *buf, t_size u_off, t_size u_len )
+{
+  t_bbuf *slice, *owner;
+
+  if( (NULL == buf) || (u_off > buf->len) || (u_len > buf->len - u_off) )
+    {
+      return( NULL );
+    }
+
+  slice = (t_bbuf*) mem_alloc( sizeof(t_bbuf) );
+  if( NULL == slice )
+    {
+      return( NULL );
+    }
+
+  owner = _bk_buf_owner( buf );
+  bk_buf_seal( owner );
+  __sync_add_and_fetch( &owner->refs, 1 );
+
+  slice->refs  = 1;
+  slice->flags = ZERO;
+  slice->owner = owner;
+  slice->data  = buf->data + u_off;
+  slice->len   = u_len;
+  slice->cap   = ZERO;
+
+  return( slice );
+}
+
+/**
+ * @fn t_void bk_buf_release( t_bbuf *buf )
+ * @brief give back a reference to a buffer or slice
+ * @remark the bytes are freed with the last reference to the
+ *         owner, which each live slice holds one of.
+ */
+t_void bk_buf_release( t_bbuf *buf )
+{
+  t_bbuf *owner;
+
+  if( (NULL == buf) || (ZERO != __sync_sub_and_fetch( &buf->refs, 1 )) )
+    {
+      return;
+    }
+
+  owner = buf->owner;
+  if( NULL == owner )
+    {
+      mem_free( buf->data );
+    }
+  mem_free( buf );
+
+  bk_buf_release( owner );
+
+  return;
+}
+
+#endif	/* CONFIG_BK_SYS_BUF */
+/* @remark end of file "bbuf.c" */
@@ -165,6 +165,26 @@ t_s32 _berror_ultostr( t_u32 u_num, t_str strptr )
   return( s_rt = (strptr - (t_str)str) );
 }
 
+#ifdef CONFIG_BK_SYS_BUF
+/**
+ * @fn _berror_buf_append( t_bbuf *buf, const t_str sz )
+ * @brief append a string to a log line, without its terminator
+ * @return 0 on success, -1 on failure
+ */
+static t_s32 _berror_buf_append( t_bbuf *buf, const t_str sz )
+{
+  t_s32 s32_len;
+
+  s32_len = _berror_strlen( sz );
+  if( 0 >= s32_len )
+    {
+      return( -1 );
+    }
+
+  return( bk_buf_append( buf, (const t_ptr)sz, (t_size)(s32_len - 1) ) );
+}
+#endif
+
 /**
  * @fn	berror_init( t_berror *error )
  * @brief initialise a berror structure
@@ -455,11 +475,17 @@ t_s32 berror_log_init( t_berrorlog *log, t_s32 logfd, t_u32 loglen, t_u8 flags
       return( rt_error = -BERR_INVALID ); /* check: invalid parameters */
     }
 
+#ifdef CONFIG_BK_SYS_BUF
+  /* @remark entries are held by reference, loglen bounds their bytes */
+  log->u_bufs   = 0;
+  log->u_buflen = 0;
+#else
   szptr = (t_str)(mem_alloc(loglen + 1)); /* watch: memory allocation */
   if( NULL == szptr )
     {
       return( rt_error = -BERR_NOSPACE ); /* memory: unable to allocate */
     }
+#endif
   
   log->u_loglen = loglen;
   log->sz_log = szptr;
@@ -486,6 +512,9 @@ t_s32 berror_log_init( t_berrorlog *log, t_s32 logfd, t_u32 loglen, t_u8 flags
       log->i_logfd = logfd;
     }
   log->flushlog = _berror_flushlog_default; /* warning: function pointer */  
+#ifdef CONFIG_BK_SYS_BUF
+  log->flushbuf = _berror_flushbuf_default;
+#endif
 #endif  
   
   berror_log_unlock( log );
@@ -501,12 +530,20 @@ t_s32 berror_log_init( t_berrorlog *log, t_s32 logfd, t_u32 loglen, t_u8 flags
 t_s32 berror_log_flush( t_berrorlog *log )
 {
   t_s32 rt_error = 0;
+#ifdef CONFIG_BK_SYS_BUF
+  t_u32 u_idx;
+#endif
+
   if( NULL == log )
     {
       return( rt_error = -BERR_NOMEM ); /* reference: NULL pointer */
     }
 
+#ifdef CONFIG_BK_SYS_BUF
+  if( (NULL == log->flushbuf) )
+#else
   if( (NULL == log->flushlog) )
+#endif
     {
       return( rt_error = -BERR_INVALID); /* invalid: parameters */
     }
@@ -518,12 +555,33 @@ t_s32 berror_log_flush( t_berrorlog *log )
   
   berror_log_lock( log );
   do {
+#ifdef CONFIG_BK_SYS_BUF
+    for( u_idx = 0; u_idx < log->u_bufs; u_idx++ )
+      {
+	rt_error = log->flushbuf( log->i_logfd, log->buf_log[ u_idx ] );
+	if( 0 > rt_error )
+	  {
+	    break;
+	  }
+	log->u_buflen -= (t_u32) bk_buf_len( log->buf_log[ u_idx ] );
+	bk_buf_release( log->buf_log[ u_idx ] );
+      }
+
+    /* @remark entries not written wait for the next flush */
+    log->u_bufs -= u_idx;
+    mem_move( log->buf_log, log->buf_log + u_idx, log->u_bufs * sizeof(t_bbuf*) );
+    if( (BERR_LOG_BUFS > log->u_bufs) && (log->u_loglen > log->u_buflen) )
+      {
+	log->u8_flags &= ~(BERR_LOGFULL);
+      }
+#else
     rt_error = log->flushlog( log->i_logfd, log->sz_log );
     if( 0 <= rt_error )
       {
 	log->sz_log_ptr = log->sz_log;
 	log->u8_flags  &= ~(BERR_LOGFULL);
       }
+#endif
   } while(0);
   berror_log_unlock( log );
 
@@ -549,7 +607,15 @@ t_s32 berror_log_free( t_berrorlog *log )
     log->sz_log = NULL;
     log->u_loglen = 0;
     log->flushlog = NULL;		/* WARNING! NULL function pointer */
-  
+#ifdef CONFIG_BK_SYS_BUF
+    while( log->u_bufs > 0 )
+      {
+	bk_buf_release( log->buf_log[ --log->u_bufs ] );
+      }
+    log->u_buflen = 0;
+    log->flushbuf = NULL;
+#endif
+
   } while(0);
   berror_log_unlock( log );
 
@@ -566,9 +632,14 @@ t_s32 berror_log_free( t_berrorlog *log )
 t_s32 berror_log( t_berrorlog *log, t_szerror *szerror, const t_str szprefix )
 {
   t_s32 rt_error = 0;
-  t_s32 szlen  = 0;
   t_str prefix;
+#ifdef CONFIG_BK_SYS_BUF
+  t_bbuf *line;
+  t_s32 i_failed = 0;
+#else
+  t_s32 szlen  = 0;
   t_str szcurr  = NULL;
+#endif
 
   if( (NULL == log) || (NULL == szerror ) )
     {
@@ -588,16 +659,36 @@ t_s32 berror_log( t_berrorlog *log, t_szerror *szerror, const t_str szprefix )
   prefix = szprefix;
   if( (NULL == prefix) || (BK_CHR_NULL == *prefix) )
     {
-      prefix = (t_str)mem_alloc( BERR_SZ_HDRLEN );
-      _berror_strcpy( prefix, SZ_BERR_DEFPREFIX );
+      prefix = (t_str)SZ_BERR_DEFPREFIX;
     }
 
   if( log->pid > 0)
     {
       _berror_ultostr(log->pid, (t_str)_bk_sz_pid_prefix);
     }
- 
-  
+
+#ifdef CONFIG_BK_SYS_BUF
+  /* @remark the line is built once and handed to the log by reference */
+  line = bk_buf_new( BERR_SZ_LEN );
+  if( NULL == line )
+    {
+      return( rt_error = -BERR_NOSPACE ); /* memory: unable to allocate */
+    }
+
+  if( log->pid > 0 )
+    {
+      i_failed |= _berror_buf_append( line, (t_str)_bk_sz_pid_prefix );
+      i_failed |= _berror_buf_append( line, SZ_BERR_DELIM );
+    }
+  i_failed |= _berror_buf_append( line, prefix );
+  i_failed |= _berror_buf_append( line, (t_str)szerror->szerr_head );
+  i_failed |= _berror_buf_append( line, SZ_BERR_DELIM );
+  i_failed |= _berror_buf_append( line, (t_str)szerror->szerr_desc );
+  i_failed |= _berror_buf_append( line, BK_STR_EOL );
+
+  rt_error = (0 == i_failed) ? berror_log_buf( log, line ) : -BERR_NOSPACE;
+  bk_buf_release( line );
+#else
   berror_log_lock( log );
   /**
    * @TODO
@@ -648,15 +739,63 @@ t_s32 berror_log( t_berrorlog *log, t_szerror *szerror, const t_str szprefix )
 
   } while(0);
   berror_log_unlock( log );
+#endif	/* CONFIG_BK_SYS_BUF */
 
-  if( NULL == szprefix )
+  return( rt_error );
+}
+
+#ifdef CONFIG_BK_SYS_BUF
+/**
+ * @fn berror_log_buf( t_berrorlog *log, t_bbuf *msg )
+ * @brief log a message the caller already holds in a buffer
+ * @details
+ * The log keeps a reference to msg instead of a copy of its
+ * bytes, so a slice of a larger buffer is logged as it is.
+ * berror_log_flush() writes the entries out in order and gives
+ * the references back; msg is sealed from here on.
+ * @return 0 if success, -ve if failure
+ */
+t_s32 berror_log_buf( t_berrorlog *log, t_bbuf *msg )
+{
+  t_s32 rt_error = 0;
+
+  if( (NULL == log) || (NULL == msg) )
     {
-      mem_free(prefix);		/* avoid dangling pointers */
-      prefix = NULL;
+      return( rt_error = -BERR_NOMEM ); /* reference: NULL pointer */
     }
 
+  if(!IS_LOG_VALID(log))
+    {
+      return( rt_error = -BERR_INVALID ); /* invalid: log parameter or content */
+    }
+
+  if( BERR_LOGFULL == (log->u8_flags & BERR_LOGFULL) )
+    {
+      return( rt_error = -BERR_NOSPACE ); /* memory: insufficient for log */
+    }
+
+  berror_log_lock( log );
+  do {
+    if( BERR_LOG_BUFS <= log->u_bufs )
+      {
+	log->u8_flags |= BERR_LOGFULL;
+	rt_error = -BERR_NOSPACE;
+	break;
+      }
+
+    log->buf_log[ log->u_bufs++ ] = bk_buf_ref( msg );
+    log->u_buflen += (t_u32) bk_buf_len( msg );
+
+    if( (BERR_LOG_BUFS <= log->u_bufs) || (log->u_loglen <= log->u_buflen) )
+      {
+	log->u8_flags |= BERR_LOGFULL;
+      }
+  } while(0);
+  berror_log_unlock( log );
+
   return( rt_error );
 }
+#endif	/* CONFIG_BK_SYS_BUF */
 
 #if defined(BERROR_FLUSHLOG_DEFAULTS)
 /**
@@ -706,6 +845,25 @@ t_s32 _berror_flushlog_default( t_s32 fd, t_str szflush )
   
   return( rt_error );
 }
+
+#ifdef CONFIG_BK_SYS_BUF
+/**
+ * @fn t_s32 _berror_flushbuf_default( t_s32 fd, t_bbuf *buf )
+ * @brief write one log entry to an open file descriptor
+ * @return -ve on error, 0 or >0 on success
+ */
+t_s32 _berror_flushbuf_default( t_s32 fd, t_bbuf *buf )
+{
+  t_s32 rt_error = 0;
+
+  if( ZERO != bk_buf_len( buf ) )
+    {
+      rt_error = write( fd, bk_buf_data( buf ), bk_buf_len( buf ) );
+    }
+
+  return( rt_error );
+}
+#endif
 #endif	/* BERROR_FLUSHLOG_DEFAULTS */
 
 
@@ -43,7 +43,297 @@ extern int	JEMALLOC_P(rallocm)(void **ptr, size_t *rsize, size_t size,
     size_t extra, int flags);
 extern int	JEMALLOC_P(sallocm)(const void *ptr, size_t *rsize, int flags);
 extern int      JEMALLOC_P(dallocm)(void *ptr, int flags);
+extern int	JEMALLOC_P(sdallocm)(void *ptr, size_t size, int flags);
+extern int	JEMALLOC_P(batchallocm)(void **ptrs, size_t *rsize, size_t size,
+    size_t n, int flags);
 
+/* @remark allocm flags and results, as in jemalloc.h */
+#ifndef ALLOCM_NO_MOVE
+#define ALLOCM_NO_MOVE		((int)0x80)
+#define ALLOCM_SUCCESS		0
+#define ALLOCM_ALIGN(a)		(__builtin_ffsl(a)-1)
+#endif
+
+/**
+ * @fn _bk_jemalloc_expand( t_ptr ptr, t_size ubytes, t_size extra )
+ * @brief resize a jemalloc block without moving it
+ * @details
+ * jemalloc grows a block in place up to ubytes + extra where
+ * the run or chunk behind it has room, and shrinks it in place.
+ *
+ * @return usable size of the block, 0 if it would have to move
+ */
+static t_size _bk_jemalloc_expand( t_ptr ptr, t_size ubytes, t_size extra )
+{
+  void *ptr_mem = ptr;
+  size_t rsize  = 0;
+
+  if( ALLOCM_SUCCESS != JEMALLOC_P(rallocm)( &ptr_mem, &rsize, ubytes, extra,
+					     ALLOCM_NO_MOVE ) )
+    {
+      return( 0 );
+    }
+
+  return( rsize );
+}
+
+/**
+ * @fn _bk_jemalloc_memalign( t_size alignment, t_size ubytes )
+ * @brief aligned allocation through allocm()
+ * @return block on success, NULL on failure
+ */
+static t_ptr _bk_jemalloc_memalign( t_size alignment, t_size ubytes )
+{
+  void *ptr_mem = NULL;
+
+  if( ALLOCM_SUCCESS != JEMALLOC_P(allocm)( &ptr_mem, NULL, ubytes,
+					    ALLOCM_ALIGN(alignment) ) )
+    {
+      return( NULL );
+    }
+
+  return( ptr_mem );
+}
+
+/**
+ * @fn _bk_jemalloc_alloc_batch( t_size ubytes, t_ptr *ptrs, t_u32 count )
+ * @brief allocate count blocks of ubytes in one call
+ * @remark small sizes are carved from an arena bin under one
+ *         bin lock, see batchallocm().
+ * @return count on success, 0 on failure
+ */
+static t_u32 _bk_jemalloc_alloc_batch( t_size ubytes, t_ptr *ptrs, t_u32 count )
+{
+  if( ALLOCM_SUCCESS != JEMALLOC_P(batchallocm)( ptrs, NULL, ubytes, count, 0 ) )
+    {
+      return( 0 );
+    }
+
+  return( count );
+}
+
+/**
+ * @fn _bk_jemalloc_free_sized( t_ptr ptr, t_size ubytes )
+ * @brief release a block of ubytes from malloc() or calloc()
+ * @remark small blocks go to the bin of their size class without
+ *         a chunk map lookup, see sdallocm().
+ */
+static t_void _bk_jemalloc_free_sized( t_ptr ptr, t_size ubytes )
+{
+  JEMALLOC_P(sdallocm)( ptr, ubytes, 0 );
+  return;
+}
+
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+/**
+ * @remark statistics
+ * names are resolved to MIBs once, when jemalloc is installed, and
+ * a poll only puts arena and bin numbers into copies of them. the
+ * stats.* counters exist only in a jemalloc built with
+ * JEMALLOC_STATS; without them pages and size classes are all
+ * that can be reported.
+ */
+#define BK_JE_MIB_DEPTH		6	/* stats.arenas.<i>.bins.<j>.nmalloc */
+
+#define BK_JE_EPOCH		0
+#define BK_JE_PACTIVE		1
+#define BK_JE_PDIRTY		2
+#define BK_JE_ALLOCATED		3	/* first of the JEMALLOC_STATS ones */
+#define BK_JE_ACTIVE		4
+#define BK_JE_MAPPED		5
+#define BK_JE_BIN_ALLOCATED	6
+#define BK_JE_BIN_NMALLOC	7
+#define BK_JE_BIN_NDALLOC	8
+#define BK_JE_BIN_NFILLS	9	/* JEMALLOC_TCACHE as well */
+#define BK_JE_BIN_NFLUSHES	10
+#define BK_JE_MIBS		11
+
+static const char *je_stats_names[ BK_JE_MIBS ] = {
+  "epoch",
+  "stats.arenas.0.pactive",
+  "stats.arenas.0.pdirty",
+  "stats.allocated",
+  "stats.active",
+  "stats.mapped",
+  "stats.arenas.0.bins.0.allocated",
+  "stats.arenas.0.bins.0.nmalloc",
+  "stats.arenas.0.bins.0.ndalloc",
+  "stats.arenas.0.bins.0.nfills",
+  "stats.arenas.0.bins.0.nflushes"
+};
+
+static size_t je_stats_mib[ BK_JE_MIBS ][ BK_JE_MIB_DEPTH ];
+static size_t je_stats_miblen[ BK_JE_MIBS ];	/* @remark 0 if unknown */
+static t_u32  je_stats_flags = ZERO;
+static t_u32  je_stats_arenas = ZERO;
+static t_u32  je_stats_bins = ZERO;
+static size_t je_stats_page = ZERO;
+static size_t je_stats_bin_size[ BKIT_MEM_STATS_BINS ];
+
+/**
+ * @fn _bk_jemalloc_stats_read( t_u32 u_which, size_t u_i, size_t u_j, void *val, size_t u_len )
+ * @brief read one statistic through its cached MIB
+ * @param u_i arena, or jemalloc's arena count for all of them
+ * @param u_j size class, where the statistic has one
+ * @return 0 on success, -ve on failure with val unchanged
+ */
+static int _bk_jemalloc_stats_read( t_u32 u_which, size_t u_i, size_t u_j,
+				    void *val, size_t u_len )
+{
+  size_t mib[ BK_JE_MIB_DEPTH ];
+  size_t u_idx;
+
+  if( ZERO == je_stats_miblen[ u_which ] )
+    {
+      return( -1 );
+    }
+
+  for( u_idx = 0; u_idx < je_stats_miblen[ u_which ]; u_idx++ )
+    {
+      mib[ u_idx ] = je_stats_mib[ u_which ][ u_idx ];
+    }
+  mib[ 2 ] = u_i;	/* @remark past the end of short MIBs, unused */
+  mib[ 4 ] = u_j;
+
+  return( (0 == JEMALLOC_P(mallctlbymib)( mib, je_stats_miblen[ u_which ],
+					  val, &u_len, NULL, 0 )) ? 0 : -1 );
+}
+
+/**
+ * @fn _bk_jemalloc_stats_init( void )
+ * @brief resolve the statistics MIBs and the constant values
+ */
+static void _bk_jemalloc_stats_init( void )
+{
+  size_t u_len, mib[ BK_JE_MIB_DEPTH ], u_miblen;
+  unsigned u_count;
+  t_u32 u_idx;
+
+  for( u_idx = 0; u_idx < BK_JE_MIBS; u_idx++ )
+    {
+      je_stats_miblen[ u_idx ] = BK_JE_MIB_DEPTH;
+      if( 0 != JEMALLOC_P(mallctlnametomib)( je_stats_names[ u_idx ],
+					     je_stats_mib[ u_idx ],
+					     &je_stats_miblen[ u_idx ] ) )
+	{
+	  je_stats_miblen[ u_idx ] = ZERO;
+	}
+    }
+
+  je_stats_flags = BKIT_MEM_STATS_BACKEND;
+  for( u_idx = BK_JE_ALLOCATED; u_idx < BK_JE_BIN_NFILLS; u_idx++ )
+    {
+      if( ZERO == je_stats_miblen[ u_idx ] )
+	{
+	  break;
+	}
+    }
+  if( BK_JE_BIN_NFILLS == u_idx )
+    {
+      je_stats_flags |= BKIT_MEM_STATS_COUNTERS;
+    }
+
+  u_len = sizeof(u_count);
+  if( 0 == JEMALLOC_P(mallctl)( "arenas.narenas", &u_count, &u_len, NULL, 0 ) )
+    {
+      je_stats_arenas = u_count;
+    }
+  u_len = sizeof(je_stats_page);
+  JEMALLOC_P(mallctl)( "arenas.pagesize", &je_stats_page, &u_len, NULL, 0 );
+
+  u_len = sizeof(u_count);
+  u_miblen = BK_JE_MIB_DEPTH;
+  if( (0 != JEMALLOC_P(mallctl)( "arenas.nbins", &u_count, &u_len, NULL, 0 )) ||
+      (0 != JEMALLOC_P(mallctlnametomib)( "arenas.bin.0.size", mib, &u_miblen )) )
+    {
+      return;
+    }
+
+  je_stats_bins = (u_count < BKIT_MEM_STATS_BINS) ? u_count : BKIT_MEM_STATS_BINS;
+  for( u_idx = 0; u_idx < je_stats_bins; u_idx++ )
+    {
+      mib[ 2 ] = u_idx;
+      u_len = sizeof(size_t);
+      JEMALLOC_P(mallctlbymib)( mib, u_miblen, &je_stats_bin_size[ u_idx ],
+				&u_len, NULL, 0 );
+    }
+
+  return;
+}
+
+/**
+ * @fn _bk_jemalloc_stats( t_mem_stats *stats )
+ * @brief fill in the jemalloc part of a snapshot
+ * @details
+ * Writing the epoch makes jemalloc merge the counters of its
+ * arenas once, every read after that is a copy. Bins are the
+ * merged ones, kept by jemalloc after the last arena.
+ */
+static t_void _bk_jemalloc_stats( t_mem_stats *stats )
+{
+  t_u64 u_epoch = 1;
+  t_u32 u_arena, u_bin;
+  t_mem_stats_bin *bin;
+  size_t u_len, u_total;
+
+  u_len = sizeof(u_epoch);
+  if( (ZERO == je_stats_miblen[ BK_JE_EPOCH ]) ||
+      (0 != JEMALLOC_P(mallctlbymib)( je_stats_mib[ BK_JE_EPOCH ],
+				      je_stats_miblen[ BK_JE_EPOCH ],
+				      &u_epoch, &u_len, &u_epoch, sizeof(u_epoch) )) )
+    {
+      return;
+    }
+
+  stats->flags     = je_stats_flags;
+  stats->page_size = je_stats_page;
+  stats->n_arenas  = (je_stats_arenas < BKIT_MEM_STATS_ARENAS) ?
+    je_stats_arenas : BKIT_MEM_STATS_ARENAS;
+
+  for( u_arena = 0; u_arena < stats->n_arenas; u_arena++ )
+    {
+      _bk_jemalloc_stats_read( BK_JE_PACTIVE, u_arena, 0,
+			       &stats->pactive[ u_arena ], sizeof(size_t) );
+      _bk_jemalloc_stats_read( BK_JE_PDIRTY, u_arena, 0,
+			       &stats->pdirty[ u_arena ], sizeof(size_t) );
+    }
+
+  if( BKIT_MEM_STATS_COUNTERS & je_stats_flags )
+    {
+      _bk_jemalloc_stats_read( BK_JE_ALLOCATED, 0, 0, &stats->allocated, sizeof(size_t) );
+      _bk_jemalloc_stats_read( BK_JE_ACTIVE, 0, 0, &stats->active, sizeof(size_t) );
+      _bk_jemalloc_stats_read( BK_JE_MAPPED, 0, 0, &stats->mapped, sizeof(size_t) );
+    }
+  else if( 0 == _bk_jemalloc_stats_read( BK_JE_PACTIVE, je_stats_arenas, 0,
+					 &u_total, sizeof(u_total) ) )
+    {
+      stats->active = u_total * je_stats_page;	/* @remark huge blocks left out */
+    }
+
+  stats->n_bins = je_stats_bins;
+  for( u_bin = 0; u_bin < je_stats_bins; u_bin++ )
+    {
+      bin = &stats->bins[ u_bin ];
+      bin->size = je_stats_bin_size[ u_bin ];
+      if( 0 == (BKIT_MEM_STATS_COUNTERS & je_stats_flags) )
+	{
+	  continue;
+	}
+      _bk_jemalloc_stats_read( BK_JE_BIN_ALLOCATED, je_stats_arenas, u_bin,
+			       &bin->allocated, sizeof(size_t) );
+      _bk_jemalloc_stats_read( BK_JE_BIN_NMALLOC, je_stats_arenas, u_bin,
+			       &bin->n_malloc, sizeof(t_u64) );
+      _bk_jemalloc_stats_read( BK_JE_BIN_NDALLOC, je_stats_arenas, u_bin,
+			       &bin->n_dalloc, sizeof(t_u64) );
+      _bk_jemalloc_stats_read( BK_JE_BIN_NFILLS, je_stats_arenas, u_bin,
+			       &bin->n_fills, sizeof(t_u64) );
+      _bk_jemalloc_stats_read( BK_JE_BIN_NFLUSHES, je_stats_arenas, u_bin,
+			       &bin->n_flushes, sizeof(t_u64) );
+    }
+
+  return;
+}
+#endif	/* CONFIG_BK_SYS_MEM_STATS */
 
 /**
  * @fn bk_jemalloc_calls( t_memory_calls *p )
@@ -56,6 +346,16 @@ t_void bk_jemalloc_calls( t_memory_calls *p )
   p->calloc     = JEMALLOC_P(calloc);
   p->free       = JEMALLOC_P(free);
   p->realloc    = JEMALLOC_P(realloc);
+  p->expand     = _bk_jemalloc_expand;
+  p->alloc_batch = _bk_jemalloc_alloc_batch;
+  p->free_sized = _bk_jemalloc_free_sized;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+  _bk_jemalloc_stats_init();
+  p->stats      = _bk_jemalloc_stats;
+#else
+  p->stats      = NULL;
+#endif
+  p->memalign   = _bk_jemalloc_memalign;
   p->alloc_used = 0;
 
   mem_changecalls( p );
@@ -0,0 +1,200 @@
+/**
+ * @file	bmutex.c
+ * @author	Sunil Beta <betasam@gmail.com>
+ * @date	2010-2012
+ * @brief	adaptive mutual exclusion lock
+ * @details
+ * Three state lock after Drepper's "Futexes Are Tricky".
+ * The state word is FREE, LOCKED or WAITERS; only an unlock
+ * of a lock in WAITERS state has to enter the kernel.
+ *
+ * @warning	relies on gcc __sync builtins.
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_SYSTEM
+
+/* @remark Standard Includes */
+#include <unistd.h>
+#include <sched.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/* @remark bkit Includes */
+#include <btypes.h>
+
+#include <bmutex.h>
+
+/**
+ * @fn _bk_mutex_relax( void )
+ * @brief hint to the processor that we are spinning
+ */
+static inline void _bk_mutex_relax( void )
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ volatile( "pause" ::: "memory" );
+#else
+  __sync_synchronize();
+#endif
+}
+
+/**
+ * @fn _bk_mutex_park( t_bmutex *mutex )
+ * @brief sleep while the lock is held with waiters
+ */
+static inline void _bk_mutex_park( t_bmutex *mutex )
+{
+#if defined(__linux__)
+  syscall( SYS_futex, &mutex->state, FUTEX_WAIT_PRIVATE,
+	   BK_MUTEX_WAITERS, NULL, NULL, 0 );
+#else
+  sched_yield();
+#endif
+}
+
+/**
+ * @fn _bk_mutex_wake( t_bmutex *mutex )
+ * @brief wake up one parked waiter
+ */
+static inline void _bk_mutex_wake( t_bmutex *mutex )
+{
+#if defined(__linux__)
+  syscall( SYS_futex, &mutex->state, FUTEX_WAKE_PRIVATE,
+	   1, NULL, NULL, 0 );
+#endif
+}
+
+/**
+ * @fn t_void bk_mutex_init( t_bmutex *mutex )
+ * @brief initialise a lock to the unlocked state
+ * @remark same as assigning BK_MUTEX_INITIALIZER
+ */
+t_void bk_mutex_init( t_bmutex *mutex )
+{
+  if( NULL == mutex )
+    {
+      return;
+    }
+
+  mutex->state       = BK_MUTEX_FREE;
+  mutex->spin        = BK_MUTEX_SPIN_DEFAULT;
+  mutex->n_acquired  = 0;
+  mutex->n_contended = 0;
+  mutex->n_parked    = 0;
+
+  return;
+}
+
+/**
+ * @fn t_void bk_mutex_lock( t_bmutex *mutex )
+ * @brief acquire the lock, waiting if necessary
+ * @details
+ * Fast path is one compare and swap. On contention the
+ * caller spins for mutex->spin iterations, after which it
+ * marks the lock as having waiters and parks on the futex.
+ */
+t_void bk_mutex_lock( t_bmutex *mutex )
+{
+  t_s32 state;
+  t_u32 u_spin;
+  t_u64 u_parked = 0;
+
+  state = __sync_val_compare_and_swap( &mutex->state, BK_MUTEX_FREE, BK_MUTEX_LOCKED );
+  if( BK_MUTEX_FREE == state )
+    {
+      mutex->n_acquired++;
+      return;
+    }
+
+  /* @remark brief spin, the holder is usually about to leave */
+  for( u_spin = 0; u_spin < mutex->spin; u_spin++ )
+    {
+      _bk_mutex_relax();
+      if( (BK_MUTEX_FREE == mutex->state) &&
+	  (BK_MUTEX_FREE == __sync_val_compare_and_swap( &mutex->state, BK_MUTEX_FREE,
+							 BK_MUTEX_LOCKED )) )
+	{
+	  goto acquired;
+	}
+    }
+
+  /* @remark park, any lock we take from here on may have waiters */
+  if( BK_MUTEX_WAITERS != state )
+    {
+      state = __sync_lock_test_and_set( &mutex->state, BK_MUTEX_WAITERS );
+    }
+  while( BK_MUTEX_FREE != state )
+    {
+      _bk_mutex_park( mutex );
+      u_parked++;
+      state = __sync_lock_test_and_set( &mutex->state, BK_MUTEX_WAITERS );
+    }
+
+ acquired:
+  mutex->n_acquired++;
+  mutex->n_contended++;
+  mutex->n_parked += u_parked;
+
+  return;
+}
+
+/**
+ * @fn t_s32 bk_mutex_trylock( t_bmutex *mutex )
+ * @brief acquire the lock only if it is free
+ * @return 0 on success, -1 if the lock is held
+ */
+t_s32 bk_mutex_trylock( t_bmutex *mutex )
+{
+  if( BK_MUTEX_FREE != __sync_val_compare_and_swap( &mutex->state, BK_MUTEX_FREE,
+						    BK_MUTEX_LOCKED ) )
+    {
+      return( -1 );
+    }
+  mutex->n_acquired++;
+
+  return( 0 );
+}
+
+/**
+ * @fn t_void bk_mutex_unlock( t_bmutex *mutex )
+ * @brief release the lock, waking a waiter if any
+ * @remark caller must be the lock holder
+ */
+t_void bk_mutex_unlock( t_bmutex *mutex )
+{
+  if( BK_MUTEX_LOCKED != __sync_fetch_and_sub( &mutex->state, 1 ) )
+    {
+      mutex->state = BK_MUTEX_FREE;
+      __sync_synchronize();
+      _bk_mutex_wake( mutex );
+    }
+
+  return;
+}
+
+/**
+ * @fn t_void bk_mutex_stats( t_bmutex *mutex, t_bmutex_stats *stats )
+ * @brief copy out the contention counters of a lock
+ * @remark counters are read without the lock, values may be
+ *         off by the acquisitions in flight.
+ */
+t_void bk_mutex_stats( t_bmutex *mutex, t_bmutex_stats *stats )
+{
+  if( (NULL == mutex) || (NULL == stats) )
+    {
+      return;
+    }
+
+  stats->acquired  = mutex->n_acquired;
+  stats->contended = mutex->n_contended;
+  stats->parked    = mutex->n_parked;
+
+  return;
+}
+
+#endif	/* CONFIG_BK_SYSTEM */
+/* @remark end of file "bmutex.c" */
@@ -165,7 +165,7 @@ static arena_chunk_t *arena_chunk_alloc(arena_t *arena);
 static void	arena_chunk_dealloc(arena_t *arena, arena_chunk_t *chunk);
 static arena_run_t *arena_run_alloc(arena_t *arena, size_t size, bool large,
     bool zero);
-static void	arena_purge(arena_t *arena, bool all);
+static size_t	arena_purge(arena_t *arena, bool all);
 static void	arena_run_dalloc(arena_t *arena, arena_run_t *run, bool dirty);
 static void	arena_run_trim_head(arena_t *arena, arena_chunk_t *chunk,
     arena_run_t *run, size_t oldsize, size_t newsize);
@@ -654,24 +654,39 @@ arena_run_alloc(arena_t *arena, size_t size, bool large, bool zero)
 	return (NULL);
 }
 
-static inline void
-arena_maybe_purge(arena_t *arena)
+static inline bool
+arena_purge_needed(arena_t *arena)
 {
 
 	/* Enforce opt_lg_dirty_mult. */
-	if (opt_lg_dirty_mult >= 0 && arena->ndirty > arena->npurgatory &&
+	return (opt_lg_dirty_mult >= 0 && arena->ndirty > arena->npurgatory &&
 	    (arena->ndirty - arena->npurgatory) > chunk_npages &&
 	    (arena->nactive >> opt_lg_dirty_mult) < (arena->ndirty -
-	    arena->npurgatory))
-		arena_purge(arena, false);
+	    arena->npurgatory));
 }
 
 static inline void
+arena_maybe_purge(arena_t *arena)
+{
+
+	if (arena_purge_needed(arena)) {
+#ifdef JEMALLOC_BACKGROUND_THREAD
+		/* Keep madvise() off the deallocation path if possible. */
+		if (background_thread_enabled) {
+			background_thread_wakeup();
+			return;
+		}
+#endif
+		arena_purge(arena, false);
+	}
+}
+
+static inline size_t
 arena_chunk_purge(arena_t *arena, arena_chunk_t *chunk)
 {
 	ql_head(arena_chunk_map_t) mapelms;
 	arena_chunk_map_t *mapelm;
-	size_t pageind, flag_unzeroed;
+	size_t pageind, flag_unzeroed, npurged;
 #ifdef JEMALLOC_DEBUG
 	size_t ndirty;
 #endif
@@ -773,6 +788,7 @@ arena_chunk_purge(arena_t *arena, arena_chunk_t *chunk)
 #ifdef JEMALLOC_DEBUG
 	ndirty = chunk->ndirty;
 #endif
+	npurged = chunk->ndirty;
 #ifdef JEMALLOC_STATS
 	arena->stats.purged += chunk->ndirty;
 #endif
@@ -829,13 +845,15 @@ arena_chunk_purge(arena_t *arena, arena_chunk_t *chunk)
 		ql_remove(&mapelms, mapelm, u.ql_link);
 		arena_run_dalloc(arena, run, false);
 	}
+
+	return (npurged);
 }
 
-static void
+static size_t
 arena_purge(arena_t *arena, bool all)
 {
 	arena_chunk_t *chunk;
-	size_t npurgatory;
+	size_t npurgatory, npurged;
 #ifdef JEMALLOC_DEBUG
 	size_t ndirty = 0;
 
@@ -862,6 +880,7 @@ arena_purge(arena_t *arena, bool all)
 	if (all == false)
 		npurgatory -= arena->nactive >> opt_lg_dirty_mult;
 	arena->npurgatory += npurgatory;
+	npurged = 0;
 
 	while (npurgatory > 0) {
 		/* Get next chunk with dirty pages. */
@@ -874,7 +893,7 @@ arena_purge(arena_t *arena, bool all)
 			 * dirty pages.
 			 */
 			arena->npurgatory -= npurgatory;
-			return;
+			return (npurged);
 		}
 		while (chunk->ndirty == 0) {
 			ql_remove(&arena->chunks_dirty, chunk, link_dirty);
@@ -883,7 +902,7 @@ arena_purge(arena_t *arena, bool all)
 			if (chunk == NULL) {
 				/* Same logic as for above. */
 				arena->npurgatory -= npurgatory;
-				return;
+				return (npurged);
 			}
 		}
 
@@ -912,8 +931,10 @@ arena_purge(arena_t *arena, bool all)
 
 		arena->npurgatory -= chunk->ndirty;
 		npurgatory -= chunk->ndirty;
-		arena_chunk_purge(arena, chunk);
+		npurged += arena_chunk_purge(arena, chunk);
 	}
+
+	return (npurged);
 }
 
 void
@@ -925,6 +946,51 @@ arena_purge_all(arena_t *arena)
 	malloc_mutex_unlock(&arena->lock);
 }
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+/*
+ * Purge on behalf of the background thread: with decay, every chunk whose
+ * oldest dirty page dates from BACKGROUND_THREAD_NTICKS or more epochs before
+ * epoch, and then whatever opt_lg_dirty_mult still calls for.  Returns the
+ * number of pages purged.
+ */
+size_t
+arena_purge_background(arena_t *arena, bool decay, unsigned epoch)
+{
+	arena_chunk_t *chunk;
+	size_t npurged;
+
+	npurged = 0;
+	malloc_mutex_lock(&arena->lock);
+	if (decay) {
+		chunk = ql_first(&arena->chunks_dirty);
+		while (chunk != NULL) {
+			arena_chunk_t *next = ql_next(&arena->chunks_dirty,
+			    chunk, link_dirty);
+
+			if (chunk->ndirty == 0) {
+				ql_remove(&arena->chunks_dirty, chunk,
+				    link_dirty);
+				chunk->dirtied = false;
+			} else if (epoch - chunk->dirty_epoch >=
+			    BACKGROUND_THREAD_NTICKS) {
+				/*
+				 * arena->lock is dropped while purging, so
+				 * start over from the head of the list.
+				 */
+				npurged += arena_chunk_purge(arena, chunk);
+				next = ql_first(&arena->chunks_dirty);
+			}
+			chunk = next;
+		}
+	}
+	if (arena_purge_needed(arena))
+		npurged += arena_purge(arena, false);
+	malloc_mutex_unlock(&arena->lock);
+
+	return (npurged);
+}
+#endif
+
 static void
 arena_run_dalloc(arena_t *arena, arena_run_t *run, bool dirty)
 {
@@ -967,6 +1033,10 @@ arena_run_dalloc(arena_t *arena, arena_run_t *run, bool dirty)
 		chunk->map[run_ind+run_pages-1-map_bias].bits = size |
 		    CHUNK_MAP_DIRTY;
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+		if (chunk->ndirty == 0)
+			chunk->dirty_epoch = background_thread_epoch;
+#endif
 		chunk->ndirty += run_pages;
 		arena->ndirty += run_pages;
 	} else {
@@ -1339,7 +1409,8 @@ arena_tcache_fill_small(arena_t *arena, tcache_bin_t *tbin, size_t binind
 #endif
 	bin = &arena->bins[binind];
 	malloc_mutex_lock(&bin->lock);
-	for (i = 0, nfill = (tbin->ncached_max >> 1); i < nfill; i++) {
+	for (i = 0, nfill = (tbin->ncached_max >> tbin->lg_fill_div); i <
+	    nfill; i++) {
 		if ((run = bin->runcur) != NULL && run->nfree > 0)
 			ptr = arena_run_reg_alloc(run, bin);
 		else
@@ -1522,6 +1593,65 @@ arena_malloc_small(arena_t *arena, size_t size, bool zero)
 	return (ret);
 }
 
+/*
+ * Allocate up to n regions of one small size class while holding the bin
+ * lock once, the way arena_tcache_fill_small() refills a tcache bin.
+ * Returns the number of regions stored in ptrs, which is less than n only
+ * if memory ran out.
+ */
+size_t
+arena_malloc_small_batch(arena_t *arena, size_t size, bool zero, void **ptrs,
+    size_t n)
+{
+	size_t i, j, binind;
+	arena_bin_t *bin;
+	arena_run_t *run;
+	void *ptr;
+
+	binind = small_size2bin[size];
+	assert(binind < nbins);
+	bin = &arena->bins[binind];
+	size = bin->reg_size;
+
+	malloc_mutex_lock(&bin->lock);
+	for (i = 0; i < n; i++) {
+		if ((run = bin->runcur) != NULL && run->nfree > 0)
+			ptr = arena_run_reg_alloc(run, bin);
+		else
+			ptr = arena_bin_malloc_hard(arena, bin);
+		if (ptr == NULL)
+			break;
+		ptrs[i] = ptr;
+	}
+#ifdef JEMALLOC_STATS
+	bin->stats.allocated += i * size;
+	bin->stats.nmalloc += i;
+	bin->stats.nrequests += i;
+#endif
+	malloc_mutex_unlock(&bin->lock);
+#ifdef JEMALLOC_PROF
+	if (isthreaded == false) {
+		malloc_mutex_lock(&arena->lock);
+		arena_prof_accum(arena, i * size);
+		malloc_mutex_unlock(&arena->lock);
+	}
+#endif
+
+	for (j = 0; j < i; j++) {
+		if (zero == false) {
+#ifdef JEMALLOC_FILL
+			if (opt_junk)
+				memset(ptrs[j], 0xa5, size);
+			else if (opt_zero)
+				memset(ptrs[j], 0, size);
+#endif
+		} else
+			memset(ptrs[j], 0, size);
+	}
+
+	return (i);
+}
+
 void *
 arena_malloc_large(arena_t *arena, size_t size, bool zero)
 {
@@ -0,0 +1,275 @@
+#define	JEMALLOC_BACKGROUND_THREAD_C_
+#include "jemalloc/internal/jemalloc_internal.h"
+#ifdef JEMALLOC_BACKGROUND_THREAD
+
+/******************************************************************************/
+/* Data. */
+
+bool	opt_background_thread = false;
+ssize_t	opt_dirty_decay_ms = DIRTY_DECAY_MS_DEFAULT;
+
+malloc_mutex_t			background_thread_mtx;
+ssize_t				dirty_decay_ms;
+background_thread_stats_t	background_thread_stats;
+bool				background_thread_enabled;
+unsigned			background_thread_epoch;
+
+/*
+ * Set by background_thread_wakeup() so that a burst of deallocations signals
+ * the thread once rather than on every free.
+ */
+static bool			background_thread_signaled;
+static pthread_cond_t		background_thread_cond;
+static pthread_t		background_thread;
+
+/******************************************************************************/
+/* Function prototypes for non-inline static functions. */
+
+static bool	background_thread_cond_init(void);
+static uint64_t	background_thread_now(void);
+static uint64_t	background_thread_interval(void);
+static size_t	background_thread_purge(bool decay, unsigned epoch);
+static void	*background_thread_entry(void *arg);
+static void	background_thread_postfork_child(void);
+
+/******************************************************************************/
+
+/* Timed waits use CLOCK_MONOTONIC, so that clock changes are ignored. */
+static bool
+background_thread_cond_init(void)
+{
+	pthread_condattr_t attr;
+
+	if (pthread_condattr_init(&attr) != 0)
+		return (true);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (pthread_cond_init(&background_thread_cond, &attr) != 0) {
+		pthread_condattr_destroy(&attr);
+		return (true);
+	}
+	pthread_condattr_destroy(&attr);
+
+	return (false);
+}
+
+static uint64_t
+background_thread_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec);
+}
+
+/* Nanoseconds between wakeups.  background_thread_mtx must be held. */
+static uint64_t
+background_thread_interval(void)
+{
+	uint64_t ms;
+
+	/*
+	 * With decay disabled the thread still wakes up to enforce
+	 * opt_lg_dirty_mult, at the pace of the default decay.
+	 */
+	ms = ((dirty_decay_ms < 0) ? DIRTY_DECAY_MS_DEFAULT : dirty_decay_ms) /
+	    BACKGROUND_THREAD_NTICKS;
+	if (ms < BACKGROUND_THREAD_MIN_INTERVAL)
+		ms = BACKGROUND_THREAD_MIN_INTERVAL;
+
+	return (ms * 1000000);
+}
+
+static size_t
+background_thread_purge(bool decay, unsigned epoch)
+{
+	size_t npurged;
+	unsigned i;
+
+	/*
+	 * Elements of arenas are only ever set once, from NULL, so they can be
+	 * read without arenas_lock.
+	 */
+	npurged = 0;
+	for (i = 0; i < narenas; i++) {
+		if (arenas[i] != NULL)
+			npurged += arena_purge_background(arenas[i], decay,
+			    epoch);
+	}
+
+	return (npurged);
+}
+
+static void *
+background_thread_entry(void *arg)
+{
+	uint64_t now, next;
+
+	malloc_mutex_lock(&background_thread_mtx);
+	next = background_thread_now() + background_thread_interval();
+	while (background_thread_enabled) {
+		size_t npurged;
+		uint64_t start, elapsed;
+		bool decay;
+		unsigned epoch;
+
+		now = background_thread_now();
+		if (now < next && background_thread_signaled == false) {
+			struct timespec ts;
+			uint64_t until;
+
+			/*
+			 * A wakeup signalled between the check above and the
+			 * wait is lost, and leaves background_thread_signaled
+			 * set, so that no later wakeup signals either.  Cap
+			 * the wait so that the flag is checked again soon,
+			 * even when the decay period is very long.
+			 */
+			until = next;
+			if (until - now > BACKGROUND_THREAD_MAX_WAIT * 1000000)
+				until = now + BACKGROUND_THREAD_MAX_WAIT * 1000000;
+			ts.tv_sec = until / 1000000000;
+			ts.tv_nsec = until % 1000000000;
+			pthread_cond_timedwait(&background_thread_cond,
+			    &background_thread_mtx, &ts);
+			continue;
+		}
+
+		/* Only the passage of time ages dirty pages, not signals. */
+		if (now >= next) {
+			background_thread_epoch++;
+			next = now + background_thread_interval();
+		}
+		background_thread_signaled = false;
+		decay = (dirty_decay_ms >= 0);
+		epoch = background_thread_epoch;
+		malloc_mutex_unlock(&background_thread_mtx);
+
+		start = background_thread_now();
+		npurged = background_thread_purge(decay, epoch);
+		elapsed = background_thread_now() - start;
+
+		malloc_mutex_lock(&background_thread_mtx);
+		background_thread_stats.nruns++;
+		background_thread_stats.npurged += npurged;
+		background_thread_stats.purge_ns += elapsed;
+		if (elapsed > background_thread_stats.purge_ns_max)
+			background_thread_stats.purge_ns_max = elapsed;
+	}
+	malloc_mutex_unlock(&background_thread_mtx);
+
+	return (NULL);
+}
+
+/*
+ * Ask the thread for a pass ahead of its next wakeup, because an arena has
+ * crossed the opt_lg_dirty_mult threshold.  Called with an arena lock held.
+ */
+void
+background_thread_wakeup(void)
+{
+
+	if (background_thread_signaled == false) {
+		background_thread_signaled = true;
+		pthread_cond_signal(&background_thread_cond);
+	}
+}
+
+/*
+ * Start the thread, if it is not running already.  Calls to this function and
+ * background_thread_stop() must be serialized by the caller.
+ */
+bool
+background_thread_start(void)
+{
+
+	malloc_mutex_lock(&background_thread_mtx);
+	if (background_thread_enabled) {
+		malloc_mutex_unlock(&background_thread_mtx);
+		return (false);
+	}
+	background_thread_enabled = true;
+	background_thread_signaled = false;
+	if (pthread_create(&background_thread, NULL, background_thread_entry,
+	    NULL) != 0) {
+		background_thread_enabled = false;
+		malloc_mutex_unlock(&background_thread_mtx);
+		return (true);
+	}
+	malloc_mutex_unlock(&background_thread_mtx);
+
+	return (false);
+}
+
+/*
+ * Stop the thread and wait for it to exit.  Deallocations purge inline again
+ * from then on.
+ */
+void
+background_thread_stop(void)
+{
+
+	malloc_mutex_lock(&background_thread_mtx);
+	if (background_thread_enabled == false) {
+		malloc_mutex_unlock(&background_thread_mtx);
+		return;
+	}
+	background_thread_enabled = false;
+	pthread_cond_signal(&background_thread_cond);
+	malloc_mutex_unlock(&background_thread_mtx);
+
+	pthread_join(background_thread, NULL);
+}
+
+void
+background_thread_prefork(void)
+{
+
+	malloc_mutex_lock(&background_thread_mtx);
+}
+
+void
+background_thread_postfork(void)
+{
+
+	malloc_mutex_unlock(&background_thread_mtx);
+}
+
+/*
+ * Only the forking thread exists in the child, so the background thread is
+ * gone even if it was running in the parent.
+ */
+static void
+background_thread_postfork_child(void)
+{
+
+	background_thread_enabled = false;
+	background_thread_signaled = false;
+	background_thread_cond_init();
+}
+
+bool
+background_thread_boot(void)
+{
+
+	if (malloc_mutex_init(&background_thread_mtx))
+		return (true);
+	if (background_thread_cond_init())
+		return (true);
+
+	/*
+	 * Registered after jemalloc_postfork(), so that this runs once
+	 * background_thread_mtx has been released in the child.
+	 */
+	if (pthread_atfork(NULL, NULL, background_thread_postfork_child) != 0)
+		return (true);
+
+	dirty_decay_ms = opt_dirty_decay_ms;
+	background_thread_enabled = false;
+	background_thread_signaled = false;
+	background_thread_epoch = 0;
+	memset(&background_thread_stats, 0, sizeof(background_thread_stats_t));
+
+	return (false);
+}
+
+#endif /* JEMALLOC_BACKGROUND_THREAD */
@@ -5,6 +5,7 @@
 /* Data. */
 
 size_t	opt_lg_chunk = LG_CHUNK_DEFAULT;
+size_t	opt_chunk_cache_max = CHUNK_CACHE_MAX_DEFAULT;
 #ifdef JEMALLOC_SWAP
 bool	opt_overcommit = true;
 #endif
@@ -14,6 +15,20 @@ malloc_mutex_t	chunks_mtx;
 chunk_stats_t	stats_chunks;
 #endif
 
+malloc_mutex_t	chunk_cache_mtx;
+size_t		chunk_cache_max;
+size_t		chunk_cache_nchunks;
+#ifdef JEMALLOC_STATS
+uint64_t	chunk_cache_nhits;
+uint64_t	chunk_cache_nmisses;
+#endif
+
+/*
+ * Address-ordered tree of cached extents.  Each extent is one or more chunks
+ * that chunk_alloc_mmap() mapped, and whose pages have since been purged.
+ */
+static extent_tree_t	chunk_cache;
+
 #ifdef JEMALLOC_IVSALLOC
 rtree_t		*chunks_rtree;
 #endif
@@ -26,6 +41,182 @@ size_t		map_bias;
 size_t		arena_maxclass; /* Max size class for arenas. */
 
 /******************************************************************************/
+/* Function prototypes for non-inline static functions. */
+
+static void	*chunk_cache_alloc(size_t size, bool *zero);
+static bool	chunk_cache_dalloc(void *chunk, size_t size);
+static bool	chunk_cache_take(void *addr, size_t size);
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+static void	chunk_stats_alloc(size_t size);
+#endif
+
+/******************************************************************************/
+
+/*
+ * Take size bytes from the lowest cached extent that is large enough, which
+ * saves chunk_alloc_mmap() its mmap() calls and alignment trimming.
+ */
+static void *
+chunk_cache_alloc(size_t size, bool *zero)
+{
+	void *ret;
+	extent_node_t *node, *xnode;
+
+	ret = NULL;
+	xnode = NULL;
+	malloc_mutex_lock(&chunk_cache_mtx);
+	for (node = extent_tree_ad_first(&chunk_cache); node != NULL; node =
+	    extent_tree_ad_next(&chunk_cache, node)) {
+		if (node->size >= size)
+			break;
+	}
+	if (node != NULL) {
+		ret = node->addr;
+		if (node->size == size) {
+			extent_tree_ad_remove(&chunk_cache, node);
+			xnode = node;
+		} else {
+			/*
+			 * Keep the trailing chunks cached.  Extents do not
+			 * overlap, so this does not change the node's place in
+			 * the tree.
+			 */
+			node->addr = (void *)((uintptr_t)node->addr + size);
+			node->size -= size;
+		}
+		chunk_cache_nchunks -= (size / chunksize);
+	}
+#ifdef JEMALLOC_STATS
+	if (ret != NULL)
+		chunk_cache_nhits++;
+	else
+		chunk_cache_nmisses++;
+#endif
+	malloc_mutex_unlock(&chunk_cache_mtx);
+
+	if (xnode != NULL)
+		base_node_dealloc(xnode);
+	if (ret != NULL) {
+#ifdef JEMALLOC_PURGE_MADVISE_DONTNEED
+		/*
+		 * madvise(..., MADV_DONTNEED) results in zero-filled pages for
+		 * anonymous mappings.
+		 */
+		*zero = true;
+#else
+		if (*zero)
+			memset(ret, 0, size);
+#endif
+	}
+
+	return (ret);
+}
+
+/*
+ * Remove [addr, addr+size) from the cache, if it is cached as a whole.
+ * Returns true if it is not.
+ */
+static bool
+chunk_cache_take(void *addr, size_t size)
+{
+	extent_node_t *node, *xnode, key;
+
+	xnode = NULL;
+	malloc_mutex_lock(&chunk_cache_mtx);
+	key.addr = addr;
+	node = extent_tree_ad_search(&chunk_cache, &key);
+	if (node == NULL || node->size < size) {
+		malloc_mutex_unlock(&chunk_cache_mtx);
+		return (true);
+	}
+	if (node->size == size) {
+		extent_tree_ad_remove(&chunk_cache, node);
+		xnode = node;
+	} else {
+		node->addr = (void *)((uintptr_t)node->addr + size);
+		node->size -= size;
+	}
+	chunk_cache_nchunks -= (size / chunksize);
+	malloc_mutex_unlock(&chunk_cache_mtx);
+
+	if (xnode != NULL)
+		base_node_dealloc(xnode);
+	return (false);
+}
+
+/*
+ * Purge and cache a chunk that would otherwise be unmapped.  Returns true if
+ * the cache has no room for it.
+ */
+static bool
+chunk_cache_dalloc(void *chunk, size_t size)
+{
+	extent_node_t *node;
+	size_t nchunks = size / chunksize;
+
+	/* Reserve room first, so that a full cache costs no system calls. */
+	malloc_mutex_lock(&chunk_cache_mtx);
+	if (chunk_cache_nchunks + nchunks > chunk_cache_max) {
+		malloc_mutex_unlock(&chunk_cache_mtx);
+		return (true);
+	}
+	chunk_cache_nchunks += nchunks;
+	malloc_mutex_unlock(&chunk_cache_mtx);
+
+	node = base_node_alloc();
+	if (node == NULL) {
+		malloc_mutex_lock(&chunk_cache_mtx);
+		chunk_cache_nchunks -= nchunks;
+		malloc_mutex_unlock(&chunk_cache_mtx);
+		return (true);
+	}
+	node->addr = chunk;
+	node->size = size;
+
+#ifdef JEMALLOC_PURGE_MADVISE_DONTNEED
+	madvise(chunk, size, MADV_DONTNEED);
+#elif defined(JEMALLOC_PURGE_MADVISE_FREE)
+	madvise(chunk, size, MADV_FREE);
+#endif
+
+	malloc_mutex_lock(&chunk_cache_mtx);
+	extent_tree_ad_insert(&chunk_cache, node);
+	malloc_mutex_unlock(&chunk_cache_mtx);
+
+	return (false);
+}
+
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+/* Account for size bytes worth of chunks that have just come into use. */
+static void
+chunk_stats_alloc(size_t size)
+{
+#  ifdef JEMALLOC_PROF
+	bool gdump;
+#  endif
+
+	malloc_mutex_lock(&chunks_mtx);
+#  ifdef JEMALLOC_STATS
+	stats_chunks.nchunks += (size / chunksize);
+#  endif
+	stats_chunks.curchunks += (size / chunksize);
+	if (stats_chunks.curchunks > stats_chunks.highchunks) {
+		stats_chunks.highchunks = stats_chunks.curchunks;
+#  ifdef JEMALLOC_PROF
+		gdump = true;
+#  endif
+	}
+#  ifdef JEMALLOC_PROF
+	else
+		gdump = false;
+#  endif
+	malloc_mutex_unlock(&chunks_mtx);
+#  ifdef JEMALLOC_PROF
+	if (opt_prof && opt_prof_gdump && gdump)
+		prof_gdump();
+#  endif
+}
+#endif
 
 /*
  * If the caller specifies (*zero == false), it is still possible to receive
@@ -55,6 +246,9 @@ chunk_alloc(size_t size, bool base, bool *zero)
 		if (ret != NULL)
 			goto RETURN;
 #endif
+		ret = chunk_cache_alloc(size, zero);
+		if (ret != NULL)
+			goto RETURN;
 		ret = chunk_alloc_mmap(size);
 		if (ret != NULL) {
 			*zero = true;
@@ -76,31 +270,8 @@ RETURN:
 	}
 #endif
 #if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
-	if (ret != NULL) {
-#  ifdef JEMALLOC_PROF
-		bool gdump;
-#  endif
-		malloc_mutex_lock(&chunks_mtx);
-#  ifdef JEMALLOC_STATS
-		stats_chunks.nchunks += (size / chunksize);
-#  endif
-		stats_chunks.curchunks += (size / chunksize);
-		if (stats_chunks.curchunks > stats_chunks.highchunks) {
-			stats_chunks.highchunks = stats_chunks.curchunks;
-#  ifdef JEMALLOC_PROF
-			gdump = true;
-#  endif
-		}
-#  ifdef JEMALLOC_PROF
-		else
-			gdump = false;
-#  endif
-		malloc_mutex_unlock(&chunks_mtx);
-#  ifdef JEMALLOC_PROF
-		if (opt_prof && opt_prof_gdump && gdump)
-			prof_gdump();
-#  endif
-	}
+	if (ret != NULL)
+		chunk_stats_alloc(size);
 #endif
 
 	assert(CHUNK_ADDR2BASE(ret) == ret);
@@ -133,9 +304,80 @@ chunk_dealloc(void *chunk, size_t size)
 	if (chunk_dealloc_dss(chunk, size) == false)
 		return;
 #endif
+	if (chunk_cache_dalloc(chunk, size) == false)
+		return;
 	chunk_dealloc_mmap(chunk, size);
 }
 
+/*
+ * Grow the chunks at [chunk, chunk+oldsize) to newsize without moving them.
+ * The new pages are zero-filled.  Returns true if the address range that
+ * would be needed is in use.
+ */
+bool
+chunk_extend(void *chunk, size_t oldsize, size_t newsize)
+{
+
+	assert(chunk != NULL);
+	assert(CHUNK_ADDR2BASE(chunk) == chunk);
+	assert((oldsize & chunksize_mask) == 0);
+	assert((newsize & chunksize_mask) == 0);
+	assert(newsize > oldsize);
+
+	/* Only chunks that chunk_alloc_mmap() mapped can be grown. */
+#ifdef JEMALLOC_SWAP
+	if (swap_enabled && chunk_in_swap(chunk))
+		return (true);
+#endif
+#ifdef JEMALLOC_DSS
+	if (chunk_in_dss(chunk))
+		return (true);
+#endif
+
+	/*
+	 * Cached chunks right after the extent are in the way of mremap().
+	 * They are unmapped rather than taken over as they are, since
+	 * mremap() cannot later move an extent made of several mappings.
+	 */
+	if (chunk_cache_take((void *)((uintptr_t)chunk + oldsize), newsize -
+	    oldsize) == false) {
+		chunk_dealloc_mmap((void *)((uintptr_t)chunk + oldsize),
+		    newsize - oldsize);
+	}
+	if (chunk_extend_mmap(chunk, oldsize, newsize))
+		return (true);
+
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+	chunk_stats_alloc(newsize - oldsize);
+#endif
+	return (false);
+}
+
+/*
+ * Change the maximum number of cached chunks, unmapping cached chunks, highest
+ * addresses first, until the cache fits.
+ */
+void
+chunk_cache_max_set(size_t max)
+{
+	extent_node_t *node;
+
+	malloc_mutex_lock(&chunk_cache_mtx);
+	chunk_cache_max = max;
+	while (chunk_cache_nchunks > chunk_cache_max && (node =
+	    extent_tree_ad_last(&chunk_cache)) != NULL) {
+		extent_tree_ad_remove(&chunk_cache, node);
+		chunk_cache_nchunks -= (node->size / chunksize);
+		malloc_mutex_unlock(&chunk_cache_mtx);
+
+		chunk_dealloc_mmap(node->addr, node->size);
+		base_node_dealloc(node);
+
+		malloc_mutex_lock(&chunk_cache_mtx);
+	}
+	malloc_mutex_unlock(&chunk_cache_mtx);
+}
+
 bool
 chunk_boot(void)
 {
@@ -150,6 +392,15 @@ chunk_boot(void)
 	if (malloc_mutex_init(&chunks_mtx))
 		return (true);
 	memset(&stats_chunks, 0, sizeof(chunk_stats_t));
+#endif
+	if (malloc_mutex_init(&chunk_cache_mtx))
+		return (true);
+	extent_tree_ad_new(&chunk_cache);
+	chunk_cache_max = opt_chunk_cache_max;
+	chunk_cache_nchunks = 0;
+#ifdef JEMALLOC_STATS
+	chunk_cache_nhits = 0;
+	chunk_cache_nmisses = 0;
 #endif
 #ifdef JEMALLOC_SWAP
 	if (chunk_swap_boot())
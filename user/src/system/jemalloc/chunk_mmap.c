@@ -222,6 +222,21 @@ chunk_dealloc_mmap(void *chunk, size_t size)
 	pages_unmap(chunk, size);
 }
 
+/*
+ * Grow a mapping without moving it, which only succeeds if the address range
+ * that follows it is unmapped.  The new pages are zero-filled.
+ */
+bool
+chunk_extend_mmap(void *chunk, size_t oldsize, size_t newsize)
+{
+
+#ifdef JEMALLOC_MREMAP_FIXED
+	return (mremap(chunk, oldsize, newsize, 0) == MAP_FAILED);
+#else
+	return (true);
+#endif
+}
+
 bool
 chunk_mmap_boot(void)
 {
@@ -47,8 +47,15 @@ CTL_PROTO(version)
 CTL_PROTO(epoch)
 #ifdef JEMALLOC_TCACHE
 CTL_PROTO(tcache_flush)
+CTL_PROTO(tcache_bin_i_ncached)
+CTL_PROTO(tcache_bin_i_ncached_max)
+CTL_PROTO(tcache_bin_i_nfill)
+INDEX_PROTO(tcache_bin_i)
 #endif
 CTL_PROTO(thread_arena)
+#ifdef JEMALLOC_BACKGROUND_THREAD
+CTL_PROTO(background_thread)
+#endif
 #ifdef JEMALLOC_STATS
 CTL_PROTO(thread_allocated)
 CTL_PROTO(thread_allocatedp)
@@ -75,8 +82,16 @@ CTL_PROTO(opt_lg_qspace_max)
 CTL_PROTO(opt_lg_cspace_max)
 CTL_PROTO(opt_lg_chunk)
 CTL_PROTO(opt_narenas)
+CTL_PROTO(opt_chunk_cache_max)
 CTL_PROTO(opt_lg_dirty_mult)
 CTL_PROTO(opt_stats_print)
+#ifdef JEMALLOC_PERCPU_ARENA
+CTL_PROTO(opt_percpu_arena)
+#endif
+#ifdef JEMALLOC_BACKGROUND_THREAD
+CTL_PROTO(opt_background_thread)
+CTL_PROTO(opt_dirty_decay_ms)
+#endif
 #ifdef JEMALLOC_FILL
 CTL_PROTO(opt_junk)
 CTL_PROTO(opt_zero)
@@ -90,6 +105,7 @@ CTL_PROTO(opt_xmalloc)
 #ifdef JEMALLOC_TCACHE
 CTL_PROTO(opt_tcache)
 CTL_PROTO(opt_lg_tcache_gc_sweep)
+CTL_PROTO(opt_tcache_adaptive)
 #endif
 #ifdef JEMALLOC_PROF
 CTL_PROTO(opt_prof)
@@ -142,6 +158,10 @@ CTL_PROTO(arenas_nhbins)
 #endif
 CTL_PROTO(arenas_nlruns)
 CTL_PROTO(arenas_purge)
+CTL_PROTO(arenas_chunk_cache_max)
+#ifdef JEMALLOC_BACKGROUND_THREAD
+CTL_PROTO(arenas_dirty_decay_ms)
+#endif
 #ifdef JEMALLOC_PROF
 CTL_PROTO(prof_active)
 CTL_PROTO(prof_dump)
@@ -151,6 +171,9 @@ CTL_PROTO(prof_interval)
 CTL_PROTO(stats_chunks_current)
 CTL_PROTO(stats_chunks_total)
 CTL_PROTO(stats_chunks_high)
+CTL_PROTO(stats_chunks_cache_current)
+CTL_PROTO(stats_chunks_cache_nhits)
+CTL_PROTO(stats_chunks_cache_nmisses)
 CTL_PROTO(stats_huge_allocated)
 CTL_PROTO(stats_huge_nmalloc)
 CTL_PROTO(stats_huge_ndalloc)
@@ -191,6 +214,12 @@ CTL_PROTO(stats_arenas_i_nmadvise)
 CTL_PROTO(stats_arenas_i_purged)
 #endif
 INDEX_PROTO(stats_arenas_i)
+#ifdef JEMALLOC_BACKGROUND_THREAD
+CTL_PROTO(stats_background_thread_nruns)
+CTL_PROTO(stats_background_thread_npurged)
+CTL_PROTO(stats_background_thread_purge_ns)
+CTL_PROTO(stats_background_thread_purge_ns_max)
+#endif
 #ifdef JEMALLOC_STATS
 CTL_PROTO(stats_allocated)
 CTL_PROTO(stats_active)
@@ -222,8 +251,22 @@ CTL_PROTO(swap_fds)
 #define	INDEX(i)	false,	{.indexed = {i##_index}},		NULL
 
 #ifdef JEMALLOC_TCACHE
+static const ctl_node_t tcache_bin_i_node[] = {
+	{NAME("ncached"),		CTL(tcache_bin_i_ncached)},
+	{NAME("ncached_max"),		CTL(tcache_bin_i_ncached_max)},
+	{NAME("nfill"),			CTL(tcache_bin_i_nfill)}
+};
+static const ctl_node_t super_tcache_bin_i_node[] = {
+	{NAME(""),			CHILD(tcache_bin_i)}
+};
+
+static const ctl_node_t tcache_bin_node[] = {
+	{INDEX(tcache_bin_i)}
+};
+
 static const ctl_node_t	tcache_node[] = {
-	{NAME("flush"),		CTL(tcache_flush)}
+	{NAME("flush"),		CTL(tcache_flush)},
+	{NAME("bin"),		CHILD(tcache_bin)}
 };
 #endif
 
@@ -262,8 +305,18 @@ static const ctl_node_t opt_node[] = {
 	{NAME("lg_cspace_max"),		CTL(opt_lg_cspace_max)},
 	{NAME("lg_chunk"),		CTL(opt_lg_chunk)},
 	{NAME("narenas"),		CTL(opt_narenas)},
+	{NAME("chunk_cache_max"),	CTL(opt_chunk_cache_max)},
 	{NAME("lg_dirty_mult"),		CTL(opt_lg_dirty_mult)},
 	{NAME("stats_print"),		CTL(opt_stats_print)}
+#ifdef JEMALLOC_PERCPU_ARENA
+	,
+	{NAME("percpu_arena"),		CTL(opt_percpu_arena)}
+#endif
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	,
+	{NAME("background_thread"),	CTL(opt_background_thread)},
+	{NAME("dirty_decay_ms"),	CTL(opt_dirty_decay_ms)}
+#endif
 #ifdef JEMALLOC_FILL
 	,
 	{NAME("junk"),			CTL(opt_junk)},
@@ -280,7 +333,8 @@ static const ctl_node_t opt_node[] = {
 #ifdef JEMALLOC_TCACHE
 	,
 	{NAME("tcache"),		CTL(opt_tcache)},
-	{NAME("lg_tcache_gc_sweep"),	CTL(opt_lg_tcache_gc_sweep)}
+	{NAME("lg_tcache_gc_sweep"),	CTL(opt_lg_tcache_gc_sweep)},
+	{NAME("tcache_adaptive"),	CTL(opt_tcache_adaptive)}
 #endif
 #ifdef JEMALLOC_PROF
 	,
@@ -357,7 +411,12 @@ static const ctl_node_t arenas_node[] = {
 	{NAME("bin"),			CHILD(arenas_bin)},
 	{NAME("nlruns"),		CTL(arenas_nlruns)},
 	{NAME("lrun"),			CHILD(arenas_lrun)},
-	{NAME("purge"),			CTL(arenas_purge)}
+	{NAME("purge"),			CTL(arenas_purge)},
+	{NAME("chunk_cache_max"),	CTL(arenas_chunk_cache_max)}
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	,
+	{NAME("dirty_decay_ms"),	CTL(arenas_dirty_decay_ms)}
+#endif
 };
 
 #ifdef JEMALLOC_PROF
@@ -369,10 +428,17 @@ static const ctl_node_t	prof_node[] = {
 #endif
 
 #ifdef JEMALLOC_STATS
+static const ctl_node_t stats_chunks_cache_node[] = {
+	{NAME("current"),		CTL(stats_chunks_cache_current)},
+	{NAME("nhits"),			CTL(stats_chunks_cache_nhits)},
+	{NAME("nmisses"),		CTL(stats_chunks_cache_nmisses)}
+};
+
 static const ctl_node_t stats_chunks_node[] = {
 	{NAME("current"),		CTL(stats_chunks_current)},
 	{NAME("total"),			CTL(stats_chunks_total)},
-	{NAME("high"),			CTL(stats_chunks_high)}
+	{NAME("high"),			CTL(stats_chunks_high)},
+	{NAME("cache"),			CHILD(stats_chunks_cache)}
 };
 
 static const ctl_node_t stats_huge_node[] = {
@@ -456,6 +522,15 @@ static const ctl_node_t stats_arenas_node[] = {
 	{INDEX(stats_arenas_i)}
 };
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+static const ctl_node_t stats_background_thread_node[] = {
+	{NAME("nruns"),		CTL(stats_background_thread_nruns)},
+	{NAME("npurged"),	CTL(stats_background_thread_npurged)},
+	{NAME("purge_ns"),	CTL(stats_background_thread_purge_ns)},
+	{NAME("purge_ns_max"),	CTL(stats_background_thread_purge_ns_max)}
+};
+#endif
+
 static const ctl_node_t stats_node[] = {
 #ifdef JEMALLOC_STATS
 	{NAME("allocated"),		CTL(stats_allocated)},
@@ -463,6 +538,9 @@ static const ctl_node_t stats_node[] = {
 	{NAME("mapped"),		CTL(stats_mapped)},
 	{NAME("chunks"),		CHILD(stats_chunks)},
 	{NAME("huge"),			CHILD(stats_huge)},
+#endif
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	{NAME("background_thread"),	CHILD(stats_background_thread)},
 #endif
 	{NAME("arenas"),		CHILD(stats_arenas)}
 };
@@ -485,6 +563,9 @@ static const ctl_node_t	root_node[] = {
 	{NAME("tcache"),	CHILD(tcache)},
 #endif
 	{NAME("thread"),	CHILD(thread)},
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	{NAME("background_thread"),	CTL(background_thread)},
+#endif
 	{NAME("config"),	CHILD(config)},
 	{NAME("opt"),		CHILD(opt)},
 	{NAME("arenas"),	CHILD(arenas)},
@@ -646,11 +727,14 @@ ctl_refresh(void)
 	ctl_stats.chunks.high = stats_chunks.highchunks;
 	malloc_mutex_unlock(&chunks_mtx);
 
-	malloc_mutex_lock(&huge_mtx);
-	ctl_stats.huge.allocated = huge_allocated;
-	ctl_stats.huge.nmalloc = huge_nmalloc;
-	ctl_stats.huge.ndalloc = huge_ndalloc;
-	malloc_mutex_unlock(&huge_mtx);
+	malloc_mutex_lock(&chunk_cache_mtx);
+	ctl_stats.chunks.cached = chunk_cache_nchunks;
+	ctl_stats.chunks.cache_nhits = chunk_cache_nhits;
+	ctl_stats.chunks.cache_nmisses = chunk_cache_nmisses;
+	malloc_mutex_unlock(&chunk_cache_mtx);
+
+	huge_stats_merge(&ctl_stats.huge.allocated, &ctl_stats.huge.nmalloc,
+	    &ctl_stats.huge.ndalloc);
 #endif
 
 	/*
@@ -1104,6 +1188,50 @@ tcache_flush_ctl(const size_t *mib, size_t miblen, void *oldp, size_t *oldlenp,
 RETURN:
 	return (ret);
 }
+
+/*
+ * The tcache.bin.<i>.* values describe the calling thread's tcache, and are
+ * read live.  ENOENT means that the thread has no tcache at the moment.
+ */
+#define	CTL_RO_TCACHE_BIN_GEN(n, v)					\
+static int								\
+n##_ctl(const size_t *mib, size_t miblen, void *oldp, size_t *oldlenp,	\
+    void *newp, size_t newlen)						\
+{									\
+	int ret;							\
+	tcache_t *tcache;						\
+	tcache_bin_t *tbin;						\
+	unsigned oldval;						\
+									\
+	READONLY();							\
+	tcache = TCACHE_GET();						\
+	if ((uintptr_t)tcache <= (uintptr_t)2) {			\
+		ret = ENOENT;						\
+		goto RETURN;						\
+	}								\
+	tbin = &tcache->tbins[mib[2]];					\
+	oldval = (v);							\
+	READ(oldval, unsigned);						\
+									\
+	ret = 0;							\
+RETURN:									\
+	return (ret);							\
+}
+
+CTL_RO_TCACHE_BIN_GEN(tcache_bin_i_ncached, tbin->ncached)
+CTL_RO_TCACHE_BIN_GEN(tcache_bin_i_ncached_max, tbin->ncached_max)
+CTL_RO_TCACHE_BIN_GEN(tcache_bin_i_nfill,
+    tbin->ncached_max >> tbin->lg_fill_div)
+#undef CTL_RO_TCACHE_BIN_GEN
+
+const ctl_node_t *
+tcache_bin_i_index(const size_t *mib, size_t miblen, size_t i)
+{
+
+	if (i >= nbins)
+		return (NULL);
+	return (super_tcache_bin_i_node);
+}
 #endif
 
 static int
@@ -1144,6 +1272,37 @@ RETURN:
 	return (ret);
 }
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+static int
+background_thread_ctl(const size_t *mib, size_t miblen, void *oldp,
+    size_t *oldlenp, void *newp, size_t newlen)
+{
+	int ret;
+	bool oldval, newval;
+
+	/* ctl_mtx serializes background_thread_{start,stop}(). */
+	malloc_mutex_lock(&ctl_mtx);
+	oldval = background_thread_enabled;
+	if (newp != NULL) {
+		newval = oldval;
+		WRITE(newval, bool);
+		if (newval && oldval == false) {
+			if (background_thread_start()) {
+				ret = EAGAIN;
+				goto RETURN;
+			}
+		} else if (newval == false && oldval)
+			background_thread_stop();
+	}
+	READ(oldval, bool);
+
+	ret = 0;
+RETURN:
+	malloc_mutex_unlock(&ctl_mtx);
+	return (ret);
+}
+#endif
+
 #ifdef JEMALLOC_STATS
 CTL_RO_NL_GEN(thread_allocated, ALLOCATED_GET(), uint64_t);
 CTL_RO_NL_GEN(thread_allocatedp, &ALLOCATED_GET(), uint64_t *);
@@ -1250,8 +1409,16 @@ CTL_RO_NL_GEN(opt_lg_qspace_max, opt_lg_qspace_max, size_t)
 CTL_RO_NL_GEN(opt_lg_cspace_max, opt_lg_cspace_max, size_t)
 CTL_RO_NL_GEN(opt_lg_chunk, opt_lg_chunk, size_t)
 CTL_RO_NL_GEN(opt_narenas, opt_narenas, size_t)
+CTL_RO_NL_GEN(opt_chunk_cache_max, opt_chunk_cache_max, size_t)
 CTL_RO_NL_GEN(opt_lg_dirty_mult, opt_lg_dirty_mult, ssize_t)
 CTL_RO_NL_GEN(opt_stats_print, opt_stats_print, bool)
+#ifdef JEMALLOC_PERCPU_ARENA
+CTL_RO_NL_GEN(opt_percpu_arena, opt_percpu_arena, bool)
+#endif
+#ifdef JEMALLOC_BACKGROUND_THREAD
+CTL_RO_NL_GEN(opt_background_thread, opt_background_thread, bool)
+CTL_RO_NL_GEN(opt_dirty_decay_ms, opt_dirty_decay_ms, ssize_t)
+#endif
 #ifdef JEMALLOC_FILL
 CTL_RO_NL_GEN(opt_junk, opt_junk, bool)
 CTL_RO_NL_GEN(opt_zero, opt_zero, bool)
@@ -1265,6 +1432,7 @@ CTL_RO_NL_GEN(opt_xmalloc, opt_xmalloc, bool)
 #ifdef JEMALLOC_TCACHE
 CTL_RO_NL_GEN(opt_tcache, opt_tcache, bool)
 CTL_RO_NL_GEN(opt_lg_tcache_gc_sweep, opt_lg_tcache_gc_sweep, ssize_t)
+CTL_RO_NL_GEN(opt_tcache_adaptive, opt_tcache_adaptive, bool)
 #endif
 #ifdef JEMALLOC_PROF
 CTL_RO_NL_GEN(opt_prof, opt_prof, bool)
@@ -1400,6 +1568,58 @@ RETURN:
 	return (ret);
 }
 
+static int
+arenas_chunk_cache_max_ctl(const size_t *mib, size_t miblen, void *oldp,
+    size_t *oldlenp, void *newp, size_t newlen)
+{
+	int ret;
+	size_t oldval, newval;
+
+	/* ctl_mtx serializes chunk_cache_max_set(). */
+	malloc_mutex_lock(&ctl_mtx);
+	oldval = chunk_cache_max;
+	if (newp != NULL) {
+		newval = oldval;
+		WRITE(newval, size_t);
+		chunk_cache_max_set(newval);
+	}
+	READ(oldval, size_t);
+
+	ret = 0;
+RETURN:
+	malloc_mutex_unlock(&ctl_mtx);
+	return (ret);
+}
+
+#ifdef JEMALLOC_BACKGROUND_THREAD
+static int
+arenas_dirty_decay_ms_ctl(const size_t *mib, size_t miblen, void *oldp,
+    size_t *oldlenp, void *newp, size_t newlen)
+{
+	int ret;
+	ssize_t oldval, newval;
+
+	malloc_mutex_lock(&background_thread_mtx);
+	oldval = dirty_decay_ms;
+	if (newp != NULL) {
+		newval = oldval;
+		WRITE(newval, ssize_t);
+		if (newval < -1 || newval > INT_MAX) {
+			ret = EINVAL;
+			goto RETURN;
+		}
+		/* The new pace applies from the thread's next wakeup. */
+		dirty_decay_ms = newval;
+	}
+	READ(oldval, ssize_t);
+
+	ret = 0;
+RETURN:
+	malloc_mutex_unlock(&background_thread_mtx);
+	return (ret);
+}
+#endif
+
 /******************************************************************************/
 
 #ifdef JEMALLOC_PROF
@@ -1458,9 +1678,13 @@ CTL_RO_NL_GEN(prof_interval, prof_interval, uint64_t)
 CTL_RO_GEN(stats_chunks_current, ctl_stats.chunks.current, size_t)
 CTL_RO_GEN(stats_chunks_total, ctl_stats.chunks.total, uint64_t)
 CTL_RO_GEN(stats_chunks_high, ctl_stats.chunks.high, size_t)
-CTL_RO_GEN(stats_huge_allocated, huge_allocated, size_t)
-CTL_RO_GEN(stats_huge_nmalloc, huge_nmalloc, uint64_t)
-CTL_RO_GEN(stats_huge_ndalloc, huge_ndalloc, uint64_t)
+CTL_RO_GEN(stats_chunks_cache_current, ctl_stats.chunks.cached, size_t)
+CTL_RO_GEN(stats_chunks_cache_nhits, ctl_stats.chunks.cache_nhits, uint64_t)
+CTL_RO_GEN(stats_chunks_cache_nmisses, ctl_stats.chunks.cache_nmisses,
+    uint64_t)
+CTL_RO_GEN(stats_huge_allocated, ctl_stats.huge.allocated, size_t)
+CTL_RO_GEN(stats_huge_nmalloc, ctl_stats.huge.nmalloc, uint64_t)
+CTL_RO_GEN(stats_huge_ndalloc, ctl_stats.huge.ndalloc, uint64_t)
 CTL_RO_GEN(stats_arenas_i_small_allocated,
     ctl_stats.arenas[mib[2]].allocated_small, size_t)
 CTL_RO_GEN(stats_arenas_i_small_nmalloc,
@@ -1567,6 +1791,38 @@ CTL_RO_GEN(stats_active, ctl_stats.active, size_t)
 CTL_RO_GEN(stats_mapped, ctl_stats.mapped, size_t)
 #endif
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+/*
+ * Unlike the rest of stats.*, these are read live rather than as of the last
+ * epoch, under the lock that the background thread updates them with.
+ */
+#define	CTL_RO_BACKGROUND_THREAD_GEN(n, v)				\
+static int								\
+n##_ctl(const size_t *mib, size_t miblen, void *oldp, size_t *oldlenp,	\
+    void *newp, size_t newlen)						\
+{									\
+	int ret;							\
+	uint64_t oldval;						\
+									\
+	malloc_mutex_lock(&background_thread_mtx);			\
+	READONLY();							\
+	oldval = background_thread_stats.v;				\
+	READ(oldval, uint64_t);						\
+									\
+	ret = 0;							\
+RETURN:									\
+	malloc_mutex_unlock(&background_thread_mtx);			\
+	return (ret);							\
+}
+
+CTL_RO_BACKGROUND_THREAD_GEN(stats_background_thread_nruns, nruns)
+CTL_RO_BACKGROUND_THREAD_GEN(stats_background_thread_npurged, npurged)
+CTL_RO_BACKGROUND_THREAD_GEN(stats_background_thread_purge_ns, purge_ns)
+CTL_RO_BACKGROUND_THREAD_GEN(stats_background_thread_purge_ns_max,
+    purge_ns_max)
+#undef CTL_RO_BACKGROUND_THREAD_GEN
+#endif
+
 /******************************************************************************/
 
 #ifdef JEMALLOC_SWAP
@@ -9,18 +9,43 @@
 /******************************************************************************/
 /* Data. */
 
-#ifdef JEMALLOC_STATS
-uint64_t	huge_nmalloc;
-uint64_t	huge_ndalloc;
-size_t		huge_allocated;
-#endif
+huge_shard_t	huge_shards[HUGE_NSHARDS];
+
+/******************************************************************************/
+/* Function prototypes for non-inline static functions. */
 
-malloc_mutex_t	huge_mtx;
+static bool	huge_grow(void *ptr, size_t oldsize, size_t newsize);
+static void	huge_insert(void *ptr, extent_node_t *node);
 
 /******************************************************************************/
 
-/* Tree of chunks that are stand-alone huge allocations. */
-static extent_tree_t	huge;
+/*
+ * Map an allocation to its shard with Fibonacci hashing of its chunk number,
+ * which spreads out allocations that span several chunks.
+ */
+static inline huge_shard_t *
+huge_shard_get(const void *ptr)
+{
+	uint32_t h;
+
+	h = (uint32_t)((uintptr_t)ptr >> opt_lg_chunk) * 2654435761U;
+	return (&huge_shards[h >> (32 - LG_HUGE_NSHARDS)]);
+}
+
+/* Start tracking the huge allocation at ptr, described by node. */
+static void
+huge_insert(void *ptr, extent_node_t *node)
+{
+	huge_shard_t *shard = huge_shard_get(ptr);
+
+	malloc_mutex_lock(&shard->mtx);
+	extent_tree_ad_insert(&shard->huge, node);
+#ifdef JEMALLOC_STATS
+	shard->nmalloc++;
+	shard->allocated += node->size;
+#endif
+	malloc_mutex_unlock(&shard->mtx);
+}
 
 void *
 huge_malloc(size_t size, bool zero)
@@ -51,14 +76,7 @@ huge_malloc(size_t size, bool zero)
 	/* Insert node into huge. */
 	node->addr = ret;
 	node->size = csize;
-
-	malloc_mutex_lock(&huge_mtx);
-	extent_tree_ad_insert(&huge, node);
-#ifdef JEMALLOC_STATS
-	huge_nmalloc++;
-	huge_allocated += csize;
-#endif
-	malloc_mutex_unlock(&huge_mtx);
+	huge_insert(ret, node);
 
 #ifdef JEMALLOC_FILL
 	if (zero == false) {
@@ -135,14 +153,7 @@ huge_palloc(size_t size, size_t alignment, bool zero)
 	/* Insert node into huge. */
 	node->addr = ret;
 	node->size = chunk_size;
-
-	malloc_mutex_lock(&huge_mtx);
-	extent_tree_ad_insert(&huge, node);
-#ifdef JEMALLOC_STATS
-	huge_nmalloc++;
-	huge_allocated += chunk_size;
-#endif
-	malloc_mutex_unlock(&huge_mtx);
+	huge_insert(ret, node);
 
 #ifdef JEMALLOC_FILL
 	if (zero == false) {
@@ -156,6 +167,43 @@ huge_palloc(size_t size, size_t alignment, bool zero)
 	return (ret);
 }
 
+/*
+ * Grow a huge allocation in place to newsize bytes, which must be a multiple
+ * of chunksize.  Returns true if the address range that follows it is not
+ * available.
+ */
+static bool
+huge_grow(void *ptr, size_t oldsize, size_t newsize)
+{
+	huge_shard_t *shard;
+	extent_node_t *node, key;
+
+	if (chunk_extend(ptr, oldsize, newsize))
+		return (true);
+
+	shard = huge_shard_get(ptr);
+	malloc_mutex_lock(&shard->mtx);
+	key.addr = ptr;
+	node = extent_tree_ad_search(&shard->huge, &key);
+	assert(node != NULL);
+	assert(node->size == oldsize);
+	node->size = newsize;
+#ifdef JEMALLOC_STATS
+	shard->allocated += newsize - oldsize;
+#endif
+	malloc_mutex_unlock(&shard->mtx);
+
+#ifdef JEMALLOC_FILL
+	/* chunk_extend() zero-fills, so only junk filling is left to do. */
+	if (opt_junk) {
+		memset((void *)((uintptr_t)ptr + oldsize), 0xa5, newsize -
+		    oldsize);
+	}
+#endif
+
+	return (false);
+}
+
 void *
 huge_ralloc_no_move(void *ptr, size_t oldsize, size_t size, size_t extra)
 {
@@ -176,6 +224,19 @@ huge_ralloc_no_move(void *ptr, size_t oldsize, size_t size, size_t extra)
 		return (ptr);
 	}
 
+	/*
+	 * Try to grow in place, with extra and then without, so that growing
+	 * buffers move neither pages nor bytes.
+	 */
+	if (oldsize > arena_maxclass && CHUNK_CEILING(size) > oldsize) {
+		assert(CHUNK_CEILING(oldsize) == oldsize);
+		if (huge_grow(ptr, oldsize, CHUNK_CEILING(size+extra)) == false)
+			return (ptr);
+		if (CHUNK_CEILING(size+extra) != CHUNK_CEILING(size) &&
+		    huge_grow(ptr, oldsize, CHUNK_CEILING(size)) == false)
+			return (ptr);
+	}
+
 	/* Reallocation would require a move. */
 	return (NULL);
 }
@@ -237,6 +298,11 @@ huge_ralloc(void *ptr, size_t oldsize, size_t size, size_t extra,
 	    ) {
 		size_t newsize = huge_salloc(ret);
 
+		/*
+		 * Stop tracking ptr first, since another thread may map its
+		 * address range again as soon as mremap() has moved the pages.
+		 */
+		huge_dalloc(ptr, false);
 		if (mremap(ptr, oldsize, newsize, MREMAP_MAYMOVE|MREMAP_FIXED,
 		    ret) == MAP_FAILED) {
 			/*
@@ -256,9 +322,8 @@ huge_ralloc(void *ptr, size_t oldsize, size_t size, size_t extra,
 			if (opt_abort)
 				abort();
 			memcpy(ret, ptr, copysize);
-			idalloc(ptr);
-		} else
-			huge_dalloc(ptr, false);
+			chunk_dealloc(ptr, oldsize);
+		}
 	} else
 #endif
 	{
@@ -271,23 +336,25 @@ huge_ralloc(void *ptr, size_t oldsize, size_t size, size_t extra,
 void
 huge_dalloc(void *ptr, bool unmap)
 {
+	huge_shard_t *shard;
 	extent_node_t *node, key;
 
-	malloc_mutex_lock(&huge_mtx);
+	shard = huge_shard_get(ptr);
+	malloc_mutex_lock(&shard->mtx);
 
 	/* Extract from tree of huge allocations. */
 	key.addr = ptr;
-	node = extent_tree_ad_search(&huge, &key);
+	node = extent_tree_ad_search(&shard->huge, &key);
 	assert(node != NULL);
 	assert(node->addr == ptr);
-	extent_tree_ad_remove(&huge, node);
+	extent_tree_ad_remove(&shard->huge, node);
 
 #ifdef JEMALLOC_STATS
-	huge_ndalloc++;
-	huge_allocated -= node->size;
+	shard->ndalloc++;
+	shard->allocated -= node->size;
 #endif
 
-	malloc_mutex_unlock(&huge_mtx);
+	malloc_mutex_unlock(&shard->mtx);
 
 	if (unmap) {
 	/* Unmap chunk. */
@@ -307,18 +374,20 @@ size_t
 huge_salloc(const void *ptr)
 {
 	size_t ret;
+	huge_shard_t *shard;
 	extent_node_t *node, key;
 
-	malloc_mutex_lock(&huge_mtx);
+	shard = huge_shard_get(ptr);
+	malloc_mutex_lock(&shard->mtx);
 
 	/* Extract from tree of huge allocations. */
 	key.addr = __DECONST(void *, ptr);
-	node = extent_tree_ad_search(&huge, &key);
+	node = extent_tree_ad_search(&shard->huge, &key);
 	assert(node != NULL);
 
 	ret = node->size;
 
-	malloc_mutex_unlock(&huge_mtx);
+	malloc_mutex_unlock(&shard->mtx);
 
 	return (ret);
 }
@@ -328,18 +397,20 @@ prof_ctx_t *
 huge_prof_ctx_get(const void *ptr)
 {
 	prof_ctx_t *ret;
+	huge_shard_t *shard;
 	extent_node_t *node, key;
 
-	malloc_mutex_lock(&huge_mtx);
+	shard = huge_shard_get(ptr);
+	malloc_mutex_lock(&shard->mtx);
 
 	/* Extract from tree of huge allocations. */
 	key.addr = __DECONST(void *, ptr);
-	node = extent_tree_ad_search(&huge, &key);
+	node = extent_tree_ad_search(&shard->huge, &key);
 	assert(node != NULL);
 
 	ret = node->prof_ctx;
 
-	malloc_mutex_unlock(&huge_mtx);
+	malloc_mutex_unlock(&shard->mtx);
 
 	return (ret);
 }
@@ -347,35 +418,64 @@ huge_prof_ctx_get(const void *ptr)
 void
 huge_prof_ctx_set(const void *ptr, prof_ctx_t *ctx)
 {
+	huge_shard_t *shard;
 	extent_node_t *node, key;
 
-	malloc_mutex_lock(&huge_mtx);
+	shard = huge_shard_get(ptr);
+	malloc_mutex_lock(&shard->mtx);
 
 	/* Extract from tree of huge allocations. */
 	key.addr = __DECONST(void *, ptr);
-	node = extent_tree_ad_search(&huge, &key);
+	node = extent_tree_ad_search(&shard->huge, &key);
 	assert(node != NULL);
 
 	node->prof_ctx = ctx;
 
-	malloc_mutex_unlock(&huge_mtx);
+	malloc_mutex_unlock(&shard->mtx);
+}
+#endif
+
+#ifdef JEMALLOC_STATS
+/* Sum up the statistics of all shards. */
+void
+huge_stats_merge(size_t *allocated, uint64_t *nmalloc, uint64_t *ndalloc)
+{
+	unsigned i;
+
+	*allocated = 0;
+	*nmalloc = 0;
+	*ndalloc = 0;
+	for (i = 0; i < HUGE_NSHARDS; i++) {
+		huge_shard_t *shard = &huge_shards[i];
+
+		malloc_mutex_lock(&shard->mtx);
+		*allocated += shard->allocated;
+		*nmalloc += shard->nmalloc;
+		*ndalloc += shard->ndalloc;
+		malloc_mutex_unlock(&shard->mtx);
+	}
 }
 #endif
 
 bool
 huge_boot(void)
 {
+	unsigned i;
 
 	/* Initialize chunks data. */
-	if (malloc_mutex_init(&huge_mtx))
-		return (true);
-	extent_tree_ad_new(&huge);
+	for (i = 0; i < HUGE_NSHARDS; i++) {
+		huge_shard_t *shard = &huge_shards[i];
+
+		if (malloc_mutex_init(&shard->mtx))
+			return (true);
+		extent_tree_ad_new(&shard->huge);
 
 #ifdef JEMALLOC_STATS
-	huge_nmalloc = 0;
-	huge_ndalloc = 0;
-	huge_allocated = 0;
+		shard->nmalloc = 0;
+		shard->ndalloc = 0;
+		shard->allocated = 0;
 #endif
+	}
 
 	return (false);
 }
@@ -15,6 +15,11 @@ __thread arena_t	*arenas_tls JEMALLOC_ATTR(tls_model("initial-exec"));
 pthread_key_t		arenas_tsd;
 #endif
 
+#if (defined(JEMALLOC_PERCPU_ARENA) && !defined(NO_TLS))
+__thread unsigned	percpu_arena_ticks
+    JEMALLOC_ATTR(tls_model("initial-exec"));
+#endif
+
 #ifdef JEMALLOC_STATS
 #  ifndef NO_TLS
 __thread thread_allocated_t	thread_allocated_tls;
@@ -63,6 +68,9 @@ bool	opt_xmalloc = false;
 bool	opt_zero = false;
 #endif
 size_t	opt_narenas = 0;
+#ifdef JEMALLOC_PERCPU_ARENA
+bool	opt_percpu_arena = false;
+#endif
 
 /******************************************************************************/
 /* Function prototypes for non-inline static functions. */
@@ -146,6 +154,11 @@ choose_arena_hard(void)
 {
 	arena_t *ret;
 
+#ifdef JEMALLOC_PERCPU_ARENA
+	if (opt_percpu_arena)
+		return (choose_arena_percpu());
+#endif
+
 	if (narenas > 1) {
 		malloc_mutex_lock(&arenas_lock);
 		if ((ret = arenas[next_arena]) == NULL)
@@ -160,6 +173,40 @@ choose_arena_hard(void)
 	return (ret);
 }
 
+#ifdef JEMALLOC_PERCPU_ARENA
+/*
+ * Choose the arena for the CPU that the calling thread is running on.  This is
+ * the first choice for a thread as well as each periodic recheck, so a thread
+ * that the scheduler has migrated follows its new CPU.  The CPU can change
+ * again right after the call; that only costs locality, not correctness.
+ */
+arena_t *
+choose_arena_percpu(void)
+{
+	arena_t *ret;
+	int cpu;
+	unsigned ind;
+
+#  ifndef NO_TLS
+	percpu_arena_ticks = PERCPU_ARENA_RECHECK;
+#  endif
+	cpu = sched_getcpu();
+	ind = (cpu < 0) ? 0 : (unsigned)cpu % narenas;
+
+	if ((ret = arenas[ind]) == NULL) {
+		malloc_mutex_lock(&arenas_lock);
+		if ((ret = arenas[ind]) == NULL)
+			ret = arenas_extend(ind);
+		malloc_mutex_unlock(&arenas_lock);
+	}
+
+	if (ret != ARENA_GET())
+		ARENA_SET(ret);
+
+	return (ret);
+}
+#endif
+
 /*
  * glibc provides a non-standard strerror_r() when _GNU_SOURCE is defined, so
  * provide a wrapper.
@@ -522,9 +569,17 @@ malloc_conf_init(void)
 			CONF_HANDLE_SIZE_T(lg_chunk, PAGE_SHIFT+1,
 			    (sizeof(size_t) << 3) - 1)
 			CONF_HANDLE_SIZE_T(narenas, 1, SIZE_T_MAX)
+			CONF_HANDLE_SIZE_T(chunk_cache_max, 0, SIZE_T_MAX)
 			CONF_HANDLE_SSIZE_T(lg_dirty_mult, -1,
 			    (sizeof(size_t) << 3) - 1)
 			CONF_HANDLE_BOOL(stats_print)
+#ifdef JEMALLOC_PERCPU_ARENA
+			CONF_HANDLE_BOOL(percpu_arena)
+#endif
+#ifdef JEMALLOC_BACKGROUND_THREAD
+			CONF_HANDLE_BOOL(background_thread)
+			CONF_HANDLE_SSIZE_T(dirty_decay_ms, -1, INT_MAX)
+#endif
 #ifdef JEMALLOC_FILL
 			CONF_HANDLE_BOOL(junk)
 			CONF_HANDLE_BOOL(zero)
@@ -541,6 +596,7 @@ malloc_conf_init(void)
 			    (sizeof(size_t) << 3) - 1)
 			CONF_HANDLE_SSIZE_T(lg_tcache_max, -1,
 			    (sizeof(size_t) << 3) - 1)
+			CONF_HANDLE_BOOL(tcache_adaptive)
 #endif
 #ifdef JEMALLOC_PROF
 			CONF_HANDLE_BOOL(prof)
@@ -679,6 +735,13 @@ malloc_init_hard(void)
 		return (true);
 	}
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	if (background_thread_boot()) {
+		malloc_mutex_unlock(&init_lock);
+		return (true);
+	}
+#endif
+
 #if (defined(JEMALLOC_STATS) && defined(NO_TLS))
 	/* Initialize allocation counters before any allocations can occur. */
 	if (pthread_key_create(&thread_allocated_tsd, thread_allocated_cleanup)
@@ -731,8 +794,13 @@ malloc_init_hard(void)
 	if (opt_narenas == 0) {
 		/*
 		 * For SMP systems, create more than one arena per CPU by
-		 * default.
+		 * default.  Per CPU arenas are exactly that, one per CPU.
 		 */
+#ifdef JEMALLOC_PERCPU_ARENA
+		if (opt_percpu_arena)
+			opt_narenas = ncpus;
+		else
+#endif
 		if (ncpus > 1)
 			opt_narenas = ncpus << 2;
 		else
@@ -790,6 +858,16 @@ malloc_init_hard(void)
 
 	malloc_initialized = true;
 	malloc_mutex_unlock(&init_lock);
+
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	/* Started last, since the thread walks the arenas array. */
+	if (opt_background_thread && background_thread_start()) {
+		malloc_write("<jemalloc>: Error starting background thread\n");
+		if (opt_abort)
+			abort();
+	}
+#endif
+
 	return (false);
 }
 
@@ -1694,6 +1772,111 @@ JEMALLOC_P(dallocm)(void *ptr, int flags)
 	return (ALLOCM_SUCCESS);
 }
 
+/*
+ * Deallocate an object whose size the caller knows: the size and alignment
+ * flags it was allocated with by allocm(), or the size given to malloc().
+ * Small objects go to the thread cache bin their size class maps to, without
+ * reading the chunk map to find their run and bin.  Everything else, and all
+ * objects while profiling (sampled objects are promoted to large runs), goes
+ * through dallocm().
+ */
+JEMALLOC_ATTR(nonnull(1))
+JEMALLOC_ATTR(visibility("default"))
+int
+JEMALLOC_P(sdallocm)(void *ptr, size_t size, int flags)
+{
+#ifdef JEMALLOC_TCACHE
+	size_t usize;
+	size_t alignment = (ZU(1) << (flags & ALLOCM_LG_ALIGN_MASK)
+	    & (SIZE_T_MAX-1));
+	tcache_t *tcache;
+
+	assert(ptr != NULL);
+	assert(size != 0);
+	assert(malloc_initialized || malloc_initializer == pthread_self());
+
+	usize = (alignment == 0) ? s2u(size) : sa2u(size, alignment, NULL);
+	if (usize <= small_maxclass
+#ifdef JEMALLOC_PROF
+	    && opt_prof == false
+#endif
+	    && (tcache = tcache_get()) != NULL) {
+		assert(isalloc(ptr) == usize);
+#ifdef JEMALLOC_STATS
+		ALLOCATED_ADD(0, usize);
+#endif
+		tcache_dalloc_small_bin(tcache, ptr, small_size2bin[usize]);
+		return (ALLOCM_SUCCESS);
+	}
+#endif
+
+	return (JEMALLOC_P(dallocm)(ptr, flags));
+}
+
+/*
+ * Allocate n objects of the same size.  Small size classes are carved from
+ * the arena bin under a single bin lock; everything else, including aligned
+ * and profiled requests, goes through allocm() one object at a time.  Either
+ * all n objects are allocated or none are.
+ */
+JEMALLOC_ATTR(nonnull(1))
+JEMALLOC_ATTR(visibility("default"))
+int
+JEMALLOC_P(batchallocm)(void **ptrs, size_t *rsize, size_t size, size_t n,
+    int flags)
+{
+	size_t i, usize;
+	arena_t *arena;
+	bool zero = flags & ALLOCM_ZERO;
+
+	assert(ptrs != NULL);
+	assert(size != 0);
+
+	if (malloc_init())
+		goto OOM;
+
+	usize = s2u(size);
+	if ((flags & ALLOCM_LG_ALIGN_MASK) != 0 || size > small_maxclass
+#ifdef JEMALLOC_PROF
+	    || opt_prof
+#endif
+	    ) {
+		for (i = 0; i < n; i++) {
+			if (JEMALLOC_P(allocm)(&ptrs[i], &usize, size, flags) !=
+			    ALLOCM_SUCCESS)
+				goto ROLLBACK;
+		}
+	} else {
+		arena = choose_arena();
+		for (i = 0; i < n;) {
+			size_t nfill = arena_malloc_small_batch(arena, size,
+			    zero, &ptrs[i], n - i);
+			if (nfill == 0)
+				goto ROLLBACK;
+#ifdef JEMALLOC_STATS
+			ALLOCATED_ADD(usize * nfill, 0);
+#endif
+			i += nfill;
+		}
+	}
+
+	if (rsize != NULL)
+		*rsize = usize;
+	return (ALLOCM_SUCCESS);
+ROLLBACK:
+	while (i > 0)
+		JEMALLOC_P(dallocm)(ptrs[--i], 0);
+OOM:
+#ifdef JEMALLOC_XMALLOC
+	if (opt_xmalloc) {
+		malloc_write("<jemalloc>: Error in batchallocm(): "
+		    "out of memory\n");
+		abort();
+	}
+#endif
+	return (ALLOCM_ERR_OOM);
+}
+
 /*
  * End non-standard functions.
  */
@@ -1711,6 +1894,10 @@ jemalloc_prefork(void)
 
 	/* Acquire all mutexes in a safe order. */
 
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	background_thread_prefork();
+#endif
+
 	malloc_mutex_lock(&arenas_lock);
 	for (i = 0; i < narenas; i++) {
 		if (arenas[i] != NULL)
@@ -1719,7 +1906,8 @@ jemalloc_prefork(void)
 
 	malloc_mutex_lock(&base_mtx);
 
-	malloc_mutex_lock(&huge_mtx);
+	for (i = 0; i < HUGE_NSHARDS; i++)
+		malloc_mutex_lock(&huge_shards[i].mtx);
 
 #ifdef JEMALLOC_DSS
 	malloc_mutex_lock(&dss_mtx);
@@ -1728,6 +1916,8 @@ jemalloc_prefork(void)
 #ifdef JEMALLOC_SWAP
 	malloc_mutex_lock(&swap_mtx);
 #endif
+
+	malloc_mutex_lock(&chunk_cache_mtx);
 }
 
 void
@@ -1737,6 +1927,8 @@ jemalloc_postfork(void)
 
 	/* Release all mutexes, now that fork() has completed. */
 
+	malloc_mutex_unlock(&chunk_cache_mtx);
+
 #ifdef JEMALLOC_SWAP
 	malloc_mutex_unlock(&swap_mtx);
 #endif
@@ -1745,7 +1937,8 @@ jemalloc_postfork(void)
 	malloc_mutex_unlock(&dss_mtx);
 #endif
 
-	malloc_mutex_unlock(&huge_mtx);
+	for (i = 0; i < HUGE_NSHARDS; i++)
+		malloc_mutex_unlock(&huge_shards[i].mtx);
 
 	malloc_mutex_unlock(&base_mtx);
 
@@ -1754,6 +1947,10 @@ jemalloc_postfork(void)
 			malloc_mutex_unlock(&arenas[i]->lock);
 	}
 	malloc_mutex_unlock(&arenas_lock);
+
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	background_thread_postfork();
+#endif
 }
 
 /******************************************************************************/
@@ -42,6 +42,24 @@ bool	opt_stats_print = false;
 /******************************************************************************/
 /* Function prototypes for non-inline static functions. */
 
+static void	stats_json_key(void (*write_cb)(void *, const char *),
+    void *cbopaque, bool *first, const char *key);
+static void	stats_json_uint(void (*write_cb)(void *, const char *),
+    void *cbopaque, bool *first, const char *key, uint64_t v);
+static void	stats_json_int(void (*write_cb)(void *, const char *),
+    void *cbopaque, bool *first, const char *key, ssize_t v);
+static void	stats_json_bool(void (*write_cb)(void *, const char *),
+    void *cbopaque, bool *first, const char *key, bool v);
+static void	stats_json_string(void (*write_cb)(void *, const char *),
+    void *cbopaque, bool *first, const char *key, const char *v);
+static void	stats_print_json(void (*write_cb)(void *, const char *),
+    void *cbopaque, bool general, bool merged, bool unmerged, bool bins,
+    bool large);
+#ifdef JEMALLOC_STATS
+static void	stats_arena_json(void (*write_cb)(void *, const char *),
+    void *cbopaque, unsigned i, bool bins, bool large);
+#endif
+
 #ifdef JEMALLOC_STATS
 static void	malloc_vcprintf(void (*write_cb)(void *, const char *),
     void *cbopaque, const char *format, va_list ap);
@@ -371,6 +389,558 @@ stats_arena_print(void (*write_cb)(void *, const char *), void *cbopaque,
 }
 #endif
 
+/*
+ * JSON output, selected with 'J' in the opts string.  The same data as the
+ * text output is emitted as one object, keyed by the mallctl names it comes
+ * from, so that collectors need not parse the tables.  Like the text output
+ * it is written a piece at a time through write_cb, and only uses
+ * malloc_cprintf() where JEMALLOC_STATS provides it.
+ */
+
+static void
+stats_json_key(void (*write_cb)(void *, const char *), void *cbopaque,
+    bool *first, const char *key)
+{
+
+	write_cb(cbopaque, *first ? "\"" : ",\"");
+	write_cb(cbopaque, key);
+	write_cb(cbopaque, "\":");
+	*first = false;
+}
+
+static void
+stats_json_uint(void (*write_cb)(void *, const char *), void *cbopaque,
+    bool *first, const char *key, uint64_t v)
+{
+	char s[UMAX2S_BUFSIZE];
+
+	stats_json_key(write_cb, cbopaque, first, key);
+	write_cb(cbopaque, u2s(v, 10, s));
+}
+
+static void
+stats_json_int(void (*write_cb)(void *, const char *), void *cbopaque,
+    bool *first, const char *key, ssize_t v)
+{
+	char s[UMAX2S_BUFSIZE];
+
+	stats_json_key(write_cb, cbopaque, first, key);
+	if (v < 0) {
+		write_cb(cbopaque, "-");
+		write_cb(cbopaque, u2s(-v, 10, s));
+	} else
+		write_cb(cbopaque, u2s(v, 10, s));
+}
+
+static void
+stats_json_bool(void (*write_cb)(void *, const char *), void *cbopaque,
+    bool *first, const char *key, bool v)
+{
+
+	stats_json_key(write_cb, cbopaque, first, key);
+	write_cb(cbopaque, v ? "true" : "false");
+}
+
+static void
+stats_json_string(void (*write_cb)(void *, const char *), void *cbopaque,
+    bool *first, const char *key, const char *v)
+{
+	char buf[UMAX2S_BUFSIZE];
+	unsigned n;
+
+	stats_json_key(write_cb, cbopaque, first, key);
+	write_cb(cbopaque, "\"");
+	for (n = 0; *v != '\0'; v++) {
+		/* Room for the longest escape, "\u00XX", and a NUL. */
+		if (n + 7 > sizeof(buf)) {
+			buf[n] = '\0';
+			write_cb(cbopaque, buf);
+			n = 0;
+		}
+		if (*v == '"' || *v == '\\') {
+			buf[n++] = '\\';
+			buf[n++] = *v;
+		} else if ((unsigned char)*v < 0x20) {
+			buf[n++] = '\\';
+			buf[n++] = 'u';
+			buf[n++] = '0';
+			buf[n++] = '0';
+			buf[n++] = "0123456789abcdef"[(unsigned char)*v >> 4];
+			buf[n++] = "0123456789abcdef"[*v & 0xf];
+		} else
+			buf[n++] = *v;
+	}
+	buf[n] = '\0';
+	write_cb(cbopaque, buf);
+	write_cb(cbopaque, "\"");
+}
+
+#ifdef JEMALLOC_STATS
+static void
+stats_arena_json(void (*write_cb)(void *, const char *), void *cbopaque,
+    unsigned i, bool bins, bool large)
+{
+	size_t pagesize, pactive, pdirty, mapped, allocated;
+	uint64_t npurge, nmadvise, purged, nmalloc, ndalloc, nrequests;
+	bool config_tcache, first, efirst;
+	unsigned nbins, j;
+
+	CTL_GET("arenas.pagesize", &pagesize, size_t);
+	CTL_GET("config.tcache", &config_tcache, bool);
+
+	first = true;
+	write_cb(cbopaque, "{");
+	CTL_I_GET("stats.arenas.0.pactive", &pactive, size_t);
+	CTL_I_GET("stats.arenas.0.pdirty", &pdirty, size_t);
+	CTL_I_GET("stats.arenas.0.mapped", &mapped, size_t);
+	CTL_I_GET("stats.arenas.0.npurge", &npurge, uint64_t);
+	CTL_I_GET("stats.arenas.0.nmadvise", &nmadvise, uint64_t);
+	CTL_I_GET("stats.arenas.0.purged", &purged, uint64_t);
+	stats_json_uint(write_cb, cbopaque, &first, "pactive", pactive);
+	stats_json_uint(write_cb, cbopaque, &first, "pdirty", pdirty);
+	stats_json_uint(write_cb, cbopaque, &first, "active",
+	    pactive * pagesize);
+	stats_json_uint(write_cb, cbopaque, &first, "mapped", mapped);
+	stats_json_uint(write_cb, cbopaque, &first, "npurge", npurge);
+	stats_json_uint(write_cb, cbopaque, &first, "nmadvise", nmadvise);
+	stats_json_uint(write_cb, cbopaque, &first, "purged", purged);
+
+	CTL_I_GET("stats.arenas.0.small.allocated", &allocated, size_t);
+	CTL_I_GET("stats.arenas.0.small.nmalloc", &nmalloc, uint64_t);
+	CTL_I_GET("stats.arenas.0.small.ndalloc", &ndalloc, uint64_t);
+	CTL_I_GET("stats.arenas.0.small.nrequests", &nrequests, uint64_t);
+	stats_json_key(write_cb, cbopaque, &first, "small");
+	efirst = true;
+	write_cb(cbopaque, "{");
+	stats_json_uint(write_cb, cbopaque, &efirst, "allocated", allocated);
+	stats_json_uint(write_cb, cbopaque, &efirst, "nmalloc", nmalloc);
+	stats_json_uint(write_cb, cbopaque, &efirst, "ndalloc", ndalloc);
+	stats_json_uint(write_cb, cbopaque, &efirst, "nrequests", nrequests);
+	write_cb(cbopaque, "}");
+
+	CTL_I_GET("stats.arenas.0.large.allocated", &allocated, size_t);
+	CTL_I_GET("stats.arenas.0.large.nmalloc", &nmalloc, uint64_t);
+	CTL_I_GET("stats.arenas.0.large.ndalloc", &ndalloc, uint64_t);
+	CTL_I_GET("stats.arenas.0.large.nrequests", &nrequests, uint64_t);
+	stats_json_key(write_cb, cbopaque, &first, "large");
+	efirst = true;
+	write_cb(cbopaque, "{");
+	stats_json_uint(write_cb, cbopaque, &efirst, "allocated", allocated);
+	stats_json_uint(write_cb, cbopaque, &efirst, "nmalloc", nmalloc);
+	stats_json_uint(write_cb, cbopaque, &efirst, "ndalloc", ndalloc);
+	stats_json_uint(write_cb, cbopaque, &efirst, "nrequests", nrequests);
+	write_cb(cbopaque, "}");
+
+	if (bins) {
+		/* Every bin is listed, so that an index is a size class. */
+		stats_json_key(write_cb, cbopaque, &first, "bins");
+		write_cb(cbopaque, "[");
+		CTL_GET("arenas.nbins", &nbins, unsigned);
+		for (j = 0; j < nbins; j++) {
+			size_t reg_size, highruns, curruns;
+			uint64_t nfills, nflushes, nruns, reruns;
+
+			CTL_J_GET("arenas.bin.0.size", &reg_size, size_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.allocated",
+			    &allocated, size_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.nmalloc", &nmalloc,
+			    uint64_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.ndalloc", &ndalloc,
+			    uint64_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.nrequests",
+			    &nrequests, uint64_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.nruns", &nruns,
+			    uint64_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.nreruns", &reruns,
+			    uint64_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.highruns",
+			    &highruns, size_t);
+			CTL_IJ_GET("stats.arenas.0.bins.0.curruns", &curruns,
+			    size_t);
+
+			efirst = true;
+			write_cb(cbopaque, j == 0 ? "{" : ",{");
+			stats_json_uint(write_cb, cbopaque, &efirst, "size",
+			    reg_size);
+			stats_json_uint(write_cb, cbopaque, &efirst,
+			    "allocated", allocated);
+			stats_json_uint(write_cb, cbopaque, &efirst, "nmalloc",
+			    nmalloc);
+			stats_json_uint(write_cb, cbopaque, &efirst, "ndalloc",
+			    ndalloc);
+			stats_json_uint(write_cb, cbopaque, &efirst,
+			    "nrequests", nrequests);
+			if (config_tcache) {
+				CTL_IJ_GET("stats.arenas.0.bins.0.nfills",
+				    &nfills, uint64_t);
+				CTL_IJ_GET("stats.arenas.0.bins.0.nflushes",
+				    &nflushes, uint64_t);
+				stats_json_uint(write_cb, cbopaque, &efirst,
+				    "nfills", nfills);
+				stats_json_uint(write_cb, cbopaque, &efirst,
+				    "nflushes", nflushes);
+			}
+			stats_json_uint(write_cb, cbopaque, &efirst, "nruns",
+			    nruns);
+			stats_json_uint(write_cb, cbopaque, &efirst, "nreruns",
+			    reruns);
+			stats_json_uint(write_cb, cbopaque, &efirst,
+			    "highruns", highruns);
+			stats_json_uint(write_cb, cbopaque, &efirst, "curruns",
+			    curruns);
+			write_cb(cbopaque, "}");
+		}
+		write_cb(cbopaque, "]");
+	}
+
+	if (large) {
+		size_t nlruns;
+		bool lfirst;
+
+		/* Large run classes are many; only those used are listed. */
+		stats_json_key(write_cb, cbopaque, &first, "lruns");
+		write_cb(cbopaque, "[");
+		CTL_GET("arenas.nlruns", &nlruns, size_t);
+		for (j = 0, lfirst = true; j < nlruns; j++) {
+			size_t run_size, highruns, curruns;
+
+			CTL_IJ_GET("stats.arenas.0.lruns.0.nrequests",
+			    &nrequests, uint64_t);
+			if (nrequests == 0)
+				continue;
+			CTL_J_GET("arenas.lrun.0.size", &run_size, size_t);
+			CTL_IJ_GET("stats.arenas.0.lruns.0.nmalloc", &nmalloc,
+			    uint64_t);
+			CTL_IJ_GET("stats.arenas.0.lruns.0.ndalloc", &ndalloc,
+			    uint64_t);
+			CTL_IJ_GET("stats.arenas.0.lruns.0.highruns",
+			    &highruns, size_t);
+			CTL_IJ_GET("stats.arenas.0.lruns.0.curruns", &curruns,
+			    size_t);
+
+			efirst = true;
+			write_cb(cbopaque, lfirst ? "{" : ",{");
+			lfirst = false;
+			stats_json_uint(write_cb, cbopaque, &efirst, "size",
+			    run_size);
+			stats_json_uint(write_cb, cbopaque, &efirst, "pages",
+			    run_size / pagesize);
+			stats_json_uint(write_cb, cbopaque, &efirst, "nmalloc",
+			    nmalloc);
+			stats_json_uint(write_cb, cbopaque, &efirst, "ndalloc",
+			    ndalloc);
+			stats_json_uint(write_cb, cbopaque, &efirst,
+			    "nrequests", nrequests);
+			stats_json_uint(write_cb, cbopaque, &efirst,
+			    "highruns", highruns);
+			stats_json_uint(write_cb, cbopaque, &efirst, "curruns",
+			    curruns);
+			write_cb(cbopaque, "}");
+		}
+		write_cb(cbopaque, "]");
+	}
+
+	write_cb(cbopaque, "}");
+}
+#endif
+
+static void
+stats_print_json(void (*write_cb)(void *, const char *), void *cbopaque,
+    bool general, bool merged, bool unmerged, bool bins, bool large)
+{
+	bool first, ofirst;
+
+	first = true;
+	write_cb(cbopaque, "{\"jemalloc\":{");
+	if (general) {
+		const char *cpv;
+		bool bv;
+		unsigned uv, j;
+		ssize_t ssv;
+		size_t sv, bsz, ssz, sssz, usz, cpsz;
+
+		bsz = sizeof(bool);
+		ssz = sizeof(size_t);
+		sssz = sizeof(ssize_t);
+		cpsz = sizeof(const char *);
+
+		CTL_GET("version", &cpv, const char *);
+		stats_json_string(write_cb, cbopaque, &first, "version", cpv);
+
+		stats_json_key(write_cb, cbopaque, &first, "config");
+		ofirst = true;
+		write_cb(cbopaque, "{");
+#define CONFIG_JSON_BOOL(n)						\
+		CTL_GET("config."#n, &bv, bool);			\
+		stats_json_bool(write_cb, cbopaque, &ofirst, #n, bv);
+		CONFIG_JSON_BOOL(debug)
+		CONFIG_JSON_BOOL(dss)
+		CONFIG_JSON_BOOL(fill)
+		CONFIG_JSON_BOOL(prof)
+		CONFIG_JSON_BOOL(stats)
+		CONFIG_JSON_BOOL(swap)
+		CONFIG_JSON_BOOL(tcache)
+		CONFIG_JSON_BOOL(tls)
+#undef CONFIG_JSON_BOOL
+		write_cb(cbopaque, "}");
+
+		stats_json_key(write_cb, cbopaque, &first, "opt");
+		ofirst = true;
+		write_cb(cbopaque, "{");
+#define OPT_JSON_BOOL(n)						\
+		if (JEMALLOC_P(mallctl)("opt."#n, &bv, &bsz, NULL, 0) == 0) \
+			stats_json_bool(write_cb, cbopaque, &ofirst, #n, bv);
+#define OPT_JSON_SIZE_T(n)						\
+		if (JEMALLOC_P(mallctl)("opt."#n, &sv, &ssz, NULL, 0) == 0) \
+			stats_json_uint(write_cb, cbopaque, &ofirst, #n, sv);
+#define OPT_JSON_SSIZE_T(n)						\
+		if (JEMALLOC_P(mallctl)("opt."#n, &ssv, &sssz, NULL, 0) == 0) \
+			stats_json_int(write_cb, cbopaque, &ofirst, #n, ssv);
+#define OPT_JSON_CHAR_P(n)						\
+		if (JEMALLOC_P(mallctl)("opt."#n, &cpv, &cpsz, NULL, 0) == 0) \
+			stats_json_string(write_cb, cbopaque, &ofirst, #n, cpv);
+		OPT_JSON_BOOL(abort)
+		OPT_JSON_SIZE_T(lg_qspace_max)
+		OPT_JSON_SIZE_T(lg_cspace_max)
+		OPT_JSON_SIZE_T(lg_chunk)
+		OPT_JSON_SIZE_T(narenas)
+		OPT_JSON_SIZE_T(chunk_cache_max)
+		OPT_JSON_SSIZE_T(lg_dirty_mult)
+		OPT_JSON_BOOL(stats_print)
+		OPT_JSON_BOOL(percpu_arena)
+		OPT_JSON_BOOL(background_thread)
+		OPT_JSON_SSIZE_T(dirty_decay_ms)
+		OPT_JSON_BOOL(junk)
+		OPT_JSON_BOOL(zero)
+		OPT_JSON_BOOL(sysv)
+		OPT_JSON_BOOL(xmalloc)
+		OPT_JSON_BOOL(tcache)
+		OPT_JSON_SSIZE_T(lg_tcache_gc_sweep)
+		OPT_JSON_SSIZE_T(lg_tcache_max)
+		OPT_JSON_BOOL(tcache_adaptive)
+		OPT_JSON_BOOL(prof)
+		OPT_JSON_CHAR_P(prof_prefix)
+		OPT_JSON_SIZE_T(lg_prof_bt_max)
+		OPT_JSON_BOOL(prof_active)
+		OPT_JSON_SSIZE_T(lg_prof_sample)
+		OPT_JSON_BOOL(prof_accum)
+		OPT_JSON_SSIZE_T(lg_prof_tcmax)
+		OPT_JSON_SSIZE_T(lg_prof_interval)
+		OPT_JSON_BOOL(prof_gdump)
+		OPT_JSON_BOOL(prof_leak)
+		OPT_JSON_BOOL(overcommit)
+#undef OPT_JSON_BOOL
+#undef OPT_JSON_SIZE_T
+#undef OPT_JSON_SSIZE_T
+#undef OPT_JSON_CHAR_P
+		write_cb(cbopaque, "}");
+
+		stats_json_uint(write_cb, cbopaque, &first, "ncpus", ncpus);
+		stats_json_uint(write_cb, cbopaque, &first, "pointer_size",
+		    sizeof(void *));
+
+		stats_json_key(write_cb, cbopaque, &first, "arenas");
+		ofirst = true;
+		write_cb(cbopaque, "{");
+#define ARENAS_JSON_UNSIGNED(n)						\
+		CTL_GET("arenas."#n, &uv, unsigned);			\
+		stats_json_uint(write_cb, cbopaque, &ofirst, #n, uv);
+#define ARENAS_JSON_SIZE_T(n)						\
+		if (JEMALLOC_P(mallctl)("arenas."#n, &sv, &ssz, NULL, 0) == 0) \
+			stats_json_uint(write_cb, cbopaque, &ofirst, #n, sv);
+		ARENAS_JSON_UNSIGNED(narenas)
+		ARENAS_JSON_SIZE_T(quantum)
+		ARENAS_JSON_SIZE_T(cacheline)
+		ARENAS_JSON_SIZE_T(subpage)
+		ARENAS_JSON_SIZE_T(pagesize)
+		ARENAS_JSON_SIZE_T(chunksize)
+		ARENAS_JSON_SIZE_T(chunk_cache_max)
+		ARENAS_JSON_SIZE_T(tspace_min)
+		ARENAS_JSON_SIZE_T(tspace_max)
+		ARENAS_JSON_SIZE_T(qspace_min)
+		ARENAS_JSON_SIZE_T(qspace_max)
+		ARENAS_JSON_SIZE_T(cspace_min)
+		ARENAS_JSON_SIZE_T(cspace_max)
+		ARENAS_JSON_SIZE_T(sspace_min)
+		ARENAS_JSON_SIZE_T(sspace_max)
+		ARENAS_JSON_SIZE_T(tcache_max)
+		ARENAS_JSON_UNSIGNED(ntbins)
+		ARENAS_JSON_UNSIGNED(nqbins)
+		ARENAS_JSON_UNSIGNED(ncbins)
+		ARENAS_JSON_UNSIGNED(nsbins)
+		ARENAS_JSON_UNSIGNED(nbins)
+		usz = sizeof(unsigned);
+		if (JEMALLOC_P(mallctl)("arenas.nhbins", &uv, &usz, NULL, 0)
+		    == 0)
+			stats_json_uint(write_cb, cbopaque, &ofirst, "nhbins",
+			    uv);
+		ARENAS_JSON_SIZE_T(nlruns)
+#undef ARENAS_JSON_UNSIGNED
+#undef ARENAS_JSON_SIZE_T
+
+		/* Size classes, the index of a bin in stats.arenas. */
+		stats_json_key(write_cb, cbopaque, &ofirst, "bin");
+		write_cb(cbopaque, "[");
+		CTL_GET("arenas.nbins", &uv, unsigned);
+		for (j = 0; j < uv; j++) {
+			uint32_t nregs;
+			bool bfirst = true;
+
+			write_cb(cbopaque, j == 0 ? "{" : ",{");
+			CTL_J_GET("arenas.bin.0.size", &sv, size_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst, "size",
+			    sv);
+			CTL_J_GET("arenas.bin.0.nregs", &nregs, uint32_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst, "nregs",
+			    nregs);
+			CTL_J_GET("arenas.bin.0.run_size", &sv, size_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst,
+			    "run_size", sv);
+			write_cb(cbopaque, "}");
+		}
+		write_cb(cbopaque, "]}");
+
+		if (JEMALLOC_P(mallctl)("background_thread", &bv, &bsz, NULL,
+		    0) == 0) {
+			uint64_t u64v;
+			bool bfirst = true;
+
+			stats_json_key(write_cb, cbopaque, &first,
+			    "background_thread");
+			write_cb(cbopaque, "{");
+			stats_json_bool(write_cb, cbopaque, &bfirst, "enabled",
+			    bv);
+			CTL_GET("arenas.dirty_decay_ms", &ssv, ssize_t);
+			stats_json_int(write_cb, cbopaque, &bfirst,
+			    "dirty_decay_ms", ssv);
+			CTL_GET("stats.background_thread.nruns", &u64v,
+			    uint64_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst, "nruns",
+			    u64v);
+			CTL_GET("stats.background_thread.npurged", &u64v,
+			    uint64_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst, "npurged",
+			    u64v);
+			CTL_GET("stats.background_thread.purge_ns", &u64v,
+			    uint64_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst, "purge_ns",
+			    u64v);
+			CTL_GET("stats.background_thread.purge_ns_max", &u64v,
+			    uint64_t);
+			stats_json_uint(write_cb, cbopaque, &bfirst,
+			    "purge_ns_max", u64v);
+			write_cb(cbopaque, "}");
+		}
+	}
+
+#ifdef JEMALLOC_STATS
+	{
+		size_t sv, ssz;
+		uint64_t u64v;
+		unsigned narenas, i;
+		char s[UMAX2S_BUFSIZE];
+
+		ssz = sizeof(size_t);
+
+		stats_json_key(write_cb, cbopaque, &first, "stats");
+		ofirst = true;
+		write_cb(cbopaque, "{");
+		CTL_GET("stats.allocated", &sv, size_t);
+		stats_json_uint(write_cb, cbopaque, &ofirst, "allocated", sv);
+		CTL_GET("stats.active", &sv, size_t);
+		stats_json_uint(write_cb, cbopaque, &ofirst, "active", sv);
+		CTL_GET("stats.mapped", &sv, size_t);
+		stats_json_uint(write_cb, cbopaque, &ofirst, "mapped", sv);
+
+		{
+			bool cfirst = true;
+
+			stats_json_key(write_cb, cbopaque, &ofirst, "chunks");
+			write_cb(cbopaque, "{");
+			CTL_GET("stats.chunks.total", &u64v, uint64_t);
+			stats_json_uint(write_cb, cbopaque, &cfirst, "total",
+			    u64v);
+			CTL_GET("stats.chunks.high", &sv, size_t);
+			stats_json_uint(write_cb, cbopaque, &cfirst, "high",
+			    sv);
+			CTL_GET("stats.chunks.current", &sv, size_t);
+			stats_json_uint(write_cb, cbopaque, &cfirst, "current",
+			    sv);
+			CTL_GET("stats.chunks.cache.current", &sv, size_t);
+			stats_json_uint(write_cb, cbopaque, &cfirst, "cached",
+			    sv);
+			CTL_GET("stats.chunks.cache.nhits", &u64v, uint64_t);
+			stats_json_uint(write_cb, cbopaque, &cfirst,
+			    "cache_nhits", u64v);
+			CTL_GET("stats.chunks.cache.nmisses", &u64v, uint64_t);
+			stats_json_uint(write_cb, cbopaque, &cfirst,
+			    "cache_nmisses", u64v);
+			if (JEMALLOC_P(mallctl)("swap.avail", &sv, &ssz, NULL,
+			    0) == 0) {
+				size_t lg_chunk;
+
+				CTL_GET("opt.lg_chunk", &lg_chunk, size_t);
+				stats_json_uint(write_cb, cbopaque, &cfirst,
+				    "swap_avail", sv << lg_chunk);
+			}
+			write_cb(cbopaque, "}");
+		}
+
+		{
+			bool hfirst = true;
+
+			stats_json_key(write_cb, cbopaque, &ofirst, "huge");
+			write_cb(cbopaque, "{");
+			CTL_GET("stats.huge.nmalloc", &u64v, uint64_t);
+			stats_json_uint(write_cb, cbopaque, &hfirst, "nmalloc",
+			    u64v);
+			CTL_GET("stats.huge.ndalloc", &u64v, uint64_t);
+			stats_json_uint(write_cb, cbopaque, &hfirst, "ndalloc",
+			    u64v);
+			CTL_GET("stats.huge.allocated", &sv, size_t);
+			stats_json_uint(write_cb, cbopaque, &hfirst,
+			    "allocated", sv);
+			write_cb(cbopaque, "}");
+		}
+
+		CTL_GET("arenas.narenas", &narenas, unsigned);
+		if (merged || unmerged) {
+			bool initialized[narenas];
+			bool afirst = true;
+			size_t isz;
+
+			isz = sizeof(initialized);
+			xmallctl("arenas.initialized", initialized, &isz, NULL,
+			    0);
+
+			/*
+			 * Arenas are keyed by their index, the merged stats
+			 * by "merged", whatever the number of arenas.
+			 */
+			stats_json_key(write_cb, cbopaque, &ofirst, "arenas");
+			write_cb(cbopaque, "{");
+			if (merged) {
+				stats_json_key(write_cb, cbopaque, &afirst,
+				    "merged");
+				stats_arena_json(write_cb, cbopaque, narenas,
+				    bins, large);
+			}
+			for (i = 0; unmerged && i < narenas; i++) {
+				if (initialized[i] == false)
+					continue;
+				stats_json_key(write_cb, cbopaque, &afirst,
+				    u2s(i, 10, s));
+				stats_arena_json(write_cb, cbopaque, i, bins,
+				    large);
+			}
+			write_cb(cbopaque, "}");
+		}
+		write_cb(cbopaque, "}");
+	}
+#endif /* #ifdef JEMALLOC_STATS */
+	write_cb(cbopaque, "}}\n");
+}
+
 void
 stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
     const char *opts)
@@ -384,6 +954,7 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 	bool unmerged = true;
 	bool bins = true;
 	bool large = true;
+	bool json = false;
 
 	/*
 	 * Refresh stats, in case mallctl() was called by the application.
@@ -437,11 +1008,20 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 				case 'l':
 					large = false;
 					break;
+				case 'J':
+					json = true;
+					break;
 				default:;
 			}
 		}
 	}
 
+	if (json) {
+		stats_print_json(write_cb, cbopaque, general, merged, unmerged,
+		    bins, large);
+		return;
+	}
+
 	write_cb(cbopaque, "___ Begin jemalloc statistics ___\n");
 	if (general) {
 		int err;
@@ -505,8 +1085,12 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 		OPT_WRITE_SIZE_T(lg_cspace_max)
 		OPT_WRITE_SIZE_T(lg_chunk)
 		OPT_WRITE_SIZE_T(narenas)
+		OPT_WRITE_SIZE_T(chunk_cache_max)
 		OPT_WRITE_SSIZE_T(lg_dirty_mult)
 		OPT_WRITE_BOOL(stats_print)
+		OPT_WRITE_BOOL(percpu_arena)
+		OPT_WRITE_BOOL(background_thread)
+		OPT_WRITE_SSIZE_T(dirty_decay_ms)
 		OPT_WRITE_BOOL(junk)
 		OPT_WRITE_BOOL(zero)
 		OPT_WRITE_BOOL(sysv)
@@ -514,6 +1098,7 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 		OPT_WRITE_BOOL(tcache)
 		OPT_WRITE_SSIZE_T(lg_tcache_gc_sweep)
 		OPT_WRITE_SSIZE_T(lg_tcache_max)
+		OPT_WRITE_BOOL(tcache_adaptive)
 		OPT_WRITE_BOOL(prof)
 		OPT_WRITE_CHAR_P(prof_prefix)
 		OPT_WRITE_SIZE_T(lg_prof_bt_max)
@@ -664,6 +1249,42 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 		write_cb(cbopaque, " (2^");
 		write_cb(cbopaque, u2s(sv, 10, s));
 		write_cb(cbopaque, ")\n");
+		CTL_GET("arenas.chunk_cache_max", &sv, size_t);
+		write_cb(cbopaque, "Maximum cached chunks: ");
+		write_cb(cbopaque, u2s(sv, 10, s));
+		write_cb(cbopaque, "\n");
+		if ((err = JEMALLOC_P(mallctl)("background_thread", &bv, &bsz,
+		    NULL, 0)) == 0) {
+			uint64_t u64v;
+
+			write_cb(cbopaque, "Background thread: ");
+			write_cb(cbopaque, bv ? "running" : "stopped");
+			CTL_GET("arenas.dirty_decay_ms", &ssv, ssize_t);
+			write_cb(cbopaque, ", dirty page decay: ");
+			if (ssv >= 0) {
+				write_cb(cbopaque, u2s(ssv, 10, s));
+				write_cb(cbopaque, " ms\n");
+			} else
+				write_cb(cbopaque, "N/A\n");
+
+			CTL_GET("stats.background_thread.nruns", &u64v,
+			    uint64_t);
+			write_cb(cbopaque, "  runs: ");
+			write_cb(cbopaque, u2s(u64v, 10, s));
+			CTL_GET("stats.background_thread.npurged", &u64v,
+			    uint64_t);
+			write_cb(cbopaque, ", purged pages: ");
+			write_cb(cbopaque, u2s(u64v, 10, s));
+			CTL_GET("stats.background_thread.purge_ns", &u64v,
+			    uint64_t);
+			write_cb(cbopaque, ", purge time: ");
+			write_cb(cbopaque, u2s(u64v, 10, s));
+			CTL_GET("stats.background_thread.purge_ns_max", &u64v,
+			    uint64_t);
+			write_cb(cbopaque, " ns (max ");
+			write_cb(cbopaque, u2s(u64v, 10, s));
+			write_cb(cbopaque, " ns)\n");
+		}
 	}
 
 #ifdef JEMALLOC_STATS
@@ -673,6 +1294,8 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 		size_t allocated, active, mapped;
 		size_t chunks_current, chunks_high, swap_avail;
 		uint64_t chunks_total;
+		size_t chunks_cached;
+		uint64_t chunks_cache_nhits, chunks_cache_nmisses;
 		size_t huge_allocated;
 		uint64_t huge_nmalloc, huge_ndalloc;
 
@@ -707,6 +1330,16 @@ stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 			    "  %13"PRIu64"%13zu%13zu\n",
 			    chunks_total, chunks_high, chunks_current);
 		}
+		CTL_GET("stats.chunks.cache.current", &chunks_cached, size_t);
+		CTL_GET("stats.chunks.cache.nhits", &chunks_cache_nhits,
+		    uint64_t);
+		CTL_GET("stats.chunks.cache.nmisses", &chunks_cache_nmisses,
+		    uint64_t);
+		malloc_cprintf(write_cb, cbopaque,
+		    "chunk cache: cached        nhits      nmisses\n");
+		malloc_cprintf(write_cb, cbopaque,
+		    "  %17zu%13"PRIu64"%13"PRIu64"\n",
+		    chunks_cached, chunks_cache_nhits, chunks_cache_nmisses);
 
 		/* Print huge stats. */
 		CTL_GET("stats.huge.nmalloc", &huge_nmalloc, uint64_t);
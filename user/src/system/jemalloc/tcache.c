@@ -5,6 +5,7 @@
 /* Data. */
 
 bool	opt_tcache = true;
+bool	opt_tcache_adaptive = true;
 ssize_t	opt_lg_tcache_max = LG_TCACHE_MAXCLASS_DEFAULT;
 ssize_t	opt_lg_tcache_gc_sweep = LG_TCACHE_GC_SWEEP_DEFAULT;
 
@@ -35,6 +36,7 @@ tcache_alloc_small_hard(tcache_t *tcache, tcache_bin_t *tbin, size_t binind)
 {
 	void *ret;
 
+	tbin->nfills++;
 	arena_tcache_fill_small(tcache->arena, tbin, binind
 #ifdef JEMALLOC_PROF
 	    , tcache->prof_accumbytes
@@ -63,6 +65,7 @@ tcache_bin_flush_small(tcache_bin_t *tbin, size_t binind, unsigned rem
 	assert(rem <= tbin->ncached);
 	assert(tbin->ncached > 0 || tbin->avail == NULL);
 
+	tbin->nflushes++;
 	for (flush = tbin->avail, nflush = tbin->ncached - rem, first_pass =
 	    true; flush != NULL; flush = deferred, nflush = ndeferred) {
 		/* Lock the arena bin associated with the first object. */
@@ -197,6 +200,47 @@ tcache_bin_flush_large(tcache_bin_t *tbin, size_t binind, unsigned rem
 		tbin->low_water = tbin->ncached;
 }
 
+/*
+ * Resize a small bin according to how it was used since the last GC visit.
+ * A hot bin first gets its fill count raised to half of its slots, and then
+ * more slots, so that its thread takes the bin lock less often.  A cold bin
+ * gives slots back first, and then fills fewer objects at a time.
+ */
+void
+tcache_bin_adapt(tcache_bin_t *tbin, size_t binind
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+    , tcache_t *tcache
+#endif
+    )
+{
+
+	assert(binind < nbins);
+
+	if (tbin->low_water > 0) {
+		if (tbin->ncached_max > tbin->nslots_init) {
+			tbin->ncached_max >>= 1;
+			if (tbin->ncached > tbin->ncached_max) {
+				tcache_bin_flush_small(tbin, binind,
+				    (tbin->ncached_max >> 1)
+#if (defined(JEMALLOC_STATS) || defined(JEMALLOC_PROF))
+				    , tcache
+#endif
+				    );
+			}
+		} else if ((tbin->ncached_max >> (tbin->lg_fill_div + 1)) > 0)
+			tbin->lg_fill_div++;
+	} else if (tbin->nfills + tbin->nflushes >= TCACHE_NEVENTS_HOT) {
+		if (tbin->lg_fill_div > 1)
+			tbin->lg_fill_div--;
+		else if (tbin->ncached_max < (tbin->nslots_init <<
+		    LG_TCACHE_NSLOTS_GROW_MAX))
+			tbin->ncached_max <<= 1;
+	}
+
+	tbin->nfills = 0;
+	tbin->nflushes = 0;
+}
+
 tcache_t *
 tcache_create(arena_t *arena)
 {
@@ -242,6 +286,10 @@ tcache_create(arena_t *arena)
 	}
 	for (; i < nhbins; i++)
 		tcache->tbins[i].ncached_max = TCACHE_NSLOTS_LARGE;
+	for (i = 0; i < nhbins; i++) {
+		tcache->tbins[i].nslots_init = tcache->tbins[i].ncached_max;
+		tcache->tbins[i].lg_fill_div = 1;
+	}
 
 	TCACHE_SET(tcache);
 
@@ -326,6 +374,40 @@ tcache_destroy(tcache_t *tcache)
 		idalloc(tcache);
 }
 
+#ifdef JEMALLOC_PERCPU_ARENA
+/*
+ * Move a tcache to another arena.  Cached objects need not move with it: a
+ * flush returns each object to the arena that owns its chunk, and only fills
+ * use tcache->arena.
+ */
+void
+tcache_arena_reassociate(tcache_t *tcache, arena_t *arena)
+{
+
+#ifdef JEMALLOC_STATS
+	/* Move from the old arena's list of extant tcaches to the new one's. */
+	malloc_mutex_lock(&tcache->arena->lock);
+	ql_remove(&tcache->arena->tcache_ql, tcache, link);
+	tcache_stats_merge(tcache, tcache->arena);
+	malloc_mutex_unlock(&tcache->arena->lock);
+	malloc_mutex_lock(&arena->lock);
+	ql_elm_new(tcache, link);
+	ql_tail_insert(&arena->tcache_ql, tcache, link);
+	malloc_mutex_unlock(&arena->lock);
+#endif
+#ifdef JEMALLOC_PROF
+	if (tcache->prof_accumbytes > 0) {
+		malloc_mutex_lock(&tcache->arena->lock);
+		arena_prof_accum(tcache->arena, tcache->prof_accumbytes);
+		malloc_mutex_unlock(&tcache->arena->lock);
+		tcache->prof_accumbytes = 0;
+	}
+#endif
+
+	tcache->arena = arena;
+}
+#endif
+
 static void
 tcache_thread_cleanup(void *arg)
 {
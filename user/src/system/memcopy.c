@@ -0,0 +1,354 @@
+/**
+ * @file	memcopy.c
+ * @author	Sunil Beta <betasam@gmail.com>
+ * @date	2010-2012
+ * @brief	block copy engine for mem_copy() and mem_move()
+ * @details
+ * Copies align the destination first and then move the widest
+ * unit the processor offers: 8 byte words everywhere, 16 byte
+ * SSE2 and 32 byte AVX2 vectors on x86. The vector width is
+ * picked once at runtime from cpuid, so a library built for a
+ * plain x86-64 still uses AVX2 where it is available.
+ *
+ * Forward copies load a unit before they store it, which makes
+ * them safe for overlapping blocks whose destination is below
+ * the source; mem_move() copies backwards for the other case.
+ *
+ * @warning	relies on gcc vector intrinsics and target attributes.
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_SYS_MEMORY
+
+/* @remark bkit Includes */
+#include <btypes.h>
+#include <bmutex.h>
+
+#include <memory.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define BKIT_MEM_COPY_SSE2
+#include <emmintrin.h>
+#if (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+#define BKIT_MEM_COPY_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/** @remark blocks below this are copied without vectors */
+#define BKIT_MEM_COPY_SMALL	64
+
+/** @remark a machine word that may sit at any address */
+typedef t_longword __attribute__((__may_alias__, __aligned__(1))) t_memory_uword;
+
+typedef t_void (*t_memory_copy_fn)( t_u8 *dest, const t_u8 *src, t_size u_bytes );
+
+/**
+ * @fn _bk_mem_copy_words( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief forward copy, destination aligned to a word
+ */
+static void _bk_mem_copy_words( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  while( (u_bytes > 0) && (0 != ((unsigned long)dest & (sizeof(t_longword) - 1))) )
+    {
+      *dest++ = *src++;
+      u_bytes--;
+    }
+
+  while( u_bytes >= sizeof(t_longword) )
+    {
+      *((t_longword*) dest) = *((const t_memory_uword*) src);
+      dest    += sizeof(t_longword);
+      src     += sizeof(t_longword);
+      u_bytes -= sizeof(t_longword);
+    }
+
+  while( u_bytes-- > 0 )
+    {
+      *dest++ = *src++;
+    }
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_move_words( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief backward copy, for destinations above an overlapping source
+ */
+static void _bk_mem_move_words( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  dest += u_bytes;
+  src  += u_bytes;
+
+  while( (u_bytes > 0) && (0 != ((unsigned long)dest & (sizeof(t_longword) - 1))) )
+    {
+      *--dest = *--src;
+      u_bytes--;
+    }
+
+  while( u_bytes >= sizeof(t_longword) )
+    {
+      dest    -= sizeof(t_longword);
+      src     -= sizeof(t_longword);
+      u_bytes -= sizeof(t_longword);
+      *((t_longword*) dest) = *((const t_memory_uword*) src);
+    }
+
+  while( u_bytes-- > 0 )
+    {
+      *--dest = *--src;
+    }
+
+  return;
+}
+
+#if defined(BKIT_MEM_COPY_SSE2)
+/**
+ * @fn _bk_mem_copy_sse2( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief forward copy, 64 bytes per round in 16 byte vectors
+ */
+static void _bk_mem_copy_sse2( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  __m128i v0, v1, v2, v3;
+  t_size u_head;
+
+  u_head = (16 - ((unsigned long)dest & 15)) & 15;
+  if( u_head > 0 )
+    {
+      _bk_mem_copy_words( dest, src, u_head );
+      dest    += u_head;
+      src     += u_head;
+      u_bytes -= u_head;
+    }
+
+  while( u_bytes >= 64 )
+    {
+      v0 = _mm_loadu_si128( (const __m128i*)(src +  0) );
+      v1 = _mm_loadu_si128( (const __m128i*)(src + 16) );
+      v2 = _mm_loadu_si128( (const __m128i*)(src + 32) );
+      v3 = _mm_loadu_si128( (const __m128i*)(src + 48) );
+      _mm_store_si128( (__m128i*)(dest +  0), v0 );
+      _mm_store_si128( (__m128i*)(dest + 16), v1 );
+      _mm_store_si128( (__m128i*)(dest + 32), v2 );
+      _mm_store_si128( (__m128i*)(dest + 48), v3 );
+      dest    += 64;
+      src     += 64;
+      u_bytes -= 64;
+    }
+
+  while( u_bytes >= 16 )
+    {
+      _mm_store_si128( (__m128i*) dest, _mm_loadu_si128( (const __m128i*) src ) );
+      dest    += 16;
+      src     += 16;
+      u_bytes -= 16;
+    }
+
+  _bk_mem_copy_words( dest, src, u_bytes );
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_move_sse2( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief backward copy in 16 byte vectors
+ */
+static void _bk_mem_move_sse2( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  t_size u_tail;
+
+  u_tail = (unsigned long)(dest + u_bytes) & 15;
+  if( u_tail > 0 )
+    {
+      u_bytes -= u_tail;
+      _bk_mem_move_words( dest + u_bytes, src + u_bytes, u_tail );
+    }
+
+  while( u_bytes >= 16 )
+    {
+      u_bytes -= 16;
+      _mm_store_si128( (__m128i*)(dest + u_bytes),
+		       _mm_loadu_si128( (const __m128i*)(src + u_bytes) ) );
+    }
+
+  _bk_mem_move_words( dest, src, u_bytes );
+
+  return;
+}
+#endif	/* BKIT_MEM_COPY_SSE2 */
+
+#if defined(BKIT_MEM_COPY_AVX2)
+/**
+ * @fn _bk_mem_copy_avx2( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief forward copy, 128 bytes per round in 32 byte vectors
+ */
+__attribute__((target("avx2")))
+static void _bk_mem_copy_avx2( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  __m256i v0, v1, v2, v3;
+  t_size u_head;
+
+  u_head = (32 - ((unsigned long)dest & 31)) & 31;
+  if( u_head > 0 )
+    {
+      _bk_mem_copy_words( dest, src, u_head );
+      dest    += u_head;
+      src     += u_head;
+      u_bytes -= u_head;
+    }
+
+  while( u_bytes >= 128 )
+    {
+      v0 = _mm256_loadu_si256( (const __m256i*)(src +  0) );
+      v1 = _mm256_loadu_si256( (const __m256i*)(src + 32) );
+      v2 = _mm256_loadu_si256( (const __m256i*)(src + 64) );
+      v3 = _mm256_loadu_si256( (const __m256i*)(src + 96) );
+      _mm256_store_si256( (__m256i*)(dest +  0), v0 );
+      _mm256_store_si256( (__m256i*)(dest + 32), v1 );
+      _mm256_store_si256( (__m256i*)(dest + 64), v2 );
+      _mm256_store_si256( (__m256i*)(dest + 96), v3 );
+      dest    += 128;
+      src     += 128;
+      u_bytes -= 128;
+    }
+
+  while( u_bytes >= 32 )
+    {
+      _mm256_store_si256( (__m256i*) dest, _mm256_loadu_si256( (const __m256i*) src ) );
+      dest    += 32;
+      src     += 32;
+      u_bytes -= 32;
+    }
+
+  _mm256_zeroupper();
+  _bk_mem_copy_words( dest, src, u_bytes );
+
+  return;
+}
+#endif	/* BKIT_MEM_COPY_AVX2 */
+
+static void _bk_mem_copy_pick( t_u8 *dest, const t_u8 *src, t_size u_bytes );
+static void _bk_mem_move_pick( t_u8 *dest, const t_u8 *src, t_size u_bytes );
+
+/* @remark engines in use, resolved on the first large copy */
+static t_memory_copy_fn mem_copy_fwd = &_bk_mem_copy_pick;
+static t_memory_copy_fn mem_copy_bwd = &_bk_mem_move_pick;
+
+/**
+ * @fn _bk_mem_copy_select( void )
+ * @brief choose the widest engines the processor supports
+ * @remark racing callers pick the same engines, no lock needed.
+ */
+static void _bk_mem_copy_select( void )
+{
+  t_memory_copy_fn fwd = &_bk_mem_copy_words;
+  t_memory_copy_fn bwd = &_bk_mem_move_words;
+
+#if defined(BKIT_MEM_COPY_SSE2)
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "sse2" ) )
+    {
+      fwd = &_bk_mem_copy_sse2;
+      bwd = &_bk_mem_move_sse2;
+    }
+#if defined(BKIT_MEM_COPY_AVX2)
+  if( __builtin_cpu_supports( "avx2" ) )
+    {
+      fwd = &_bk_mem_copy_avx2;
+    }
+#endif
+#endif	/* BKIT_MEM_COPY_SSE2 */
+
+  mem_copy_fwd = fwd;
+  mem_copy_bwd = bwd;
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_copy_pick( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief first forward copy, selects the engines and copies
+ */
+static void _bk_mem_copy_pick( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  _bk_mem_copy_select();
+  mem_copy_fwd( dest, src, u_bytes );
+  return;
+}
+
+/**
+ * @fn _bk_mem_move_pick( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+ * @brief first backward copy, selects the engines and copies
+ */
+static void _bk_mem_move_pick( t_u8 *dest, const t_u8 *src, t_size u_bytes )
+{
+  _bk_mem_copy_select();
+  mem_copy_bwd( dest, src, u_bytes );
+  return;
+}
+
+/**
+ * @fn t_size mem_copy( t_ptr dest_ptr, t_ptr src_ptr, t_size u_bytes_to_copy )
+ * @brief copies source to destination
+ * @details
+ * Small blocks, such as the structures _OPS_ASSIGN_SZ() moves,
+ * are copied a word at a time in place; larger ones go to the
+ * widest engine available. Blocks must not overlap unless the
+ * destination is below the source, use mem_move() otherwise.
+ *
+ * @return bytes copied
+ */
+t_size mem_copy( t_ptr dest_ptr, t_ptr src_ptr, t_size u_bytes_to_copy )
+{
+  if( (0 == dest_ptr) || (0 == src_ptr) )
+    {
+      return( 0 );
+    }
+
+  if( u_bytes_to_copy < BKIT_MEM_COPY_SMALL )
+    {
+      _bk_mem_copy_words( (t_u8*) dest_ptr, (const t_u8*) src_ptr, u_bytes_to_copy );
+    }
+  else
+    {
+      mem_copy_fwd( (t_u8*) dest_ptr, (const t_u8*) src_ptr, u_bytes_to_copy );
+    }
+
+  return( u_bytes_to_copy );
+}
+
+/**
+ * @fn t_size mem_move( t_ptr dest_ptr, t_ptr src_ptr, t_size u_bytes_to_move )
+ * @brief copies source to destination, blocks may overlap
+ * @return bytes copied
+ */
+t_size mem_move( t_ptr dest_ptr, t_ptr src_ptr, t_size u_bytes_to_move )
+{
+  t_u8 *dest = (t_u8*) dest_ptr;
+  const t_u8 *src = (const t_u8*) src_ptr;
+
+  if( (0 == dest_ptr) || (0 == src_ptr) )
+    {
+      return( 0 );
+    }
+
+  if( (dest <= src) || (dest >= (src + u_bytes_to_move)) )
+    {
+      return( mem_copy( dest_ptr, src_ptr, u_bytes_to_move ) );
+    }
+
+  if( u_bytes_to_move < BKIT_MEM_COPY_SMALL )
+    {
+      _bk_mem_move_words( dest, src, u_bytes_to_move );
+    }
+  else
+    {
+      mem_copy_bwd( dest, src, u_bytes_to_move );
+    }
+
+  return( u_bytes_to_move );
+}
+
+#endif	/* CONFIG_BK_SYS_MEMORY */
+/* @remark end of file "memcopy.c" */
@@ -18,50 +18,135 @@
 
 /* @remark Standard Includes : required for malloc() */
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+#include <pthread.h>
+#endif
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+#include <sched.h>
+#endif
+
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+#include <time.h>
+#endif
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+#include <sys/mman.h>
+#endif
+
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#endif
+
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+#endif
+
+#if defined(BKIT_DEBUG_MODE)
+#include <stdio.h>
+#endif
+
 /* @remark bkit Includes */
 #include <ops.h>
 #include <btypes.h>
+#include <bmutex.h>
 
 #include <memory.h>
 
-static t_ptr ptr_track[ MEMORY_TRACKER_SIZE ];
-static t_u32 ptr_sizes[ MEMORY_TRACKER_SIZE ];
+/**
+ * @remark allocation tracker
+ * open addressed hash table keyed by pointer, linear probing with
+ * backward shift deletion, so mem_free() never walks the table.
+ * slots are allocated from stdlib and not through the callbacks
+ * as the tracker must survive mem_changecalls(). a block made
+ * inside an allocation scope names the scope and its index in
+ * the block list of the scope.
+ */
+struct s_memory_track {
+  t_ptr ptr;
+  t_size size;
+  t_u32 flags;
+  t_u32 scope_idx;
+  t_mem_scope *scope;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  t_size map_length;		/* @remark length of the mapping, 0 if none */
+#endif
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+  t_u32 trace_id;		/* @remark block number in the trace, 0 if none */
+#endif
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+  t_u32 prof_site;		/* @remark profiler epoch and site + 1, 0 if none */
+#endif
+};
+
+/* @remark tracker flags */
+#define BKIT_MEM_TRACK_MMAP	0x01	/* block is an anonymous mapping */
+#define BKIT_MEM_TRACK_HUGE	0x02	/* mapping uses MAP_HUGETLB */
+#define BKIT_MEM_TRACK_SIZED	0x04	/* backend was asked for exactly size */
+
+typedef struct s_memory_track t_memory_track;
 
-static t_u32 memory_tracker_loc = ZERO;
+static t_memory_track *ptr_track = NULL;
+static t_u32 ptr_track_slots = ZERO;
 
 static t_memory_calls mc;
 static t_bool mem_init_state = ZERO;
-static t_u32 total_memory_allocated = ZERO;
-static t_bool mem_ctl_lock = false;
+static t_u64 total_memory_allocated = ZERO;
+static t_bmutex mem_ctl_lock BK_CACHELINE_ALIGNED = BK_MUTEX_INITIALIZER;
+
+/* @remark innermost allocation scope of each thread */
+static __thread t_mem_scope *mem_scope_cur = NULL;
 
 /**
  * @fn     _bk_mem_lock()
  * @brief  statement to lock internal memory manager
- * @remark binary semaphore
+ * @remark adaptive mutex, see bmutex.c
  */
 void _bk_mem_lock(void)
 {
-  while( true == mem_ctl_lock )
-    {
-      usleep( BKIT_MEM_SLEEP_USECS );
-    }
-  mem_ctl_lock = true;
+  bk_mutex_lock( &mem_ctl_lock );
   return;
 }
 
 /**
  * @fn	  _bk_mem_unlock()
  * @brief statement to unlock internal memory manager
- * @remark binary semaphore
+ * @remark adaptive mutex, see bmutex.c
  */
 void _bk_mem_unlock(void)
 {
-  mem_ctl_lock = false;
+  bk_mutex_unlock( &mem_ctl_lock );
   return;
 }
 
+/**
+ * @fn _bk_mem_memalign( t_size alignment, t_size ubytes )
+ * @brief aligned allocation callback on top of stdlib
+ * @return block on success, NULL on failure
+ */
+static t_ptr _bk_mem_memalign( t_size alignment, t_size ubytes )
+{
+  t_ptr ptr_mem = NULL;
+
+  if( 0 != posix_memalign( &ptr_mem, alignment, ubytes ) )
+    {
+      return( NULL );
+    }
+
+  return( ptr_mem );
+}
+
 /**
  * @fn void mem_init( t_memory_calls *imc )
  * @brief initialises all needed memory callbacks
@@ -78,10 +163,33 @@ void mem_init( t_memory_calls *imc )
   imc->calloc  = &calloc;
   imc->realloc = &realloc;
   imc->free    = &free;
+  imc->expand  = NULL;		/* @remark libc grows in place itself */
+  imc->alloc_batch = NULL;
+  imc->free_sized = NULL;
+  imc->stats = NULL;
+  imc->memalign = &_bk_mem_memalign;
 
   /* initiate state, usage counters */
   imc->alloc_used = 0;
   mem_init_state  = 1;
+
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+  {
+    static t_bool trace_env_seen = ZERO;
+    const char *path;
+
+    /* @remark record from startup when the environment asks for it */
+    if( ZERO == trace_env_seen )
+      {
+	trace_env_seen = 1;
+	path = getenv( BKIT_MEM_TRACE_ENV );
+	if( (NULL != path) && (0 == mem_trace_start( path )) )
+	  {
+	    atexit( mem_trace_stop );
+	  }
+      }
+  }
+#endif
 }
 
 
@@ -111,337 +219,3622 @@ inline void _bk_mem_disable( )
   return;
 }
 
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
 /**
- * @fn t_ptr mem_alloc( t_u32 ui_bytes )
- * @param ui_bytes number of bytes to allocate.
- * @brief allocates memory like malloc.
- * @details
- * This function is to mimic malloc but has the 
- * capability to use a different callback for
- * allocating memory.
- *
- * @return pointer to allocated memory heap
- *	   or NULL on failure.
+ * @remark memory budget
+ * mem_limit_used counts tracked blocks at their requested size,
+ * slabs of the thread caches and the slabs and chunks pools and
+ * arenas take from the callbacks. the first request that would
+ * take it past the soft limit runs the reclaim callbacks once;
+ * they run again only after use has dropped back under the soft
+ * limit, or when a request would pass the hard limit, which is
+ * refused if reclaim did not make room for it.
+ */
+struct s_memory_reclaim {
+  t_mem_reclaim_fn fn;
+  t_ptr arg;
+};
+
+typedef struct s_memory_reclaim t_memory_reclaim;
+
+#define BKIT_MEM_LIMIT_UNDER	0	/* use at or below the soft limit */
+#define BKIT_MEM_LIMIT_PENDING	1	/* over the soft limit, not reclaimed */
+#define BKIT_MEM_LIMIT_RECLAIMED 2	/* over the soft limit, reclaimed */
+
+static t_size mem_limit_soft  = ZERO;
+static t_size mem_limit_hard  = ZERO;
+static t_size mem_limit_used  = ZERO;
+static t_u32  mem_limit_state = BKIT_MEM_LIMIT_UNDER;
+
+static t_memory_reclaim mem_reclaim_list[ BKIT_MEM_RECLAIM_MAX ];
+static t_u32 mem_reclaim_count = ZERO;
+static volatile t_u32 mem_reclaim_active = ZERO;
+
+/* @remark set while this thread runs the callbacks */
+static __thread t_bool mem_reclaim_busy = ZERO;
+
+/**
+ * @fn _bk_mem_limit_exceeds( t_size ui_limit, t_size ui_bytes )
+ * @brief find out if ui_bytes more would pass a limit
+ * @remark caller must hold the memory lock, 0 is no limit
  */
-t_ptr mem_alloc( t_u32 ui_bytes )
+static inline t_bool _bk_mem_limit_exceeds( t_size ui_limit, t_size ui_bytes )
 {
-  if( ZERO == mem_init_state )
+  if( ZERO == ui_limit )
     {
-      mem_init( &mc );
+      return( false );
     }
 
-  _bk_mem_lock();
-  ptr_track[ memory_tracker_loc ] = mc.malloc( (size_t) ui_bytes );
-  if( (t_ptr)0 == ptr_track[ memory_tracker_loc ] )
+  return( ((ui_bytes > ui_limit) || (mem_limit_used > ui_limit - ui_bytes)) ? true : false );
+}
+
+/**
+ * @fn _bk_mem_limit_add( t_size ui_bytes )
+ * @brief count bytes taken against the budget
+ * @remark caller must hold the memory lock
+ */
+static inline void _bk_mem_limit_add( t_size ui_bytes )
+{
+  mem_limit_used += ui_bytes;
+  if( (BKIT_MEM_LIMIT_UNDER == mem_limit_state) && (ZERO != mem_limit_soft) &&
+      (mem_limit_used > mem_limit_soft) )
     {
-      _bk_mem_unlock();
-      return((t_ptr)0);
+      mem_limit_state = BKIT_MEM_LIMIT_PENDING;
     }
-  ptr_sizes[ memory_tracker_loc ] = ui_bytes;
-  mc.alloc_used++;
-  memory_tracker_loc++;
-  if( memory_tracker_loc >= MEMORY_TRACKER_SIZE ) /* @remark wrap-around */
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_limit_sub( t_size ui_bytes )
+ * @brief count bytes given back to the budget
+ * @remark caller must hold the memory lock
+ */
+static inline void _bk_mem_limit_sub( t_size ui_bytes )
+{
+  mem_limit_used -= (ui_bytes < mem_limit_used) ? ui_bytes : mem_limit_used;
+  if( mem_limit_used <= mem_limit_soft )
     {
-      memory_tracker_loc = 0;
-      total_memory_allocated += ui_bytes;
-      _bk_mem_unlock();
-      return( ptr_track[ MEMORY_TRACKER_SIZE - 1 ] );
+      mem_limit_state = BKIT_MEM_LIMIT_UNDER;
     }
-  total_memory_allocated += ui_bytes;
-  _bk_mem_unlock();
 
-  return( ptr_track[ memory_tracker_loc-1 ] );  
+  return;
 }
 
 /**
- * @fn t_ptr mem_clearalloc( t_u32 ui_bytes )
- * @param ui_bytes number of bytes to allocate.
- * @brief same functionality as calloc.
+ * @fn _bk_mem_limit_take( t_size ui_bytes )
+ * @brief count bytes against the budget if the hard limit allows
+ * @remark caller must hold the memory lock
+ * @return 0 on success, -1 if the bytes would pass the hard limit
+ */
+static inline t_s32 _bk_mem_limit_take( t_size ui_bytes )
+{
+  if( true == _bk_mem_limit_exceeds( mem_limit_hard, ui_bytes ) )
+    {
+      return( -1 );
+    }
+  _bk_mem_limit_add( ui_bytes );
+
+  return( 0 );
+}
+
+/**
+ * @fn _bk_mem_limit_admit( t_size ui_bytes )
+ * @brief check a request against the budget before it is made
  * @details
- * This function does exactly the same as calloc
- * except that the callback can be changed and
- * all allocations upto [MEMORY_TRACKER_SIZE] 
- * are tracked for automatic memory free-up.
+ * Runs the reclaim callbacks when the request is the first to go
+ * over the soft limit, or when it would go over the hard limit.
+ * The bytes are not taken here; requests racing on other threads
+ * may pass the hard limit by what they ask for between them.
  *
- * @return pointer to cleared and allocated
- *	   memory heap or NULL on failure.
+ * @remark caller must not hold the memory lock
+ * @return 0 if the request may go ahead, -1 if it is refused
  */
-t_ptr mem_clearalloc( t_u32 ui_bytes )
+static t_s32 _bk_mem_limit_admit( t_size ui_bytes )
 {
+  t_size u_wanted = ZERO;
+  t_bool b_hard;
 
-  if( 0 == mem_init_state )
+  if( (ZERO == mem_limit_soft) && (ZERO == mem_limit_hard) )
     {
-      mem_init( &mc );
+      return( 0 );
     }
-  
+
   _bk_mem_lock();
-  ptr_track[ memory_tracker_loc ] = mc.calloc( sizeof(t_u8), (size_t) ui_bytes );
-  if( NULL == ptr_track[ memory_tracker_loc ] )
+  b_hard = _bk_mem_limit_exceeds( mem_limit_hard, ui_bytes );
+  if( true == b_hard )
     {
-      _bk_mem_unlock();
-      return(NULL);
+      u_wanted = mem_limit_used + ui_bytes - mem_limit_hard;
     }
-  ptr_sizes[ memory_tracker_loc ] = ui_bytes;
-  mc.alloc_used++;
-  memory_tracker_loc++;
-  if( memory_tracker_loc >= MEMORY_TRACKER_SIZE ) /* @remark wrap-around */
+  if( (true == _bk_mem_limit_exceeds( mem_limit_soft, ui_bytes )) &&
+      (BKIT_MEM_LIMIT_RECLAIMED != mem_limit_state) )
     {
+      u_wanted = mem_limit_used + ui_bytes - mem_limit_soft;
+      mem_limit_state = BKIT_MEM_LIMIT_RECLAIMED;
+    }
+  _bk_mem_unlock();
 
-      memory_tracker_loc = 0;
-      mc.alloc_used = memory_tracker_loc;
+  if( ZERO != u_wanted )
+    {
+      mem_reclaim( u_wanted );
+    }
 
-      total_memory_allocated += ui_bytes;
-      _bk_mem_unlock();
-      return( ptr_track[ MEMORY_TRACKER_SIZE - 1 ] );
+  if( true != b_hard )
+    {
+      return( 0 );
     }
+
+  _bk_mem_lock();
+  b_hard = _bk_mem_limit_exceeds( mem_limit_hard, ui_bytes );
   _bk_mem_unlock();
 
-  return( ptr_track[ memory_tracker_loc-1 ] );  
+  return( (true == b_hard) ? -1 : 0 );
 }
+#else
+#define _bk_mem_limit_add( ui_bytes )
+#define _bk_mem_limit_sub( ui_bytes )
+#define _bk_mem_limit_take( ui_bytes )	0
+#define _bk_mem_limit_admit( ui_bytes )	0
+#endif	/* CONFIG_BK_SYS_MEM_LIMIT */
 
+#if defined(CONFIG_BK_SYS_MEM_STATS)
 /**
- * @fn void mem_free( t_ptr ptr_mem )
- * @param ptr_mem pointer of the location to be freed.
- * @brief same as free(ptr) with callback support 
- * @details
- * This function frees up memory similar to free() except
- * that it cannot free memory if the memory callbacks were
- * changed after allocating memory from a different 
- * algorithm.
- *
- * @return Nothing even on failure.
+ * @remark statistics counters
+ * bytes of tracked blocks and their high water mark, and blocks
+ * handed out since startup. blocks given back are worked out by
+ * mem_stats() from what is still live, so frees count nothing.
  */
-void mem_free( t_ptr ptr_mem )
+static t_size mem_stats_live  = ZERO;
+static t_size mem_stats_peak  = ZERO;
+static t_u64  mem_stats_allocs = ZERO;
+
+/**
+ * @fn _bk_mem_stats_add( t_size ui_bytes )
+ * @brief count bytes of a tracked block
+ * @remark caller must hold the memory lock
+ */
+static inline void _bk_mem_stats_add( t_size ui_bytes )
 {
-  int traverse_loc = 0;
-  unsigned long ul_ptr_one, ul_ptr_two;
+  mem_stats_live += ui_bytes;
+  if( mem_stats_live > mem_stats_peak )
+    {
+      mem_stats_peak = mem_stats_live;
+    }
 
-  if( 0 == mem_init_state )
+  return;
+}
+
+#define _bk_mem_stats_sub( ui_bytes )	(mem_stats_live -= (ui_bytes))
+#define _bk_mem_stats_new( )		(mem_stats_allocs++)
+#else
+#define _bk_mem_stats_add( ui_bytes )
+#define _bk_mem_stats_sub( ui_bytes )
+#define _bk_mem_stats_new( )
+#endif	/* CONFIG_BK_SYS_MEM_STATS */
+
+/**
+ * @fn _bk_mem_track_hash( t_ptr ptr_mem, t_u32 u_mask )
+ * @brief hash a pointer into a tracker slot
+ * @remark fibonacci hashing, low bits dropped as they are
+ *         always zero for aligned allocations.
+ */
+static inline t_u32 _bk_mem_track_hash( t_ptr ptr_mem, t_u32 u_mask )
+{
+  t_u64 u_key = (t_u64)(unsigned long) ptr_mem;
+
+  u_key >>= 4;
+  u_key *= 0x9E3779B97F4A7C15ULL;
+
+  return( (t_u32)(u_key >> 32) & u_mask );
+}
+
+/**
+ * @fn _bk_mem_track_grow( void )
+ * @brief double the tracker, rehashing live entries
+ * @remark caller must hold the memory lock
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 _bk_mem_track_grow( void )
+{
+  t_memory_track *new_track;
+  t_u32 new_slots, u_idx, u_loc;
+
+  new_slots = (ZERO == ptr_track_slots) ? MEMORY_TRACKER_SIZE : (ptr_track_slots << 1);
+  if( new_slots < ptr_track_slots )
     {
-      /* memory not initialised */
-      return;
+      return( -1 );		/* @remark overflow */
     }
 
-  _bk_mem_lock();
-  if( 0 >= mc.alloc_used )
-    {      
-      _bk_mem_unlock();
-      traverse_loc = (int)0xf17eb17d;
-      return;
+  new_track = (t_memory_track*) calloc( new_slots, sizeof(t_memory_track) );
+  if( NULL == new_track )
+    {
+      return( -1 );
     }
 
-  if( 0 == memory_tracker_loc )
+  for( u_idx = 0; u_idx < ptr_track_slots; u_idx++ )
     {
-      mc.alloc_used = 0;
-      ul_ptr_one = (t_ul)ptr_track[ 0 ];
-      if( (t_ul)ptr_mem == ul_ptr_one )
+      if( NULL == ptr_track[ u_idx ].ptr )
 	{
-	  mc.free( (t_ptr)ul_ptr_one );
-	  ptr_track[ 0 ] = (t_ptr)NULL;
+	  continue;
 	}
-      _bk_mem_unlock();
-      return;
+      u_loc = _bk_mem_track_hash( ptr_track[ u_idx ].ptr, new_slots - 1 );
+      while( NULL != new_track[ u_loc ].ptr )
+	{
+	  u_loc = (u_loc + 1) & (new_slots - 1);
+	}
+      new_track[ u_loc ] = ptr_track[ u_idx ];
     }
-  
-  for( traverse_loc = 0; traverse_loc < memory_tracker_loc; traverse_loc++ )
+
+  free( ptr_track );
+  ptr_track = new_track;
+  ptr_track_slots = new_slots;
+
+  return( 0 );
+}
+
+/**
+ * @fn _bk_mem_track_insert( t_ptr ptr_mem, t_size ui_bytes, t_u32 u_flags )
+ * @brief record a new allocation in the tracker
+ * @remark caller must hold the memory lock, keeps load under 3/4
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 _bk_mem_track_insert( t_ptr ptr_mem, t_size ui_bytes, t_u32 u_flags )
+{
+  t_u32 u_loc;
+
+  if( (mc.alloc_used + 1) * 4 >= ptr_track_slots * 3 )
     {
-      if( ptr_track[ traverse_loc ] == ptr_mem )
+      if( 0 > _bk_mem_track_grow() )
 	{
-	  ul_ptr_one = (t_ul) ptr_track[ traverse_loc ];
-	  ul_ptr_two = (t_ul) ptr_track[ memory_tracker_loc - 1 ];
-	  _OPS_SWAP( ul_ptr_one, ul_ptr_two );
-
-	  ptr_track[ traverse_loc ] = (t_ptr)ul_ptr_one;
-	  ptr_track[ memory_tracker_loc - 1 ] = (t_ptr)ul_ptr_two;
-	  if( (0 != ul_ptr_one) && (ul_ptr_one != ul_ptr_two) )
-	    {
-	      ptr_track[ traverse_loc ] = (t_ptr)NULL;
-	      mc.free( ptr_mem );
-	      mc.alloc_used--;
-	      memory_tracker_loc--;	  
-	      ptr_track[ memory_tracker_loc - 1 ] = (t_ptr)0;
-	    }
+	  return( -1 );
 	}
     }
-  _bk_mem_unlock();
 
-  traverse_loc = (int)0xdeadbeef;	/* debug watch */
-  return;
-}
+  u_loc = _bk_mem_track_hash( ptr_mem, ptr_track_slots - 1 );
+  while( NULL != ptr_track[ u_loc ].ptr )
+    {
+      u_loc = (u_loc + 1) & (ptr_track_slots - 1);
+    }
+
+  ptr_track[ u_loc ].ptr   = ptr_mem;
+  ptr_track[ u_loc ].size  = ui_bytes;
+  ptr_track[ u_loc ].flags = u_flags;
+  ptr_track[ u_loc ].scope = NULL;
+  ptr_track[ u_loc ].scope_idx = ZERO;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  ptr_track[ u_loc ].map_length = ZERO;
+#endif
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+  ptr_track[ u_loc ].trace_id = ZERO;
+#endif
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+  ptr_track[ u_loc ].prof_site = ZERO;
+#endif
+  mc.alloc_used++;
+  total_memory_allocated += ui_bytes;
+  _bk_mem_limit_add( ui_bytes );
+  _bk_mem_stats_add( ui_bytes );
 
+  return( 0 );
+}
 
-#if defined(BKIT_DEBUG_MODE)
 /**
- * @fn mem_stat
- * @brief status of memory allocation tracking
- * @remark debug function only, no use otherwise
+ * @fn _bk_mem_track_find( t_ptr ptr_mem )
+ * @brief locate the tracker slot of an allocation
+ * @remark caller must hold the memory lock
+ * @return pointer to the slot or NULL if not tracked
  */
-void mem_stat( void )
+static t_memory_track *_bk_mem_track_find( t_ptr ptr_mem )
 {
-  int tidx = 0;
+  t_u32 u_loc;
 
-  if( 0 == mem_init_state )
+  if( (ZERO == ptr_track_slots) || (NULL == ptr_mem) )
     {
-      printf("%s: caution memory state [ %d ]\n", __FUNCTION__, mem_init_state );
+      return( NULL );
     }
 
-  _bk_mem_lock();
-  for( tidx = 0; tidx < memory_tracker_loc; tidx++ )
-  {
-    printf("%s: [%d] memory pointer [ 0x%08X ]\n", __FUNCTION__, tidx, ptr_track[ tidx ]);
-  }
-  printf("%s: total memory: %u bytes [%d]\n", __FUNCTION__, total_memory_allocated, memory_tracker_loc );
-  _bk_mem_unlock();
+  u_loc = _bk_mem_track_hash( ptr_mem, ptr_track_slots - 1 );
+  while( NULL != ptr_track[ u_loc ].ptr )
+    {
+      if( ptr_mem == ptr_track[ u_loc ].ptr )
+	{
+	  return( &ptr_track[ u_loc ] );
+	}
+      u_loc = (u_loc + 1) & (ptr_track_slots - 1);
+    }
 
-  return;
+  return( NULL );
 }
-#endif	/* BKIT_DEBUG_MODE */
 
+#if defined(CONFIG_BK_SYS_MEM_PROF)
 /**
- * @fn t_ptr mem_realloc( t_ptr ptr_mem, t_u32 ui_bytes )
- * @param ptr_mem pointer to memory whose allocated heapsize is
- *        to be changed.
- * @param ui_bytes new number of bytes to be allocated.
- * @details
- * This function is similar to realloc. It can also use a different
- * callback for reallocation. This is to manage memory allocation
- * better inside an application.
- *
- * @warning does not work if callback was changed after first
- *          allocation.
- *
- * @return Pointer to the re-allocated heap which can be different
- *         if the callback was changed after the first allocation 
- *         on success and NULL on failure.
- *
+ * @remark sampling profiler
+ * each thread counts down the bytes it allocates and samples the
+ * request that takes the count below zero, after which the next
+ * count is drawn from an exponential distribution with a mean of
+ * mem_prof_rate bytes. sampling is then a poisson process over
+ * bytes allocated and a sample of s bytes stands for an expected
+ * s / (1 - exp(-s / rate)) bytes. a sampled block is tracked, its
+ * tracker entry names the call site it was charged to so the live
+ * bytes of the site drop when the block is freed. entries carry
+ * the low bits of the epoch of the profile they were charged to,
+ * blocks sampled before a restart are not counted against the
+ * new one.
+ */
+struct s_memory_prof_site {
+  t_ptr site;
+  t_u64 n_samples;
+  t_u64 n_live;
+  double alloc_bytes;
+  double live_bytes;
+};
+
+typedef struct s_memory_prof_site t_memory_prof_site;
+
+static t_bool mem_prof_on    = ZERO;
+static t_size mem_prof_rate  = BKIT_MEM_PROF_RATE;
+static t_u32  mem_prof_epoch = ZERO;
+static t_u32  mem_prof_used  = ZERO;
+static t_u64  mem_prof_t0    = ZERO;
+static t_u64  mem_prof_t1    = ZERO;
+static t_memory_prof_site mem_prof_sites[ BKIT_MEM_PROF_SITES ];
+
+static __thread t_s64 mem_prof_left    = ZERO;
+static __thread t_u32 mem_prof_pending = ZERO;
+static __thread t_u32 mem_prof_tepoch  = ZERO;
+static __thread t_u64 mem_prof_rng     = ZERO;
+static __thread t_ptr mem_prof_site    = NULL;
+
+/**
+ * @fn _bk_mem_prof_now( void )
+ * @brief monotonic clock in nanoseconds
  */
-t_ptr mem_realloc( t_ptr ptr_mem, t_u32 ui_bytes )
+static inline t_u64 _bk_mem_prof_now( void )
 {
-  if( ZERO == mem_init_state )
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return( (t_u64) ts.tv_sec * 1000000000ULL + (t_u64) ts.tv_nsec );
+}
+
+/**
+ * @fn _bk_mem_prof_interval( void )
+ * @brief bytes until the next sample, exponentially distributed
+ * @remark xorshift64* per thread, good enough for spacing samples
+ */
+static t_s64 _bk_mem_prof_interval( void )
+{
+  double d_unit;
+
+  if( ZERO == mem_prof_rng )
     {
-      mem_init( &mc );
+      mem_prof_rng = ((t_u64)(unsigned long) &mem_prof_rng) ^ _bk_mem_prof_now();
+      mem_prof_rng |= 1;
     }
 
-  return( realloc( ptr_mem, ui_bytes ) );
+  mem_prof_rng ^= mem_prof_rng >> 12;
+  mem_prof_rng ^= mem_prof_rng << 25;
+  mem_prof_rng ^= mem_prof_rng >> 27;
+
+  /* @remark 53 random bits, in (0, 1] */
+  d_unit = (double)(((mem_prof_rng * 0x2545F4914F6CDD1DULL) >> 11) + 1) / 9007199254740992.0;
+
+  return( (t_s64)(-log( d_unit ) * (double) mem_prof_rate) + 1 );
 }
 
 /**
- * @fn void mem_gc( void )
- * @brief frees upto 256 memory allocations that were done
- *        using betakit's memory allocating calls.
+ * @fn _bk_mem_prof_tick( t_size ui_bytes, t_u32 u_blocks, t_ptr site )
+ * @brief count bytes allocated by a thread, arm a sample when due
  * @details
- * This is just to free up to a maximum of 256 memory locations
- * if they were allocated with the same kit. The purpose is
- * trivial and is to take care of memory that was not properly
- * freed. 
- *
- * bug that caused double free has been fixed.
- *
- * @return Nothing
+ * An armed sample makes the next u_blocks or fewer blocks of the
+ * request skip the thread cache; _bk_mem_prof_sample() charges
+ * them to site as they enter the tracker.
  */
-void mem_gc( void )
+static inline void _bk_mem_prof_tick( t_size ui_bytes, t_u32 u_blocks, t_ptr site )
 {
-  register t_u32 traverse_loc = 0;
-  register t_u32 traverse_max = 0;
- 
+  t_u32 u_due = 0;
 
-  if( 0 == mem_init_state )
+  if( ZERO == mem_prof_on )
     {
       return;
     }
 
-  _bk_mem_lock();
-  do {
-
-  traverse_max = memory_tracker_loc;
-  if( MEMORY_TRACKER_SIZE > traverse_max )
+  if( mem_prof_tepoch != mem_prof_epoch )
     {
-      traverse_max = MEMORY_TRACKER_SIZE;
+      mem_prof_tepoch  = mem_prof_epoch;
+      mem_prof_pending = ZERO;
+      mem_prof_left    = _bk_mem_prof_interval();
     }
 
-  if( 0 >= mc.alloc_used )
-    {      
-      _bk_mem_unlock();
-      traverse_loc = (int)0xf17eb17d;
-      return;
+  mem_prof_left -= (t_s64) ui_bytes;
+  while( mem_prof_left <= 0 )
+    {
+      u_due++;
+      mem_prof_left += _bk_mem_prof_interval();
     }
 
-  for( traverse_loc = (traverse_max-1); 
-       (traverse_loc >= 0) && (mc.alloc_used > 0); 
-       traverse_loc-- )
+  if( ZERO != u_due )
     {
-      mc.free( ptr_track[ traverse_loc ] );
-      ptr_track[ traverse_loc ] = (t_ptr)NULL;
-      mc.alloc_used--;
+      mem_prof_pending = (u_due < u_blocks) ? u_due : u_blocks;
+      mem_prof_site    = site;
     }
 
-  memory_tracker_loc = 0;
-  } while(0);
-  _bk_mem_unlock();
-
   return;
 }
 
 /**
- * @fn t_s32 mem_alloc_count( void )
- * @brief returns total memory allocated through mem_* so far.
- * @return memory allocated so far
- * @details
- * This is just to expose an internal variable in the library
- * through a hook. I am not very sure you can access these 
- * symbols although lint has been quite strict in teaching me
- * that they can indeed be accessed unless I throw them "static."
+ * @fn _bk_mem_prof_weight( t_size ui_bytes )
+ * @brief bytes a sample of ui_bytes stands for
  */
-t_s32 mem_alloc_count( void )
+static inline double _bk_mem_prof_weight( t_size ui_bytes )
 {
-  register t_u32 u_count = 0;
-
-  _bk_mem_lock();
-  u_count = mc.alloc_used;
-  _bk_mem_unlock();
+  double d_bytes = (double)(ZERO != ui_bytes ? ui_bytes : 1);
 
-  return( u_count );
+  return( d_bytes / (1.0 - exp( -d_bytes / (double) mem_prof_rate )) );
 }
 
-
 /**
- * @fn t_u32 mem_copy( t_ptr dest_ptr, t_ptr src_ptr, t_u32 bytes_to_copy )
- * @brief copies source to destination treating memory in bytes
- * @detail 
- * This should be optimised to handle variables of register size.
- *
- * @return bytes copied
+ * @fn _bk_mem_prof_find( t_ptr site )
+ * @brief slot of a call site, added if new
+ * @remark caller must hold the memory lock. slot 0 collects the
+ *         sites that no longer fit, the table is kept 3/4 full.
+ * @return slot index
  */
-t_u32 mem_copy( t_ptr dest_ptr, t_ptr src_ptr, t_u32 u_bytes_to_copy )
+static t_u32 _bk_mem_prof_find( t_ptr site )
 {
-  t_u32 u_words_to_copy = 0;
-  t_u32 u_bytes_copied  = 0;
-  t_u32 u_words_copied  = 0;
-  t_u32 u_scratch;
-  
-  if( (0 == dest_ptr) || (0 == src_ptr) )
+  t_u32 u_loc;
+
+  u_loc = _bk_mem_track_hash( site, BKIT_MEM_PROF_SITES - 1 );
+  for( ;; )
+    {
+      if( ZERO == u_loc )
+	{
+	  u_loc = 1;
+	}
+      if( site == mem_prof_sites[ u_loc ].site )
+	{
+	  return( u_loc );
+	}
+      if( NULL == mem_prof_sites[ u_loc ].site )
+	{
+	  break;
+	}
+      u_loc = (u_loc + 1) & (BKIT_MEM_PROF_SITES - 1);
+    }
+
+  if( (mem_prof_used + 1) * 4 >= BKIT_MEM_PROF_SITES * 3 )
     {
-      return( u_bytes_copied );
+      return( 0 );
     }
 
-  u_scratch       = u_bytes_to_copy;
-  u_words_to_copy = u_bytes_to_copy / sizeof(t_word);
+  mem_prof_sites[ u_loc ].site = site;
+  mem_prof_used++;
+
+  return( u_loc );
+}
 
-  u_bytes_to_copy = u_scratch % sizeof( t_word );
+/**
+ * @fn _bk_mem_prof_sample( t_memory_track *track )
+ * @brief charge a new block to the armed call site, if any
+ * @remark caller must hold the memory lock
+ */
+static inline void _bk_mem_prof_sample( t_memory_track *track )
+{
+  t_memory_prof_site *prof;
+  double d_weight;
+  t_u32 u_slot;
 
-  while( u_words_copied++ < u_words_to_copy )
+  if( (ZERO == mem_prof_pending) || (ZERO == mem_prof_on) )
     {
-      *((t_word*)(dest_ptr++)) = *((t_word*)(src_ptr++));
+      return;
     }
+  mem_prof_pending--;
+
+  u_slot   = _bk_mem_prof_find( mem_prof_site );
+  prof     = &mem_prof_sites[ u_slot ];
+  d_weight = _bk_mem_prof_weight( track->size );
+
+  prof->n_samples++;
+  prof->n_live++;
+  prof->alloc_bytes += d_weight;
+  prof->live_bytes  += d_weight;
+  track->prof_site   = ((mem_prof_epoch & 0xFFFF) << 16) | (u_slot + 1);
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_prof_live( t_memory_track *track, t_s32 i_sign )
+ * @brief add a sampled block to, or take it from, its site
+ * @remark caller must hold the memory lock
+ */
+static inline void _bk_mem_prof_live( t_memory_track *track, t_s32 i_sign )
+{
+  t_memory_prof_site *prof;
 
-  while( u_bytes_copied++ < u_bytes_to_copy )
+  if( (ZERO == track->prof_site) ||
+      ((track->prof_site >> 16) != (mem_prof_epoch & 0xFFFF)) )
     {
-      *((t_byte*)(dest_ptr++)) = *((t_byte*)(src_ptr++));
+      return;
     }
 
-  u_scratch = u_bytes_copied + (sizeof(t_word) * u_words_copied);
+  prof = &mem_prof_sites[ (track->prof_site & 0xFFFF) - 1 ];
+  prof->n_live     += i_sign;
+  prof->live_bytes += i_sign * _bk_mem_prof_weight( track->size );
 
-  return( u_scratch );
+  return;
+}
+#else
+#define _bk_mem_prof_tick( bytes, blocks, site )
+#define _bk_mem_prof_sample( track )
+#define _bk_mem_prof_live( track, sign )
+#endif	/* CONFIG_BK_SYS_MEM_PROF */
+
+/**
+ * @fn _bk_mem_track_remove( t_memory_track *track )
+ * @brief drop a tracker slot found by _bk_mem_track_find()
+ * @remark caller must hold the memory lock. entries following
+ *         in the probe chain are shifted back, no tombstones.
+ */
+static void _bk_mem_track_remove( t_memory_track *track )
+{
+  t_u32 u_hole, u_loc, u_home;
+
+  _bk_mem_prof_live( track, -1 );
+  _bk_mem_limit_sub( track->size );
+  _bk_mem_stats_sub( track->size );
+
+  u_hole = (t_u32)(track - ptr_track);
+  u_loc  = u_hole;
+
+  for( ;; )
+    {
+      u_loc = (u_loc + 1) & (ptr_track_slots - 1);
+      if( NULL == ptr_track[ u_loc ].ptr )
+	{
+	  break;
+	}
+      u_home = _bk_mem_track_hash( ptr_track[ u_loc ].ptr, ptr_track_slots - 1 );
+      /* @remark move entry back unless its home lies in (hole, loc] */
+      if( ((u_loc - u_home) & (ptr_track_slots - 1)) >=
+	  ((u_loc - u_hole) & (ptr_track_slots - 1)) )
+	{
+	  ptr_track[ u_hole ] = ptr_track[ u_loc ];
+	  u_hole = u_loc;
+	}
+    }
+
+  ptr_track[ u_hole ].ptr   = NULL;
+  ptr_track[ u_hole ].size  = ZERO;
+  ptr_track[ u_hole ].flags = ZERO;
+  ptr_track[ u_hole ].scope = NULL;
+  mc.alloc_used--;
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_track_resize( t_ptr ptr_old, t_ptr ptr_new, t_size ui_bytes )
+ * @brief follow a block through a reallocation
+ * @remark caller must hold the memory lock. a moved block takes
+ *         the slot freed by the old one, so this cannot fail.
+ */
+static void _bk_mem_track_resize( t_ptr ptr_old, t_ptr ptr_new, t_size ui_bytes )
+{
+  t_memory_track *track, saved;
+
+  track = _bk_mem_track_find( ptr_old );
+  if( NULL == track )
+    {
+      return;
+    }
+
+  if( ui_bytes > track->size )
+    {
+      total_memory_allocated += ui_bytes - track->size;
+    }
+
+  if( ptr_old == ptr_new )
+    {
+      _bk_mem_prof_live( track, -1 );
+      _bk_mem_limit_add( ui_bytes );
+      _bk_mem_limit_sub( track->size );
+      _bk_mem_stats_sub( track->size );
+      _bk_mem_stats_add( ui_bytes );
+      track->size   = ui_bytes;
+      track->flags &= ~BKIT_MEM_TRACK_SIZED;
+      _bk_mem_prof_live( track, 1 );
+      return;
+    }
+
+  saved = *track;
+  _bk_mem_track_remove( track );
+  total_memory_allocated -= ui_bytes;
+  _bk_mem_track_insert( ptr_new, ui_bytes, ZERO );
+
+  /* @remark the block keeps its flags, scope, trace number and site */
+  track = _bk_mem_track_find( ptr_new );
+  saved.ptr    = ptr_new;
+  saved.size   = ui_bytes;
+  saved.flags &= ~BKIT_MEM_TRACK_SIZED;
+  *track = saved;
+  if( NULL != saved.scope )
+    {
+      saved.scope->blocks[ saved.scope_idx ] = ptr_new;
+    }
+  _bk_mem_prof_live( track, 1 );
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_scope_attach( t_ptr ptr_mem )
+ * @brief link a tracked block to the current scope of the thread
+ * @details
+ * A full block list is compacted in place when less than half of
+ * it is live, and doubled otherwise, so a scope whose blocks come
+ * and go keeps a list about the size of its live set.
+ *
+ * @remark caller must hold the memory lock
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 _bk_mem_scope_attach( t_ptr ptr_mem )
+{
+  t_mem_scope *scope = mem_scope_cur;
+  t_memory_track *track;
+  t_ptr *new_blocks;
+  t_u32 u_idx, u_live, new_slots;
+
+  if( NULL == scope )
+    {
+      return( 0 );
+    }
+
+  if( scope->n_blocks == scope->n_slots )
+    {
+      if( (scope->n_live << 1) < scope->n_blocks )
+	{
+	  for( u_idx = 0, u_live = 0; u_idx < scope->n_blocks; u_idx++ )
+	    {
+	      if( NULL == scope->blocks[ u_idx ] )
+		{
+		  continue;
+		}
+	      track = _bk_mem_track_find( scope->blocks[ u_idx ] );
+	      if( (NULL == track) || (scope != track->scope) )
+		{
+		  continue;	/* @remark released by mem_gc() */
+		}
+	      track->scope_idx = u_live;
+	      scope->blocks[ u_live++ ] = scope->blocks[ u_idx ];
+	    }
+	  scope->n_blocks = u_live;
+	  scope->n_live   = u_live;
+	}
+      else
+	{
+	  new_slots = (ZERO == scope->n_slots) ? BKIT_MEM_SCOPE_SLOTS : (scope->n_slots << 1);
+	  if( new_slots < scope->n_slots )
+	    {
+	      return( -1 );	/* @remark overflow */
+	    }
+	  new_blocks = (t_ptr*) realloc( scope->blocks, new_slots * sizeof(t_ptr) );
+	  if( NULL == new_blocks )
+	    {
+	      return( -1 );
+	    }
+	  scope->blocks  = new_blocks;
+	  scope->n_slots = new_slots;
+	}
+    }
+
+  track = _bk_mem_track_find( ptr_mem );
+  track->scope     = scope;
+  track->scope_idx = scope->n_blocks;
+  scope->blocks[ scope->n_blocks++ ] = ptr_mem;
+  scope->n_live++;
+
+  return( 0 );
+}
+
+/**
+ * @fn _bk_mem_scope_detach( t_memory_track *track )
+ * @brief unlink a block from the scope it was made in, if any
+ * @remark caller must hold the memory lock
+ */
+static inline void _bk_mem_scope_detach( t_memory_track *track )
+{
+  if( NULL != track->scope )
+    {
+      track->scope->blocks[ track->scope_idx ] = NULL;
+      track->scope->n_live--;
+      track->scope = NULL;
+    }
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_track_new( t_ptr ptr_mem, t_size ui_bytes, t_u32 u_flags )
+ * @brief track a new allocation and give it to the current scope
+ * @remark caller must hold the memory lock
+ * @return 0 on success, -ve on failure with nothing recorded
+ */
+static t_s32 _bk_mem_track_new( t_ptr ptr_mem, t_size ui_bytes, t_u32 u_flags )
+{
+  if( 0 > _bk_mem_track_insert( ptr_mem, ui_bytes, u_flags ) )
+    {
+      return( -1 );
+    }
+
+  if( 0 > _bk_mem_scope_attach( ptr_mem ) )
+    {
+      _bk_mem_track_remove( _bk_mem_track_find( ptr_mem ) );
+      total_memory_allocated -= ui_bytes;
+      return( -1 );
+    }
+
+  _bk_mem_prof_sample( _bk_mem_track_find( ptr_mem ) );
+  _bk_mem_stats_new();
+
+  return( 0 );
+}
+
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+/**
+ * @remark allocation trace
+ * while a trace is open every request on a tracked block is kept
+ * as a t_mem_trace_rec in a buffer under the memory lock, and the
+ * buffer goes to the trace file with one write() when it fills.
+ * blocks are named by a number stored in the tracker, so while
+ * tracing the thread caches are bypassed and every block is
+ * tracked. requests on blocks made before the trace began are
+ * left out, apart from a resize which starts a new block.
+ */
+static int   mem_trace_fd   = -1;
+static t_u32 mem_trace_next = ZERO;
+static t_u32 mem_trace_used = ZERO;
+static t_u16 mem_trace_threads = ZERO;
+static t_u64 mem_trace_t0   = ZERO;
+static t_mem_trace_rec mem_trace_buf[ BKIT_MEM_TRACE_BUFFER ];
+static __thread t_u16 mem_trace_tid = ZERO;
+
+/**
+ * @fn _bk_mem_trace_now( void )
+ * @brief monotonic clock in nanoseconds
+ */
+static inline t_u64 _bk_mem_trace_now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return( (t_u64) ts.tv_sec * 1000000000ULL + (t_u64) ts.tv_nsec );
+}
+
+/**
+ * @fn _bk_mem_trace_flush( void )
+ * @brief write the buffered records to the trace file
+ * @remark caller must hold the memory lock. a failed write
+ *         closes the trace, the file keeps what was written.
+ */
+static void _bk_mem_trace_flush( void )
+{
+  t_u8 *u8_buf = (t_u8*) mem_trace_buf;
+  t_size u_left = mem_trace_used * sizeof(t_mem_trace_rec);
+  ssize_t l_done;
+
+  mem_trace_used = ZERO;
+  while( u_left > 0 )
+    {
+      l_done = write( mem_trace_fd, u8_buf, u_left );
+      if( 0 >= l_done )
+	{
+	  if( (0 > l_done) && (EINTR == errno) )
+	    {
+	      continue;
+	    }
+	  close( mem_trace_fd );
+	  mem_trace_fd = -1;
+	  return;
+	}
+      u8_buf += l_done;
+      u_left -= (t_size) l_done;
+    }
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_trace( t_u8 u_op, t_ptr ptr_mem, t_size ui_bytes, t_size ui_align )
+ * @brief record a request on a tracked block
+ * @remark caller must hold the memory lock; frees are recorded
+ *         before the block leaves the tracker.
+ */
+static void _bk_mem_trace( t_u8 u_op, t_ptr ptr_mem, t_size ui_bytes, t_size ui_align )
+{
+  t_memory_track *track;
+  t_mem_trace_rec *rec;
+
+  if( (0 > mem_trace_fd) || (NULL == (track = _bk_mem_track_find( ptr_mem ))) )
+    {
+      return;
+    }
+
+  if( (BKIT_MEM_TRACE_REALLOC == u_op) && (ZERO == track->trace_id) )
+    {
+      u_op = BKIT_MEM_TRACE_ALLOC;
+    }
+
+  if( BKIT_MEM_TRACE_REALLOC > u_op )
+    {
+      if( ZERO == ++mem_trace_next )
+	{
+	  mem_trace_next = 1;
+	}
+      track->trace_id = mem_trace_next;
+    }
+  else if( ZERO == track->trace_id )
+    {
+      return;
+    }
+
+  if( ZERO == mem_trace_tid )
+    {
+      mem_trace_tid = ++mem_trace_threads;
+    }
+
+  rec = &mem_trace_buf[ mem_trace_used++ ];
+  rec->time   = _bk_mem_trace_now() - mem_trace_t0;
+  rec->size   = ui_bytes;
+  rec->id     = track->trace_id;
+  rec->thread = mem_trace_tid;
+  rec->op     = u_op;
+  rec->align_shift = (ZERO != ui_align) ? (t_u8) __builtin_ctzl( ui_align ) : ZERO;
+
+  if( BKIT_MEM_TRACE_BUFFER == mem_trace_used )
+    {
+      _bk_mem_trace_flush();
+    }
+
+  return;
+}
+#else
+#define _bk_mem_trace( op, ptr, bytes, align )
+#endif	/* CONFIG_BK_SYS_MEM_TRACE */
+
+/**
+ * @fn _bk_mem_untracked_ok( void )
+ * @brief find out if a new block may skip the tracker
+ * @remark blocks of a scope or a trace and sampled blocks must be
+ *         tracked, those are not served from the thread caches.
+ * @return true if the thread cache may serve the request
+ */
+static inline t_bool _bk_mem_untracked_ok( void )
+{
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+  if( 0 <= mem_trace_fd )
+    {
+      return( false );
+    }
+#endif
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+  if( ZERO != mem_prof_pending )
+    {
+      return( false );
+    }
+#endif
+
+  return( (NULL == mem_scope_cur) ? true : false );
+}
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+/**
+ * @remark per-thread caches
+ * small requests are served from per-thread magazines of free
+ * blocks, one magazine per power of two size class. blocks are
+ * carved out of slabs and carry a header naming their slab, the
+ * slab registry is only written under the memory lock and can
+ * be read without it, so mem_free() can recognise a cached block
+ * without touching shared state. magazines refill from, and
+ * spill into, a shared depot a batch at a time.
+ */
+struct s_memory_slab {
+  t_u8 *data;
+  t_u8 *end;
+  t_u32 stride;
+  t_u32 class;
+  t_u32 n_carved;		/* @remark blocks carved so far */
+  t_u32 n_idle;			/* @remark of those, blocks in the depot */
+};
+
+struct s_memory_block {
+  struct s_memory_slab *slab;
+  t_u32 class;
+  t_u32 magic;
+} __attribute__((aligned(16)));
+
+struct s_memory_tcache {
+  t_ptr mag[ BKIT_MEM_TCACHE_CLASSES ][ BKIT_MEM_TCACHE_DEPTH ];
+  t_u32 n_mag[ BKIT_MEM_TCACHE_CLASSES ];
+  volatile long n_live;
+  volatile long n_bytes;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+  volatile long n_allocs;	/* @remark blocks handed out, this generation */
+#endif
+  t_u32 gen;
+  struct s_memory_tcache *next;
+};
+
+typedef struct s_memory_slab   t_memory_slab;
+typedef struct s_memory_block  t_memory_block;
+typedef struct s_memory_tcache t_memory_tcache;
+
+#define BKIT_MEM_BLOCK_LIVE	0xB10CCAFEu
+#define BKIT_MEM_BLOCK_IDLE	0xB10CF4EEu
+#define BKIT_MEM_PAGE_MIN	4096
+
+static __thread t_memory_tcache *mem_tcache = NULL;
+static pthread_key_t  mem_tcache_key;
+static pthread_once_t mem_tcache_once = PTHREAD_ONCE_INIT;
+
+static t_memory_tcache *mem_tcache_list = NULL;
+static long mem_tcache_retired_live  = ZERO;
+static long mem_tcache_retired_bytes = ZERO;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+static t_u64 mem_tcache_allocs = ZERO;	/* @remark of caches gone or reset */
+#endif
+static volatile t_u32 mem_tcache_gen = ZERO;
+
+static t_memory_slab * volatile mem_slab_reg[ BKIT_MEM_TCACHE_SLABS ];
+static t_u32 mem_slab_count = ZERO;
+
+/* @remark marks a released slab in the registry, holds no blocks */
+static t_memory_slab mem_slab_gone;
+
+static t_ptr  mem_depot[ BKIT_MEM_TCACHE_CLASSES ];
+static t_u8  *mem_carve_next[ BKIT_MEM_TCACHE_CLASSES ];
+static t_memory_slab *mem_carve_slab[ BKIT_MEM_TCACHE_CLASSES ];
+
+/**
+ * @fn _bk_mem_tcache_class( t_size ui_bytes )
+ * @brief size class of a request
+ * @return class index or -1 if the request is not cached
+ */
+static inline t_s32 _bk_mem_tcache_class( t_size ui_bytes )
+{
+  t_s32 class = 0;
+
+  if( (ZERO == ui_bytes) || (BKIT_MEM_TCACHE_MAX < ui_bytes) )
+    {
+      return( -1 );
+    }
+
+  while( (BKIT_MEM_TCACHE_MIN << class) < ui_bytes )
+    {
+      class++;
+    }
+
+  return( class );
+}
+
+/**
+ * @fn _bk_mem_slab_hash( t_memory_slab *slab )
+ * @brief home slot of a slab in the registry
+ */
+static inline t_u32 _bk_mem_slab_hash( t_memory_slab *slab )
+{
+  return( _bk_mem_track_hash( (t_ptr)slab, BKIT_MEM_TCACHE_SLABS - 1 ) );
+}
+
+/**
+ * @fn _bk_mem_slab_registered( t_memory_slab *slab )
+ * @brief lock free lookup of a slab in the registry
+ * @remark a released slab leaves mem_slab_gone in its slot, so
+ *         lookups probe past it. the marker has no blocks and no
+ *         pointer falls inside it.
+ * @return true if the slab belongs to the cache
+ */
+static inline t_bool _bk_mem_slab_registered( t_memory_slab *slab )
+{
+  t_u32 u_loc, u_probe;
+  t_memory_slab *reg;
+
+  u_loc = _bk_mem_slab_hash( slab );
+  for( u_probe = 0; u_probe < BKIT_MEM_TCACHE_SLABS; u_probe++ )
+    {
+      reg = mem_slab_reg[ u_loc ];
+      if( reg == slab )
+	{
+	  return( true );
+	}
+      if( NULL == reg )
+	{
+	  break;
+	}
+      u_loc = (u_loc + 1) & (BKIT_MEM_TCACHE_SLABS - 1);
+    }
+
+  return( false );
+}
+
+/**
+ * @fn _bk_mem_slab_new( t_u32 class )
+ * @brief allocate and register a slab for a size class
+ * @remark caller must hold the memory lock. the registry is
+ *         kept at most half full to keep probes short.
+ * @return new slab or NULL on failure
+ */
+static t_memory_slab *_bk_mem_slab_new( t_u32 class )
+{
+  t_memory_slab *slab;
+  t_u32 u_loc;
+
+  if( mem_slab_count >= (BKIT_MEM_TCACHE_SLABS / 2) )
+    {
+      return( NULL );
+    }
+
+  if( 0 > _bk_mem_limit_take( BKIT_MEM_SLAB_SIZE ) )
+    {
+      return( NULL );
+    }
+
+  slab = (t_memory_slab*) mc.malloc( BKIT_MEM_SLAB_SIZE );
+  if( NULL == slab )
+    {
+      _bk_mem_limit_sub( BKIT_MEM_SLAB_SIZE );
+      return( NULL );
+    }
+
+  slab->stride = (BKIT_MEM_TCACHE_MIN << class) + sizeof(t_memory_block);
+  slab->class  = class;
+  slab->n_carved = ZERO;
+  slab->n_idle   = ZERO;
+  slab->data   = (t_u8*)slab + sizeof(t_memory_block) * 
+    ((sizeof(t_memory_slab) + sizeof(t_memory_block) - 1) / sizeof(t_memory_block));
+  slab->end    = slab->data + 
+    ((((t_u8*)slab + BKIT_MEM_SLAB_SIZE) - slab->data) / slab->stride) * slab->stride;
+
+  /* @remark slab must be complete before readers can find it */
+  __sync_synchronize();
+
+  u_loc = _bk_mem_slab_hash( slab );
+  while( (NULL != mem_slab_reg[ u_loc ]) && (&mem_slab_gone != mem_slab_reg[ u_loc ]) )
+    {
+      u_loc = (u_loc + 1) & (BKIT_MEM_TCACHE_SLABS - 1);
+    }
+  mem_slab_reg[ u_loc ] = slab;
+  mem_slab_count++;
+
+  mem_carve_slab[ class ] = slab;
+  mem_carve_next[ class ] = slab->data;
+
+  return( slab );
+}
+
+/**
+ * @fn _bk_mem_tcache_owner( t_ptr ptr_mem )
+ * @brief find out if a pointer is a cached block
+ * @details
+ * The header in front of the pointer is only read when it lies
+ * on the same page, so this is safe for any heap pointer. The
+ * slab named in the header must be registered and the pointer
+ * must fall on a block boundary within it.
+ *
+ * @return header of the block or NULL if not a cached block
+ */
+static inline t_memory_block *_bk_mem_tcache_owner( t_ptr ptr_mem )
+{
+  t_memory_block *block;
+  t_memory_slab *slab;
+  t_u8 *u8_ptr = (t_u8*) ptr_mem;
+
+  if( ((unsigned long)ptr_mem & (BKIT_MEM_PAGE_MIN - 1)) < sizeof(t_memory_block) )
+    {
+      return( NULL );
+    }
+
+  block = (t_memory_block*)ptr_mem - 1;
+  if( (BKIT_MEM_BLOCK_LIVE != block->magic) && (BKIT_MEM_BLOCK_IDLE != block->magic) )
+    {
+      return( NULL );
+    }
+
+  slab = block->slab;
+  if( true != _bk_mem_slab_registered( slab ) )
+    {
+      return( NULL );
+    }
+
+  if( (u8_ptr < slab->data) || (u8_ptr >= slab->end) ||
+      (sizeof(t_memory_block) != (t_u32)((u8_ptr - slab->data) % slab->stride)) )
+    {
+      return( NULL );
+    }
+
+  return( block );
+}
+
+/**
+ * @fn _bk_mem_tcache_fill( t_memory_tcache *tc, t_u32 class )
+ * @brief refill an empty magazine with a batch of blocks
+ * @details
+ * Takes blocks spilled to the depot first and carves fresh
+ * ones out of the current slab of the class after that.
+ *
+ * @return number of blocks added to the magazine
+ */
+static t_u32 _bk_mem_tcache_fill( t_memory_tcache *tc, t_u32 class )
+{
+  t_u32 u_count = 0;
+  t_memory_block *block;
+  t_memory_slab *slab;
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+  t_bool b_admitted = false;
+#endif
+
+  _bk_mem_lock();
+  while( (u_count < BKIT_MEM_TCACHE_BATCH) && (NULL != mem_depot[ class ]) )
+    {
+      block = (t_memory_block*) mem_depot[ class ] - 1;
+      block->slab->n_idle--;
+      tc->mag[ class ][ u_count++ ] = mem_depot[ class ];
+      mem_depot[ class ] = *((t_ptr*) mem_depot[ class ]);
+    }
+
+  while( u_count < BKIT_MEM_TCACHE_BATCH )
+    {
+      slab = mem_carve_slab[ class ];
+      if( (NULL == slab) || (mem_carve_next[ class ] >= slab->end) )
+	{
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+	  /* @remark a new slab may run the reclaim callbacks, not under the lock */
+	  if( true != b_admitted )
+	    {
+	      _bk_mem_unlock();
+	      b_admitted = true;
+	      if( 0 > _bk_mem_limit_admit( BKIT_MEM_SLAB_SIZE ) )
+		{
+		  _bk_mem_lock();
+		  break;
+		}
+	      _bk_mem_lock();
+	      continue;
+	    }
+#endif
+	  if( NULL == (slab = _bk_mem_slab_new( class )) )
+	    {
+	      break;
+	    }
+	}
+
+      block = (t_memory_block*) mem_carve_next[ class ];
+      mem_carve_next[ class ] += slab->stride;
+      if( ((unsigned long)(block + 1) & (BKIT_MEM_PAGE_MIN - 1)) < sizeof(t_memory_block) )
+	{
+	  continue;		/* @remark header would sit on the previous page */
+	}
+
+      block->slab  = slab;
+      block->class = class;
+      block->magic = BKIT_MEM_BLOCK_IDLE;
+      slab->n_carved++;
+      tc->mag[ class ][ u_count++ ] = (t_ptr)(block + 1);
+    }
+  _bk_mem_unlock();
+
+  tc->n_mag[ class ] = u_count;
+
+  return( u_count );
+}
+
+/**
+ * @fn _bk_mem_tcache_flush( t_memory_tcache *tc, t_u32 class, t_u32 u_count )
+ * @brief spill blocks from the top of a magazine into the depot
+ * @remark one lock acquisition for the whole batch
+ */
+static void _bk_mem_tcache_flush( t_memory_tcache *tc, t_u32 class, t_u32 u_count )
+{
+  t_ptr ptr_mem;
+
+  if( ZERO == u_count )
+    {
+      return;
+    }
+
+  _bk_mem_lock();
+  while( u_count-- > 0 )
+    {
+      ptr_mem = tc->mag[ class ][ --tc->n_mag[ class ] ];
+      ((t_memory_block*) ptr_mem - 1)->slab->n_idle++;
+      *((t_ptr*) ptr_mem) = mem_depot[ class ];
+      mem_depot[ class ] = ptr_mem;
+    }
+  _bk_mem_unlock();
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_tcache_exit( t_ptr arg )
+ * @brief thread destructor, hands a cache back to the depot
+ */
+static void _bk_mem_tcache_exit( t_ptr arg )
+{
+  t_memory_tcache *tc = (t_memory_tcache*) arg;
+  t_memory_tcache **link;
+  t_u32 class;
+
+  if( NULL == tc )
+    {
+      return;
+    }
+
+  if( tc->gen == mem_tcache_gen )
+    {
+      for( class = 0; class < BKIT_MEM_TCACHE_CLASSES; class++ )
+	{
+	  _bk_mem_tcache_flush( tc, class, tc->n_mag[ class ] );
+	}
+    }
+
+  _bk_mem_lock();
+  if( tc->gen == mem_tcache_gen )
+    {
+      mem_tcache_retired_live  += tc->n_live;
+      mem_tcache_retired_bytes += tc->n_bytes;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+      mem_tcache_allocs += tc->n_allocs;
+#endif
+    }
+  for( link = &mem_tcache_list; NULL != *link; link = &((*link)->next) )
+    {
+      if( tc == *link )
+	{
+	  *link = tc->next;
+	  break;
+	}
+    }
+  _bk_mem_unlock();
+
+  mem_tcache = NULL;
+  free( tc );
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_tcache_key( void )
+ * @brief create the thread destructor key, once
+ */
+static void _bk_mem_tcache_key( void )
+{
+  pthread_key_create( &mem_tcache_key, _bk_mem_tcache_exit );
+  return;
+}
+
+/**
+ * @fn _bk_mem_tcache_get( void )
+ * @brief cache of the calling thread, created on first use
+ * @details
+ * A cache left over from before a mem_gc() holds blocks that no
+ * longer exist, it is emptied and its counters are reset.
+ *
+ * @return cache or NULL if none could be created
+ */
+static inline t_memory_tcache *_bk_mem_tcache_get( void )
+{
+  t_memory_tcache *tc = mem_tcache;
+  t_u32 class;
+
+  if( NULL != tc )
+    {
+      if( tc->gen != mem_tcache_gen )
+	{
+	  for( class = 0; class < BKIT_MEM_TCACHE_CLASSES; class++ )
+	    {
+	      tc->n_mag[ class ] = 0;
+	    }
+	  tc->n_live  = 0;
+	  tc->n_bytes = 0;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+	  tc->n_allocs = 0;
+#endif
+	  tc->gen     = mem_tcache_gen;
+	}
+      return( tc );
+    }
+
+  pthread_once( &mem_tcache_once, _bk_mem_tcache_key );
+
+  tc = (t_memory_tcache*) calloc( 1, sizeof(t_memory_tcache) );
+  if( NULL == tc )
+    {
+      return( NULL );
+    }
+
+  _bk_mem_lock();
+  tc->gen = mem_tcache_gen;
+  tc->next = mem_tcache_list;
+  mem_tcache_list = tc;
+  _bk_mem_unlock();
+
+  pthread_setspecific( mem_tcache_key, tc );
+  mem_tcache = tc;
+
+  return( tc );
+}
+
+/**
+ * @fn _bk_mem_tcache_alloc( t_size ui_bytes )
+ * @brief serve a small request from the thread cache
+ * @return block or NULL if the request must take the slow path
+ */
+static inline t_ptr _bk_mem_tcache_alloc( t_size ui_bytes )
+{
+  t_memory_tcache *tc;
+  t_ptr ptr_mem;
+  t_s32 class;
+
+  if( 0 > (class = _bk_mem_tcache_class( ui_bytes )) )
+    {
+      return( NULL );
+    }
+
+  if( NULL == (tc = _bk_mem_tcache_get()) )
+    {
+      return( NULL );
+    }
+
+  if( ZERO == tc->n_mag[ class ] )
+    {
+      if( ZERO == _bk_mem_tcache_fill( tc, class ) )
+	{
+	  return( NULL );
+	}
+    }
+
+  ptr_mem = tc->mag[ class ][ --tc->n_mag[ class ] ];
+  ((t_memory_block*)ptr_mem - 1)->magic = BKIT_MEM_BLOCK_LIVE;
+  tc->n_live++;
+  tc->n_bytes += ui_bytes;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+  tc->n_allocs++;
+#endif
+
+  return( ptr_mem );
+}
+
+/**
+ * @fn _bk_mem_tcache_free( t_ptr ptr_mem )
+ * @brief return a cached block to the thread cache
+ * @return 0 if the block was ours, -ve if it was not
+ */
+static inline t_s32 _bk_mem_tcache_free( t_ptr ptr_mem )
+{
+  t_memory_tcache *tc;
+  t_memory_block *block;
+
+  if( NULL == (block = _bk_mem_tcache_owner( ptr_mem )) )
+    {
+      return( -1 );
+    }
+
+  if( BKIT_MEM_BLOCK_LIVE != block->magic )
+    {
+      return( 0 );		/* @remark already free, ignored */
+    }
+  block->magic = BKIT_MEM_BLOCK_IDLE;
+
+  if( NULL == (tc = _bk_mem_tcache_get()) )
+    {
+      /* @remark no cache for this thread, spill it */
+      _bk_mem_lock();
+      block->slab->n_idle++;
+      *((t_ptr*) ptr_mem) = mem_depot[ block->class ];
+      mem_depot[ block->class ] = ptr_mem;
+      mem_tcache_retired_live--;
+      _bk_mem_unlock();
+      return( 0 );
+    }
+
+  if( BKIT_MEM_TCACHE_DEPTH == tc->n_mag[ block->class ] )
+    {
+      _bk_mem_tcache_flush( tc, block->class, BKIT_MEM_TCACHE_BATCH );
+    }
+
+  tc->mag[ block->class ][ tc->n_mag[ block->class ]++ ] = ptr_mem;
+  tc->n_live--;
+
+  return( 0 );
+}
+
+/**
+ * @fn _bk_mem_tcache_size( t_ptr ptr_mem )
+ * @brief usable size of a cached block
+ * @return size in bytes or 0 if not a cached block
+ */
+static inline t_u32 _bk_mem_tcache_size( t_ptr ptr_mem )
+{
+  t_memory_block *block;
+
+  if( (NULL == (block = _bk_mem_tcache_owner( ptr_mem ))) ||
+      (BKIT_MEM_BLOCK_LIVE != block->magic) )
+    {
+      return( ZERO );
+    }
+
+  return( BKIT_MEM_TCACHE_MIN << block->class );
+}
+
+/**
+ * @fn _bk_mem_tcache_count( long *bytes )
+ * @brief merge the counters of all thread caches
+ * @remark caller must hold the memory lock
+ * @return number of live cached blocks
+ */
+static long _bk_mem_tcache_count( long *bytes )
+{
+  t_memory_tcache *tc;
+  long l_live  = mem_tcache_retired_live;
+  long l_bytes = mem_tcache_retired_bytes;
+
+  for( tc = mem_tcache_list; NULL != tc; tc = tc->next )
+    {
+      if( tc->gen == mem_tcache_gen )
+	{
+	  l_live  += tc->n_live;
+	  l_bytes += tc->n_bytes;
+	}
+    }
+
+  if( NULL != bytes )
+    {
+      *bytes = l_bytes;
+    }
+
+  return( l_live );
+}
+
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+/**
+ * @fn _bk_mem_tcache_stats( t_mem_stats *stats )
+ * @brief fill in the thread cache part of a snapshot
+ * @remark caller must hold the memory lock. magazines are read
+ *         while their threads use them, the counts are a guess.
+ * @return blocks handed out by the thread caches, cumulative
+ */
+static t_u64 _bk_mem_tcache_stats( t_mem_stats *stats )
+{
+  t_memory_tcache *tc;
+  t_u64 u_allocs = mem_tcache_allocs;
+  t_u32 class;
+
+  stats->tc_live = (t_u64) _bk_mem_tcache_count( NULL );
+  stats->tc_slab_bytes = (t_size) mem_slab_count * BKIT_MEM_SLAB_SIZE;
+
+  for( tc = mem_tcache_list; NULL != tc; tc = tc->next )
+    {
+      if( tc->gen != mem_tcache_gen )
+	{
+	  continue;
+	}
+      u_allocs += tc->n_allocs;
+      for( class = 0; class < BKIT_MEM_TCACHE_CLASSES; class++ )
+	{
+	  stats->tc_cached[ class ] += tc->n_mag[ class ];
+	}
+    }
+
+  return( u_allocs );
+}
+#endif	/* CONFIG_BK_SYS_MEM_STATS */
+
+/**
+ * @fn _bk_mem_tcache_gc( void )
+ * @brief release every slab, invalidating all thread caches
+ * @remark caller must hold the memory lock
+ */
+static void _bk_mem_tcache_gc( void )
+{
+  t_u32 u_loc, class;
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+  t_memory_tcache *tc;
+
+  /* @remark caches reset their counters when they see the new gen */
+  for( tc = mem_tcache_list; NULL != tc; tc = tc->next )
+    {
+      if( tc->gen == mem_tcache_gen )
+	{
+	  mem_tcache_allocs += tc->n_allocs;
+	}
+    }
+#endif
+
+  for( u_loc = 0; u_loc < BKIT_MEM_TCACHE_SLABS; u_loc++ )
+    {
+      if( (NULL != mem_slab_reg[ u_loc ]) && (&mem_slab_gone != mem_slab_reg[ u_loc ]) )
+	{
+	  mc.free( mem_slab_reg[ u_loc ] );
+	}
+      mem_slab_reg[ u_loc ] = NULL;
+    }
+  _bk_mem_limit_sub( (t_size) mem_slab_count * BKIT_MEM_SLAB_SIZE );
+  mem_slab_count = ZERO;
+
+  for( class = 0; class < BKIT_MEM_TCACHE_CLASSES; class++ )
+    {
+      mem_depot[ class ] = NULL;
+      mem_carve_slab[ class ] = NULL;
+      mem_carve_next[ class ] = NULL;
+    }
+
+  mem_tcache_retired_live  = ZERO;
+  mem_tcache_retired_bytes = ZERO;
+  mem_tcache_gen++;
+
+  return;
+}
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+/**
+ * @fn _bk_mem_tcache_trim( void )
+ * @brief release the slabs whose blocks are all in the depot
+ * @details
+ * Such a slab has no block in use and none in a magazine, so it
+ * can go without touching any thread cache. Its blocks are taken
+ * off the depot first, then its registry slot is marked with
+ * mem_slab_gone so lock free lookups of other slabs still probe
+ * past it.
+ *
+ * @remark caller must hold the memory lock
+ * @return bytes released
+ */
+static t_size _bk_mem_tcache_trim( void )
+{
+  t_memory_slab *slab;
+  t_memory_block *block;
+  t_ptr *link;
+  t_size u_bytes = ZERO;
+  t_u32 u_loc, class;
+
+  for( class = 0; class < BKIT_MEM_TCACHE_CLASSES; class++ )
+    {
+      link = &mem_depot[ class ];
+      while( NULL != *link )
+	{
+	  block = (t_memory_block*) *link - 1;
+	  if( block->slab->n_idle == block->slab->n_carved )
+	    {
+	      *link = *((t_ptr*) *link);
+	    }
+	  else
+	    {
+	      link = (t_ptr*) *link;
+	    }
+	}
+    }
+
+  for( u_loc = 0; u_loc < BKIT_MEM_TCACHE_SLABS; u_loc++ )
+    {
+      slab = mem_slab_reg[ u_loc ];
+      if( (NULL == slab) || (&mem_slab_gone == slab) || (slab->n_idle != slab->n_carved) )
+	{
+	  continue;
+	}
+      if( slab == mem_carve_slab[ slab->class ] )
+	{
+	  mem_carve_slab[ slab->class ] = NULL;
+	  mem_carve_next[ slab->class ] = NULL;
+	}
+      mem_slab_reg[ u_loc ] = &mem_slab_gone;
+      mem_slab_count--;
+      mc.free( slab );
+      u_bytes += BKIT_MEM_SLAB_SIZE;
+    }
+  if( ZERO != u_bytes )
+    {
+      _bk_mem_limit_sub( u_bytes );
+    }
+
+  return( u_bytes );
+}
+#endif	/* CONFIG_BK_SYS_MEM_LIMIT */
+#endif	/* CONFIG_BK_SYS_MEM_TCACHE */
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+/**
+ * @remark large allocations
+ * requests of mem_mmap_threshold bytes or more are anonymous
+ * mappings of their own, huge pages where asked for. a released
+ * mapping has its pages dropped with MADV_DONTNEED, which hands
+ * the memory back to the kernel at once, and the empty range is
+ * kept in a small cache to serve the next large request without
+ * another mmap().
+ */
+struct s_memory_map {
+  t_ptr ptr;
+  t_size length;
+  t_u32 flags;
+};
+
+typedef struct s_memory_map t_memory_map;
+
+static t_size mem_mmap_threshold = BKIT_MEM_MMAP_THRESHOLD;
+static t_u32  mem_mmap_flags     = BKIT_MEM_MMAP_THP;
+static t_memory_map mem_map_cache[ BKIT_MEM_MMAP_CACHE ];
+static t_u32  mem_map_cached     = ZERO;
+
+/**
+ * @fn _bk_mem_map_length( t_size ui_bytes, t_u32 u_flags )
+ * @brief length of the mapping that holds ui_bytes
+ */
+static inline t_size _bk_mem_map_length( t_size ui_bytes, t_u32 u_flags )
+{
+  t_size u_unit;
+
+  u_unit = (BKIT_MEM_TRACK_HUGE & u_flags) ? BKIT_MEM_HUGEPAGE : (t_size) BK_PAGESIZE;
+
+  return( (ui_bytes + u_unit - 1) & ~(u_unit - 1) );
+}
+
+/**
+ * @fn _bk_mem_map_get( t_size ui_bytes, t_u32 *u_flags, t_size *u_map )
+ * @brief find or make a mapping for ui_bytes
+ * @details
+ * A cached mapping is reused when it is large enough and no more
+ * than twice the size needed. Otherwise a new one is mapped, with
+ * MAP_HUGETLB first if configured, falling back to normal pages
+ * when no huge pages are reserved.
+ *
+ * @return mapping on success, NULL on failure; u_flags receives
+ *         the tracker flags of the mapping and u_map its length,
+ *         which for a reused mapping may exceed what ui_bytes needs.
+ */
+static t_ptr _bk_mem_map_get( t_size ui_bytes, t_u32 *u_flags, t_size *u_map )
+{
+  t_ptr ptr_map = NULL;
+  t_size u_length;
+  t_u32 u_idx;
+
+  _bk_mem_lock();
+  for( u_idx = 0; u_idx < mem_map_cached; u_idx++ )
+    {
+      u_length = _bk_mem_map_length( ui_bytes, mem_map_cache[ u_idx ].flags );
+      if( (mem_map_cache[ u_idx ].length >= u_length) &&
+	  (mem_map_cache[ u_idx ].length <= (u_length << 1)) )
+	{
+	  ptr_map  = mem_map_cache[ u_idx ].ptr;
+	  *u_flags = mem_map_cache[ u_idx ].flags;
+	  *u_map   = mem_map_cache[ u_idx ].length;
+	  mem_map_cache[ u_idx ] = mem_map_cache[ --mem_map_cached ];
+	  break;
+	}
+    }
+  _bk_mem_unlock();
+
+  if( NULL != ptr_map )
+    {
+      return( ptr_map );
+    }
+
+#if defined(MAP_HUGETLB)
+  if( BKIT_MEM_MMAP_HUGETLB & mem_mmap_flags )
+    {
+      *u_flags = BKIT_MEM_TRACK_MMAP | BKIT_MEM_TRACK_HUGE;
+      *u_map   = _bk_mem_map_length( ui_bytes, *u_flags );
+      ptr_map  = mmap( NULL, *u_map, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+      if( MAP_FAILED != ptr_map )
+	{
+	  return( ptr_map );
+	}
+    }
+#endif
+
+  *u_flags = BKIT_MEM_TRACK_MMAP;
+  *u_map   = u_length = _bk_mem_map_length( ui_bytes, *u_flags );
+  ptr_map  = mmap( NULL, u_length, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( MAP_FAILED == ptr_map )
+    {
+      return( NULL );
+    }
+
+#if defined(MADV_HUGEPAGE)
+  if( (BKIT_MEM_MMAP_THP & mem_mmap_flags) && (u_length >= BKIT_MEM_HUGEPAGE) )
+    {
+      madvise( ptr_map, u_length, MADV_HUGEPAGE );
+    }
+#endif
+
+  return( ptr_map );
+}
+
+/**
+ * @fn _bk_mem_map_put( t_ptr ptr_map, t_size u_length, t_u32 u_flags )
+ * @brief give the pages of a mapping back, keep the range if possible
+ * @param u_length length of the mapping, see _bk_mem_map_get()
+ */
+static void _bk_mem_map_put( t_ptr ptr_map, t_size u_length, t_u32 u_flags )
+{
+  madvise( ptr_map, u_length, MADV_DONTNEED );
+
+  _bk_mem_lock();
+  if( mem_map_cached < BKIT_MEM_MMAP_CACHE )
+    {
+      mem_map_cache[ mem_map_cached ].ptr    = ptr_map;
+      mem_map_cache[ mem_map_cached ].length = u_length;
+      mem_map_cache[ mem_map_cached ].flags  = u_flags;
+      mem_map_cached++;
+      ptr_map = NULL;
+    }
+  _bk_mem_unlock();
+
+  if( NULL != ptr_map )
+    {
+      munmap( ptr_map, u_length );
+    }
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_map_alloc( t_size ui_bytes, t_u8 u_op )
+ * @brief allocate a large block as a mapping and track it
+ * @param u_op request to record in a trace, BKIT_MEM_TRACE_*
+ * @remark mappings come zero filled, cached ones included.
+ * @return block on success, NULL on failure
+ */
+static t_ptr _bk_mem_map_alloc( t_size ui_bytes, t_u8 u_op )
+{
+  t_ptr ptr_map;
+  t_size u_map = ZERO;
+  t_u32 u_flags = ZERO;
+
+  ptr_map = _bk_mem_map_get( ui_bytes, &u_flags, &u_map );
+  if( NULL == ptr_map )
+    {
+      return( NULL );
+    }
+
+  _bk_mem_lock();
+  if( 0 > _bk_mem_track_new( ptr_map, ui_bytes, u_flags ) )
+    {
+      _bk_mem_unlock();
+      _bk_mem_map_put( ptr_map, u_map, u_flags );
+      return( NULL );
+    }
+  _bk_mem_track_find( ptr_map )->map_length = u_map;
+  _bk_mem_trace( u_op, ptr_map, ui_bytes, 0 );
+  _bk_mem_unlock();
+
+  return( ptr_map );
+}
+
+/**
+ * @fn _bk_mem_map_resize( t_ptr ptr_map, t_size *u_map, t_size ui_old, t_size ui_bytes, t_u32 u_flags )
+ * @brief resize a tracked mapping, moving it if the kernel must
+ * @param u_map length of the mapping, updated on success
+ * @remark the tracker is updated by the caller.
+ * @return the mapping on success, NULL on failure
+ */
+static t_ptr _bk_mem_map_resize( t_ptr ptr_map, t_size *u_map, t_size ui_old, t_size ui_bytes, t_u32 u_flags )
+{
+  t_ptr ptr_new;
+  t_size u_old, u_new;
+
+  u_old = *u_map;
+  u_new = _bk_mem_map_length( ui_bytes, u_flags );
+  if( u_old == u_new )
+    {
+      return( ptr_map );
+    }
+  *u_map = u_new;
+
+#if defined(MREMAP_MAYMOVE)
+  ptr_new = mremap( ptr_map, u_old, u_new, MREMAP_MAYMOVE );
+  if( MAP_FAILED != ptr_new )
+    {
+      return( ptr_new );
+    }
+#endif
+
+  if( u_new < u_old )
+    {
+      munmap( (t_u8*) ptr_map + u_new, u_old - u_new );
+      return( ptr_map );
+    }
+
+  ptr_new = mmap( NULL, u_new, PROT_READ | PROT_WRITE,
+#if defined(MAP_HUGETLB)
+		  (BKIT_MEM_TRACK_HUGE & u_flags) ? (MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB) :
+#endif
+		  (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0 );
+  if( MAP_FAILED == ptr_new )
+    {
+      *u_map = u_old;
+      return( NULL );
+    }
+  mem_copy( ptr_new, ptr_map, ui_old );
+  munmap( ptr_map, u_old );
+
+  return( ptr_new );
+}
+
+/**
+ * @fn _bk_mem_map_gc( void )
+ * @brief unmap every cached mapping
+ * @remark caller must hold the memory lock
+ */
+static void _bk_mem_map_gc( void )
+{
+  while( mem_map_cached > 0 )
+    {
+      mem_map_cached--;
+      munmap( mem_map_cache[ mem_map_cached ].ptr, mem_map_cache[ mem_map_cached ].length );
+    }
+
+  return;
+}
+#endif	/* CONFIG_BK_SYS_MEM_MMAP */
+
+/**
+ * @fn _bk_mem_alloc( t_size ui_bytes, t_ptr site )
+ * @brief mem_alloc() on behalf of a caller
+ * @param site call site charged by the profiler
+ */
+static t_ptr _bk_mem_alloc( t_size ui_bytes, t_ptr site )
+{
+  t_ptr ptr_mem;
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  _bk_mem_prof_tick( ui_bytes, 1, site );
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  if( (true == _bk_mem_untracked_ok()) && (NULL != (ptr_mem = _bk_mem_tcache_alloc( ui_bytes ))) )
+    {
+      return( ptr_mem );
+    }
+#endif
+
+  if( 0 > _bk_mem_limit_admit( ui_bytes ) )
+    {
+      return( NULL );
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  if( (ZERO != mem_mmap_threshold) && (ui_bytes >= mem_mmap_threshold) )
+    {
+      return( _bk_mem_map_alloc( ui_bytes, BKIT_MEM_TRACE_ALLOC ) );
+    }
+#endif
+
+  ptr_mem = mc.malloc( ui_bytes );
+  if( NULL == ptr_mem )
+    {
+      return( NULL );
+    }
+
+  _bk_mem_lock();
+  if( 0 > _bk_mem_track_new( ptr_mem, ui_bytes, BKIT_MEM_TRACK_SIZED ) )
+    {
+      _bk_mem_unlock();
+      mc.free( ptr_mem );
+      return( NULL );
+    }
+  _bk_mem_trace( BKIT_MEM_TRACE_ALLOC, ptr_mem, ui_bytes, 0 );
+  _bk_mem_unlock();
+
+  return( ptr_mem );
+}
+
+/**
+ * @fn t_ptr mem_alloc( t_size ui_bytes )
+ * @param ui_bytes number of bytes to allocate.
+ * @brief allocates memory like malloc.
+ * @details
+ * This function is to mimic malloc but has the 
+ * capability to use a different callback for
+ * allocating memory.
+ *
+ * @return pointer to allocated memory heap
+ *	   or NULL on failure.
+ */
+t_ptr mem_alloc( t_size ui_bytes )
+{
+  return( _bk_mem_alloc( ui_bytes, __builtin_return_address( 0 ) ) );
+}
+
+/**
+ * @fn t_ptr mem_clearalloc( t_size ui_bytes )
+ * @param ui_bytes number of bytes to allocate.
+ * @brief same functionality as calloc.
+ * @details
+ * This function does exactly the same as calloc
+ * except that the callback can be changed and
+ * all allocations are tracked for automatic
+ * memory free-up.
+ *
+ * @return pointer to cleared and allocated
+ *	   memory heap or NULL on failure.
+ */
+t_ptr mem_clearalloc( t_size ui_bytes )
+{
+  t_ptr ptr_mem;
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  _bk_mem_prof_tick( ui_bytes, 1, __builtin_return_address( 0 ) );
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  if( (true == _bk_mem_untracked_ok()) && (NULL != (ptr_mem = _bk_mem_tcache_alloc( ui_bytes ))) )
+    {
+      memset( ptr_mem, 0, ui_bytes );
+      return( ptr_mem );
+    }
+#endif
+
+  if( 0 > _bk_mem_limit_admit( ui_bytes ) )
+    {
+      return( NULL );
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  if( (ZERO != mem_mmap_threshold) && (ui_bytes >= mem_mmap_threshold) )
+    {
+      return( _bk_mem_map_alloc( ui_bytes, BKIT_MEM_TRACE_CALLOC ) );
+    }
+#endif
+
+  ptr_mem = mc.calloc( sizeof(t_u8), ui_bytes );
+  if( NULL == ptr_mem )
+    {
+      return( NULL );
+    }
+
+  _bk_mem_lock();
+  if( 0 > _bk_mem_track_new( ptr_mem, ui_bytes, BKIT_MEM_TRACK_SIZED ) )
+    {
+      _bk_mem_unlock();
+      mc.free( ptr_mem );
+      return( NULL );
+    }
+  _bk_mem_trace( BKIT_MEM_TRACE_CALLOC, ptr_mem, ui_bytes, 0 );
+  _bk_mem_unlock();
+
+  return( ptr_mem );
+}
+
+/**
+ * @fn _bk_mem_free_tracked( t_ptr ptr_mem, t_size ui_bytes )
+ * @brief release a block that is not in a thread cache
+ * @param ui_bytes size the caller says the block has, 0 if unknown
+ * @details
+ * The block leaves the tracker and goes back to where it came
+ * from. Blocks the backend made at exactly the size given go to
+ * its sized free callback where there is one.
+ */
+static void _bk_mem_free_tracked( t_ptr ptr_mem, t_size ui_bytes )
+{
+  t_memory_track *track;
+  t_size u_size;
+  t_u32 u_flags;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  t_size u_map;
+#endif
+
+  _bk_mem_lock();
+  track = _bk_mem_track_find( ptr_mem );
+  if( NULL == track )
+    {
+      _bk_mem_unlock();
+      return;
+    }
+  u_size  = track->size;
+  u_flags = track->flags;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  u_map   = track->map_length;
+#endif
+  _bk_mem_trace( BKIT_MEM_TRACE_FREE, ptr_mem, 0, 0 );
+  _bk_mem_scope_detach( track );
+  _bk_mem_track_remove( track );
+  _bk_mem_unlock();
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  if( BKIT_MEM_TRACK_MMAP & u_flags )
+    {
+      _bk_mem_map_put( ptr_mem, u_map, u_flags );
+      return;
+    }
+#endif
+
+  if( (NULL != mc.free_sized) && (BKIT_MEM_TRACK_SIZED & u_flags) &&
+      (ZERO != ui_bytes) && (ui_bytes == u_size) )
+    {
+      mc.free_sized( ptr_mem, ui_bytes );
+      return;
+    }
+
+  mc.free( ptr_mem );
+
+  return;
+}
+
+/**
+ * @fn void mem_free( t_ptr ptr_mem )
+ * @param ptr_mem pointer of the location to be freed.
+ * @brief same as free(ptr) with callback support 
+ * @details
+ * This function frees up memory similar to free() except
+ * that it cannot free memory if the memory callbacks were
+ * changed after allocating memory from a different 
+ * algorithm. Pointers not allocated through betakit are
+ * left untouched.
+ *
+ * @return Nothing even on failure.
+ */
+void mem_free( t_ptr ptr_mem )
+{
+  if( (0 == mem_init_state) || (NULL == ptr_mem) )
+    {
+      /* memory not initialised */
+      return;
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  if( 0 == _bk_mem_tcache_free( ptr_mem ) )
+    {
+      return;
+    }
+#endif
+
+  _bk_mem_free_tracked( ptr_mem, ZERO );
+
+  return;
+}
+
+/**
+ * @fn void mem_free_sized( t_ptr ptr_mem, t_size ui_bytes )
+ * @param ptr_mem block from mem_alloc(), mem_clearalloc() or
+ *        mem_alloc_batch()
+ * @param ui_bytes size the block was allocated with
+ * @brief mem_free() for callers that know the size of the block
+ * @details
+ * Blocks too large for the thread caches skip the check for a
+ * cached block. The size is handed on to the backend's sized free
+ * callback (see bk_jemalloc_calls()), which then need not look
+ * the block up to find its size class. Blocks from mem_realloc()
+ * or mem_alloc_aligned() and a size that does not match the
+ * tracker fall back to the plain free callback.
+ *
+ * @return Nothing even on failure.
+ */
+void mem_free_sized( t_ptr ptr_mem, t_size ui_bytes )
+{
+  if( (0 == mem_init_state) || (NULL == ptr_mem) )
+    {
+      return;
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  if( (ui_bytes <= BKIT_MEM_TCACHE_MAX) && (0 == _bk_mem_tcache_free( ptr_mem )) )
+    {
+      return;
+    }
+#endif
+
+  _bk_mem_free_tracked( ptr_mem, ui_bytes );
+
+  return;
+}
+
+/**
+ * @fn t_ptr mem_alloc_aligned( t_size ui_align, t_size ui_bytes )
+ * @param ui_align alignment in bytes, a power of two such as
+ *        BK_CACHELINE or BK_PAGESIZE
+ * @param ui_bytes number of bytes to allocate.
+ * @brief allocates memory starting at a multiple of ui_align
+ * @details
+ * Goes to the memalign callback, posix_memalign() or jemalloc's
+ * allocm(), and is tracked like mem_alloc(). Callbacks installed
+ * without a memalign entry cannot serve aligned requests.
+ *
+ * @warning mem_realloc() does not keep the alignment.
+ *
+ * @return pointer to allocated memory heap or NULL on failure.
+ */
+t_ptr mem_alloc_aligned( t_size ui_align, t_size ui_bytes )
+{
+  t_ptr ptr_mem;
+
+  if( (ZERO == ui_align) || (ZERO != (ui_align & (ui_align - 1))) ||
+      (ZERO == ui_bytes) )
+    {
+      return( NULL );
+    }
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  if( NULL == mc.memalign )
+    {
+      return( NULL );
+    }
+
+  if( ui_align < sizeof(t_ptr) )
+    {
+      ui_align = sizeof(t_ptr);	/* @remark posix_memalign minimum */
+    }
+
+  if( 0 > _bk_mem_limit_admit( ui_bytes ) )
+    {
+      return( NULL );
+    }
+
+  _bk_mem_prof_tick( ui_bytes, 1, __builtin_return_address( 0 ) );
+  ptr_mem = mc.memalign( ui_align, ui_bytes );
+  if( NULL == ptr_mem )
+    {
+      return( NULL );
+    }
+
+  _bk_mem_lock();
+  if( 0 > _bk_mem_track_new( ptr_mem, ui_bytes, ZERO ) )
+    {
+      _bk_mem_unlock();
+      mc.free( ptr_mem );
+      return( NULL );
+    }
+  _bk_mem_trace( BKIT_MEM_TRACE_ALIGNED, ptr_mem, ui_bytes, ui_align );
+  _bk_mem_unlock();
+
+  return( ptr_mem );
+}
+
+/**
+ * @fn void mem_free_aligned( t_ptr ptr_mem )
+ * @param ptr_mem block from mem_alloc_aligned()
+ * @brief releases an aligned block
+ * @remark aligned blocks are tracked like any other, this is
+ *         mem_free() under a name that pairs with the allocation.
+ *
+ * @return Nothing
+ */
+void mem_free_aligned( t_ptr ptr_mem )
+{
+  mem_free( ptr_mem );
+  return;
+}
+
+/**
+ * @fn t_u32 mem_alloc_batch( t_size ui_bytes, t_ptr *ptrs, t_u32 u_count )
+ * @param ui_bytes size of each block
+ * @param ptrs array that receives u_count pointers
+ * @param u_count number of blocks to allocate
+ * @brief allocate many blocks of one size at once
+ * @details
+ * Blocks the thread cache can serve cost no lock at all. The rest
+ * come from the backend in one request where it has a batch call
+ * (see bk_jemalloc_calls()) and are entered in the tracker under
+ * a single acquisition of the memory lock. Blocks are released
+ * with mem_free() or mem_free_batch(). A batch whose total size
+ * does not fit in a t_size is refused.
+ *
+ * @return u_count on success, 0 on failure with nothing allocated
+ */
+t_u32 mem_alloc_batch( t_size ui_bytes, t_ptr *ptrs, t_u32 u_count )
+{
+  t_memory_track *track;
+  t_u32 u_idx = 0, u_first, u_track;
+
+  if( (NULL == ptrs) || (ZERO == u_count) || (ZERO == ui_bytes) )
+    {
+      return( 0 );
+    }
+
+  /* @remark the batch total is charged and admitted as one request */
+  if( ui_bytes > SIZE_MAX / u_count )
+    {
+      return( 0 );
+    }
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  _bk_mem_prof_tick( ui_bytes * u_count, u_count, __builtin_return_address( 0 ) );
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  while( (true == _bk_mem_untracked_ok()) && (u_idx < u_count) &&
+	 (NULL != (ptrs[ u_idx ] = _bk_mem_tcache_alloc( ui_bytes ))) )
+    {
+      u_idx++;
+    }
+
+  if( u_idx == u_count )
+    {
+      return( u_count );
+    }
+#endif
+
+  /* @remark the rest come from the backend */
+  u_first = u_idx;
+  if( 0 > _bk_mem_limit_admit( ui_bytes * (u_count - u_first) ) )
+    {
+      goto rollback;
+    }
+
+  if( NULL != mc.alloc_batch )
+    {
+      if( ZERO == mc.alloc_batch( ui_bytes, ptrs + u_first, u_count - u_first ) )
+	{
+	  goto rollback;
+	}
+      u_idx = u_count;
+    }
+  else
+    {
+      for( ; u_idx < u_count; u_idx++ )
+	{
+	  if( NULL == (ptrs[ u_idx ] = mc.malloc( ui_bytes )) )
+	    {
+	      goto release;
+	    }
+	}
+    }
+
+  _bk_mem_lock();
+  for( u_track = u_first; u_track < u_count; u_track++ )
+    {
+      if( 0 > _bk_mem_track_new( ptrs[ u_track ], ui_bytes, BKIT_MEM_TRACK_SIZED ) )
+	{
+	  while( u_track-- > u_first )
+	    {
+	      track = _bk_mem_track_find( ptrs[ u_track ] );
+	      _bk_mem_scope_detach( track );
+	      _bk_mem_track_remove( track );
+	    }
+	  _bk_mem_unlock();
+	  goto release;
+	}
+      _bk_mem_trace( BKIT_MEM_TRACE_ALLOC, ptrs[ u_track ], ui_bytes, 0 );
+    }
+  _bk_mem_unlock();
+
+  return( u_count );
+
+ release:
+  while( u_idx-- > u_first )
+    {
+      mc.free( ptrs[ u_idx ] );
+    }
+
+ rollback:
+  /* @remark cached blocks go back to the thread cache */
+  while( u_first-- > 0 )
+    {
+      mem_free( ptrs[ u_first ] );
+    }
+
+  return( 0 );
+}
+
+/**
+ * @fn void mem_free_batch( t_ptr *ptrs, t_u32 u_count )
+ * @param ptrs array of blocks from mem_alloc() or mem_alloc_batch()
+ * @param u_count number of entries in ptrs
+ * @brief release many blocks at once
+ * @details
+ * Cached blocks go straight back to the thread cache, all others
+ * leave the tracker under one acquisition of the memory lock and
+ * are then handed to the backend. Entries are set to NULL as they
+ * are released; pointers not allocated through betakit are left
+ * untouched and are cleared as well.
+ *
+ * @return Nothing
+ */
+void mem_free_batch( t_ptr *ptrs, t_u32 u_count )
+{
+  t_memory_track *track;
+  t_u32 u_idx, u_first = 0;
+
+  if( (0 == mem_init_state) || (NULL == ptrs) )
+    {
+      return;
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  for( u_idx = 0; u_idx < u_count; u_idx++ )
+    {
+      if( (NULL != ptrs[ u_idx ]) && (0 == _bk_mem_tcache_free( ptrs[ u_idx ] )) )
+	{
+	  ptrs[ u_idx ] = NULL;
+	}
+    }
+#endif
+
+  _bk_mem_lock();
+  for( u_idx = 0; u_idx < u_count; u_idx++ )
+    {
+      if( NULL == ptrs[ u_idx ] )
+	{
+	  continue;
+	}
+      track = _bk_mem_track_find( ptrs[ u_idx ] );
+      if( NULL == track )
+	{
+	  ptrs[ u_idx ] = NULL;
+	  continue;
+	}
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+      /* @remark mappings move to the front, released one by one */
+      if( BKIT_MEM_TRACK_MMAP & track->flags )
+	{
+	  t_ptr ptr_map  = ptrs[ u_idx ];
+	  ptrs[ u_idx ]   = ptrs[ u_first ];
+	  ptrs[ u_first ] = ptr_map;
+	  u_first++;
+	  continue;
+	}
+#endif
+      _bk_mem_trace( BKIT_MEM_TRACE_FREE, ptrs[ u_idx ], 0, 0 );
+      _bk_mem_scope_detach( track );
+      _bk_mem_track_remove( track );
+    }
+  _bk_mem_unlock();
+
+  for( u_idx = 0; u_idx < u_first; u_idx++ )
+    {
+      mem_free( ptrs[ u_idx ] );
+      ptrs[ u_idx ] = NULL;
+    }
+
+  for( u_idx = u_first; u_idx < u_count; u_idx++ )
+    {
+      if( NULL != ptrs[ u_idx ] )
+	{
+	  mc.free( ptrs[ u_idx ] );
+	  ptrs[ u_idx ] = NULL;
+	}
+    }
+
+  return;
+}
+
+/**
+ * @fn t_mem_scope *mem_scope_begin( void )
+ * @brief open an allocation scope on the calling thread
+ * @details
+ * Until the matching mem_scope_end(), every block the thread gets
+ * from mem_alloc(), mem_clearalloc(), mem_alloc_aligned() and
+ * mem_alloc_batch(), or that mem_realloc() has to allocate anew,
+ * belongs to the scope. Scopes nest, new blocks go to the one
+ * opened last. Blocks of a scope may still be resized or freed
+ * one by one, from any thread, before the scope ends.
+ *
+ * @remark scoped blocks do not come from the thread cache.
+ * @return the scope on success, NULL on failure
+ */
+t_mem_scope *mem_scope_begin( void )
+{
+  t_mem_scope *scope;
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  scope = (t_mem_scope*) calloc( 1, sizeof(t_mem_scope) );
+  if( NULL == scope )
+    {
+      return( NULL );
+    }
+
+  scope->parent = mem_scope_cur;
+  mem_scope_cur = scope;
+
+  return( scope );
+}
+
+/**
+ * @fn void mem_scope_end( t_mem_scope *scope )
+ * @param scope scope from mem_scope_begin() on this thread
+ * @brief release every block still owned by a scope
+ * @details
+ * Walks the block list of the scope only, so the cost and the time
+ * the memory lock is held follow the size of the scope and not of
+ * the tracker. Scopes opened inside this one and not yet ended are
+ * ended first; the scope that was current when this one began is
+ * current again afterwards.
+ *
+ * @warning a scope must be ended by the thread that began it, a
+ *          scope not open on the calling thread is left alone.
+ *
+ * @return Nothing
+ */
+void mem_scope_end( t_mem_scope *scope )
+{
+  t_memory_track *track;
+  t_mem_scope *open;
+  t_ptr *blocks;
+  t_u32 u_idx, u_first = 0;
+
+  open = mem_scope_cur;
+  while( (NULL != open) && (scope != open) )
+    {
+      open = open->parent;
+    }
+  if( (NULL == scope) || (NULL == open) )
+    {
+      return;
+    }
+
+  while( scope != mem_scope_cur )
+    {
+      mem_scope_end( mem_scope_cur );
+    }
+  mem_scope_cur = scope->parent;
+
+  blocks = scope->blocks;
+  _bk_mem_lock();
+  for( u_idx = 0; u_idx < scope->n_blocks; u_idx++ )
+    {
+      if( NULL == blocks[ u_idx ] )
+	{
+	  continue;
+	}
+      track = _bk_mem_track_find( blocks[ u_idx ] );
+      if( (NULL == track) || (scope != track->scope) )
+	{
+	  blocks[ u_idx ] = NULL;	/* @remark released by mem_gc() */
+	  continue;
+	}
+      track->scope = NULL;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+      /* @remark mappings move to the front, released one by one */
+      if( BKIT_MEM_TRACK_MMAP & track->flags )
+	{
+	  t_ptr ptr_map    = blocks[ u_idx ];
+	  blocks[ u_idx ]   = blocks[ u_first ];
+	  blocks[ u_first ] = ptr_map;
+	  u_first++;
+	  continue;
+	}
+#endif
+      _bk_mem_trace( BKIT_MEM_TRACE_FREE, blocks[ u_idx ], 0, 0 );
+      _bk_mem_track_remove( track );
+    }
+  _bk_mem_unlock();
+
+  for( u_idx = 0; u_idx < u_first; u_idx++ )
+    {
+      mem_free( blocks[ u_idx ] );
+    }
+
+  for( u_idx = u_first; u_idx < scope->n_blocks; u_idx++ )
+    {
+      if( NULL != blocks[ u_idx ] )
+	{
+	  mc.free( blocks[ u_idx ] );
+	}
+    }
+
+  free( blocks );
+  free( scope );
+
+  return;
+}
+
+#if defined(BKIT_DEBUG_MODE)
+/**
+ * @fn mem_stat
+ * @brief status of memory allocation tracking
+ * @remark debug function only, no use otherwise
+ */
+void mem_stat( void )
+{
+  t_u32 tidx = 0;
+
+  if( 0 == mem_init_state )
+    {
+      printf("%s: caution memory state [ %d ]\n", __FUNCTION__, mem_init_state );
+    }
+
+  _bk_mem_lock();
+  for( tidx = 0; tidx < ptr_track_slots; tidx++ )
+  {
+    if( NULL != ptr_track[ tidx ].ptr )
+      {
+	printf("%s: [%u] memory pointer [ %p ] [ %llu bytes ]\n", __FUNCTION__, tidx,
+	       ptr_track[ tidx ].ptr, (unsigned long long) ptr_track[ tidx ].size );
+      }
+  }
+  printf("%s: total memory: %llu bytes [%u/%u]\n", __FUNCTION__,
+	 (unsigned long long) total_memory_allocated,
+	 mc.alloc_used, ptr_track_slots );
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  {
+    long l_bytes, l_live;
+    l_live = _bk_mem_tcache_count( &l_bytes );
+    printf("%s: thread caches: %ld blocks live, %ld bytes served, %u slabs\n", __FUNCTION__,
+	   l_live, l_bytes, mem_slab_count );
+  }
+#endif
+  _bk_mem_unlock();
+
+  return;
+}
+#endif	/* BKIT_DEBUG_MODE */
+
+/**
+ * @fn t_ptr mem_realloc( t_ptr ptr_mem, t_size ui_bytes )
+ * @param ptr_mem pointer to memory whose allocated heapsize is
+ *        to be changed.
+ * @param ui_bytes new number of bytes to be allocated.
+ * @details
+ * This function is similar to realloc and goes through the same
+ * callbacks as mem_alloc(). Where the callbacks can resize a block
+ * in place (see bk_jemalloc_calls()) that is tried first, asking
+ * for some headroom so a buffer that keeps growing mostly stays
+ * where it is; otherwise the realloc callback moves it. The
+ * tracker follows the block either way.
+ *
+ * @warning pointers not allocated through betakit are refused.
+ *
+ * @return Pointer to the re-allocated heap, which may differ
+ *         from ptr_mem, on success and NULL on failure, in which
+ *         case ptr_mem is left as it was.
+ */
+t_ptr mem_realloc( t_ptr ptr_mem, t_size ui_bytes )
+{
+  t_memory_track *track;
+  t_ptr ptr_new;
+  t_size u_size;
+  t_u32 u_flags;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  t_size u_map;
+#endif
+
+  if( NULL == ptr_mem )
+    {
+      return( _bk_mem_alloc( ui_bytes, __builtin_return_address( 0 ) ) );
+    }
+
+  if( ZERO == ui_bytes )
+    {
+      mem_free( ptr_mem );
+      return( NULL );
+    }
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  /* @remark cached blocks are not known to the allocator */
+  if( ZERO != (u_size = _bk_mem_tcache_size( ptr_mem )) )
+    {
+      if( ui_bytes <= u_size )
+	{
+	  return( ptr_mem );
+	}
+      if( NULL != (ptr_new = _bk_mem_alloc( ui_bytes, __builtin_return_address( 0 ) )) )
+	{
+	  mem_copy( ptr_new, ptr_mem, u_size );
+	  mem_free( ptr_mem );
+	}
+      return( ptr_new );
+    }
+#endif
+
+  _bk_mem_lock();
+  track   = _bk_mem_track_find( ptr_mem );
+  u_size  = (NULL != track) ? track->size : ZERO;
+  u_flags = (NULL != track) ? track->flags : ZERO;
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  u_map   = (NULL != track) ? track->map_length : ZERO;
+#endif
+  _bk_mem_unlock();
+
+  /* @remark a tracked block of 0 bytes simply grows */
+  if( NULL == track )
+    {
+      return( NULL );
+    }
+
+  if( (ui_bytes > u_size) && (0 > _bk_mem_limit_admit( ui_bytes - u_size )) )
+    {
+      return( NULL );
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  if( BKIT_MEM_TRACK_MMAP & u_flags )
+    {
+      ptr_new = _bk_mem_map_resize( ptr_mem, &u_map, u_size, ui_bytes, u_flags );
+      if( NULL == ptr_new )
+	{
+	  return( NULL );
+	}
+    }
+  else
+#endif
+  if( (NULL != mc.expand) &&
+      (ui_bytes <= mc.expand( ptr_mem, ui_bytes,
+			      (ui_bytes > u_size) ? (ui_bytes >> BKIT_MEM_GROW_SHIFT) : 0 )) )
+    {
+      ptr_new = ptr_mem;
+    }
+  else
+    {
+      ptr_new = mc.realloc( ptr_mem, ui_bytes );
+      if( NULL == ptr_new )
+	{
+	  return( NULL );
+	}
+    }
+
+  _bk_mem_lock();
+  _bk_mem_track_resize( ptr_mem, ptr_new, ui_bytes );
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  if( BKIT_MEM_TRACK_MMAP & u_flags )
+    {
+      _bk_mem_track_find( ptr_new )->map_length = u_map;
+    }
+#endif
+  _bk_mem_trace( BKIT_MEM_TRACE_REALLOC, ptr_new, ui_bytes, 0 );
+  _bk_mem_unlock();
+
+  return( ptr_new );
+}
+
+/**
+ * @fn void mem_gc( void )
+ * @brief frees all memory allocations that were done
+ *        using betakit's memory allocating calls.
+ * @details
+ * This is to free up all memory locations still held
+ * in the tracker if they were allocated with the same
+ * kit. The purpose is trivial and is to take care of
+ * memory that was not properly freed. The tracker is
+ * released as well and is rebuilt on next allocation.
+ *
+ * @return Nothing
+ */
+void mem_gc( void )
+{
+  register t_u32 traverse_loc = 0;
+
+  if( 0 == mem_init_state )
+    {
+      return;
+    }
+
+  _bk_mem_lock();
+  do {
+
+  for( traverse_loc = 0;
+       (traverse_loc < ptr_track_slots) && (mc.alloc_used > 0);
+       traverse_loc++ )
+    {
+      if( NULL == ptr_track[ traverse_loc ].ptr )
+	{
+	  continue;
+	}
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+      if( BKIT_MEM_TRACK_MMAP & ptr_track[ traverse_loc ].flags )
+	{
+	  munmap( ptr_track[ traverse_loc ].ptr, ptr_track[ traverse_loc ].map_length );
+	}
+      else
+#endif
+      mc.free( ptr_track[ traverse_loc ].ptr );
+      _bk_mem_limit_sub( ptr_track[ traverse_loc ].size );
+      _bk_mem_stats_sub( ptr_track[ traverse_loc ].size );
+      mc.alloc_used--;
+    }
+
+  free( ptr_track );
+  ptr_track = NULL;
+  ptr_track_slots = ZERO;
+  mc.alloc_used = ZERO;
+
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+  for( traverse_loc = 0; traverse_loc < BKIT_MEM_PROF_SITES; traverse_loc++ )
+    {
+      mem_prof_sites[ traverse_loc ].n_live     = ZERO;
+      mem_prof_sites[ traverse_loc ].live_bytes = 0.0;
+    }
+#endif
+
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  _bk_mem_tcache_gc();
+#endif
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  _bk_mem_map_gc();
+#endif
+  } while(0);
+  _bk_mem_unlock();
+
+  return;
+}
+
+/**
+ * @fn t_s32 mem_alloc_count( void )
+ * @brief returns number of live allocations made through mem_*
+ * @return allocations not yet freed
+ * @details
+ * This is just to expose an internal variable in the library
+ * through a hook. I am not very sure you can access these 
+ * symbols although lint has been quite strict in teaching me
+ * that they can indeed be accessed unless I throw them "static."
+ * Counters of the thread caches are merged in on each call.
+ */
+t_s32 mem_alloc_count( void )
+{
+  register t_u32 u_count = 0;
+
+  _bk_mem_lock();
+  u_count = mc.alloc_used;
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  u_count += (t_u32) _bk_mem_tcache_count( NULL );
+#endif
+  _bk_mem_unlock();
+
+  return( u_count );
+}
+
+
+/**
+ * @fn void mem_lock_stats( t_bmutex_stats *stats )
+ * @brief contention counters of the memory manager lock
+ * @details
+ * Reports how often the memory lock was taken, how many of
+ * those acquisitions had to wait for another thread and how
+ * often a waiter was put to sleep.
+ *
+ * @return Nothing
+ */
+void mem_lock_stats( t_bmutex_stats *stats )
+{
+  bk_mutex_stats( &mem_ctl_lock, stats );
+  return;
+}
+
+#if defined(CONFIG_BK_SYS_MEM_STATS)
+/**
+ * @fn t_s32 mem_stats( t_mem_stats *stats )
+ * @param stats snapshot to fill in, the previous one or zeroed
+ * @brief take a snapshot of the memory manager and its backend
+ * @details
+ * Counters of the memory manager are copied under the memory
+ * lock, which is held no longer than mem_alloc_count() holds it;
+ * the backend fills in its part afterwards through the stats
+ * callback, without the lock. Rates are worked out against the
+ * snapshot stats held on entry, so a monitor that passes the
+ * same structure on every poll gets the rates over its period.
+ *
+ * @return 0 on success, -1 on failure
+ */
+t_s32 mem_stats( t_mem_stats *stats )
+{
+  struct timespec ts;
+  t_u64 u_time, u_allocs, u_frees, u_ns;
+  t_void (*backend)( t_mem_stats *stats );
+
+  if( NULL == stats )
+    {
+      return( -1 );
+    }
+
+  u_time   = stats->time;
+  u_allocs = stats->n_allocs;
+  u_frees  = stats->n_frees;
+  memset( stats, 0, sizeof(t_mem_stats) );
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  stats->time = (t_u64) ts.tv_sec * 1000000000ULL + (t_u64) ts.tv_nsec;
+
+  _bk_mem_lock();
+  stats->live_bytes  = mem_stats_live;
+  stats->peak_bytes  = mem_stats_peak;
+  stats->live_blocks = mc.alloc_used;
+  stats->n_allocs    = mem_stats_allocs;
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  stats->n_allocs    += _bk_mem_tcache_stats( stats );
+  stats->live_blocks += stats->tc_live;
+#endif
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  stats->map_cached  = mem_map_cached;
+#endif
+  backend = mc.stats;
+  _bk_mem_unlock();
+
+  stats->n_frees = (stats->n_allocs > stats->live_blocks) ?
+    (stats->n_allocs - stats->live_blocks) : ZERO;
+
+  if( NULL != backend )
+    {
+      backend( stats );
+    }
+
+  /* @remark rates only once there is an earlier snapshot to go by */
+  if( (ZERO != u_time) && (stats->time > u_time) &&
+      (stats->n_allocs >= u_allocs) && (stats->n_frees >= u_frees) )
+    {
+      u_ns = stats->time - u_time;
+      stats->alloc_rate = (double)(stats->n_allocs - u_allocs) * 1e9 / (double) u_ns;
+      stats->free_rate  = (double)(stats->n_frees  - u_frees)  * 1e9 / (double) u_ns;
+    }
+
+  return( 0 );
+}
+#endif	/* CONFIG_BK_SYS_MEM_STATS */
+
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+/**
+ * @fn void mem_mmap_config( t_size ui_threshold, t_u32 u_flags )
+ * @param ui_threshold smallest request served by its own mapping,
+ *        0 sends every request to the callbacks.
+ * @param u_flags BKIT_MEM_MMAP_HUGETLB and/or BKIT_MEM_MMAP_THP
+ * @brief tune the large allocation path
+ * @details
+ * BKIT_MEM_MMAP_HUGETLB maps from the reserved huge page pool
+ * (vm.nr_hugepages) and falls back to normal pages when it is
+ * empty; BKIT_MEM_MMAP_THP asks for transparent huge pages on
+ * mappings of BKIT_MEM_HUGEPAGE or more. Blocks already mapped
+ * keep the settings they were made with.
+ *
+ * @return Nothing
+ */
+void mem_mmap_config( t_size ui_threshold, t_u32 u_flags )
+{
+  _bk_mem_lock();
+  mem_mmap_threshold = ui_threshold;
+  mem_mmap_flags     = u_flags;
+  _bk_mem_unlock();
+
+  return;
+}
+#endif	/* CONFIG_BK_SYS_MEM_MMAP */
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+/**
+ * @fn t_s32 mem_set_limit( t_size ui_soft, t_size ui_hard )
+ * @param ui_soft bytes in use past which the reclaim callbacks
+ *        run, 0 for none
+ * @param ui_hard bytes in use past which requests are refused,
+ *        0 for none
+ * @brief put the memory manager on a budget
+ * @details
+ * Counts blocks at the size asked for, plus the slabs of the
+ * thread caches and of object pools and the chunks of arenas.
+ * Crossing the soft limit drops the idle slabs and mappings the
+ * memory manager keeps, then runs every callback registered with
+ * mem_reclaim_register() once, so caches shrink before anything
+ * fails; a request that would still take use past the hard limit
+ * after reclaim returns NULL. Limits below current use take
+ * effect with the next request.
+ *
+ * @return 0 on success, -1 if the soft limit is above the hard one
+ */
+t_s32 mem_set_limit( t_size ui_soft, t_size ui_hard )
+{
+  if( (ZERO != ui_soft) && (ZERO != ui_hard) && (ui_soft > ui_hard) )
+    {
+      return( -1 );
+    }
+
+  _bk_mem_lock();
+  mem_limit_soft  = ui_soft;
+  mem_limit_hard  = ui_hard;
+  mem_limit_state = ((ZERO != ui_soft) && (mem_limit_used > ui_soft)) ?
+    BKIT_MEM_LIMIT_PENDING : BKIT_MEM_LIMIT_UNDER;
+  _bk_mem_unlock();
+
+  return( 0 );
+}
+
+/**
+ * @fn t_size mem_usage( t_void )
+ * @brief bytes counted against the limits of mem_set_limit()
+ * @return bytes in use
+ */
+t_size mem_usage( t_void )
+{
+  t_size u_used;
+
+  _bk_mem_lock();
+  u_used = mem_limit_used;
+  _bk_mem_unlock();
+
+  return( u_used );
+}
+
+/**
+ * @fn t_s32 mem_reclaim_register( t_mem_reclaim_fn fn, t_ptr arg )
+ * @param fn callback, given arg and the bytes still wanted, that
+ *        releases what it can and returns the bytes it released
+ * @param arg passed to fn as is
+ * @brief add a cache that gives memory back under pressure
+ * @details
+ * Callbacks run in the order they were registered, so register
+ * the cheapest caches to rebuild first. They run on the thread
+ * whose request crossed a limit, without the memory lock, and
+ * may free and allocate; they must not wait on locks that are
+ * held around allocations. mem_pool_reclaim() fits as is.
+ *
+ * @return 0 on success, -1 if fn is NULL or the registry is full
+ */
+t_s32 mem_reclaim_register( t_mem_reclaim_fn fn, t_ptr arg )
+{
+  t_s32 i_ret = -1;
+
+  if( NULL == fn )
+    {
+      return( -1 );
+    }
+
+  _bk_mem_lock();
+  if( mem_reclaim_count < BKIT_MEM_RECLAIM_MAX )
+    {
+      mem_reclaim_list[ mem_reclaim_count ].fn  = fn;
+      mem_reclaim_list[ mem_reclaim_count ].arg = arg;
+      mem_reclaim_count++;
+      i_ret = 0;
+    }
+  _bk_mem_unlock();
+
+  return( i_ret );
+}
+
+/**
+ * @fn t_void mem_reclaim_unregister( t_mem_reclaim_fn fn, t_ptr arg )
+ * @brief remove a callback added by mem_reclaim_register()
+ * @remark waits for reclaims in progress on other threads to
+ *         finish, so arg may be released once this returns.
+ */
+t_void mem_reclaim_unregister( t_mem_reclaim_fn fn, t_ptr arg )
+{
+  t_u32 u_idx;
+  t_bool b_found = false;
+
+  _bk_mem_lock();
+  for( u_idx = 0; u_idx < mem_reclaim_count; u_idx++ )
+    {
+      if( (fn == mem_reclaim_list[ u_idx ].fn) && (arg == mem_reclaim_list[ u_idx ].arg) )
+	{
+	  b_found = true;
+	  break;
+	}
+    }
+  if( true == b_found )
+    {
+      mem_reclaim_count--;
+      for( ; u_idx < mem_reclaim_count; u_idx++ )
+	{
+	  mem_reclaim_list[ u_idx ] = mem_reclaim_list[ u_idx + 1 ];
+	}
+    }
+  _bk_mem_unlock();
+
+  while( (true == b_found) && (true != mem_reclaim_busy) && (ZERO != mem_reclaim_active) )
+    {
+      sched_yield();
+    }
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_reclaim_own( t_size ui_wanted )
+ * @brief drop the caches of the memory manager itself
+ * @details
+ * Slabs of the thread caches with no block in use or in a
+ * magazine are released, and mappings kept for reuse are
+ * unmapped. The mappings had their pages dropped when they were
+ * freed and are not counted against the limits, so only the
+ * slabs count towards the bytes released.
+ *
+ * @return bytes released
+ */
+static t_size _bk_mem_reclaim_own( t_size ui_wanted )
+{
+  t_size u_freed = ZERO;
+
+  (void) ui_wanted;
+
+  _bk_mem_lock();
+#if defined(CONFIG_BK_SYS_MEM_TCACHE)
+  u_freed += _bk_mem_tcache_trim();
+#endif
+#if defined(CONFIG_BK_SYS_MEM_MMAP)
+  _bk_mem_map_gc();
+#endif
+  _bk_mem_unlock();
+
+  return( u_freed );
+}
+
+/**
+ * @fn t_size mem_reclaim( t_size ui_wanted )
+ * @param ui_wanted bytes to release, 0 to run every callback
+ * @brief ask the registered caches to give memory back
+ * @details
+ * The caches of the memory manager itself are dropped first,
+ * then callbacks are called in turn until ui_wanted bytes have
+ * been released between them. Called by the memory manager
+ * when a limit is crossed, and by hand to drop caches early;
+ * a callback that allocates does not start another reclaim.
+ *
+ * @return bytes released, as the callbacks reported them
+ */
+t_size mem_reclaim( t_size ui_wanted )
+{
+  t_memory_reclaim list[ BKIT_MEM_RECLAIM_MAX ];
+  t_u32 u_count, u_idx;
+  t_size u_freed = ZERO;
+
+  if( true == mem_reclaim_busy )
+    {
+      return( ZERO );
+    }
+
+  _bk_mem_lock();
+  u_count = mem_reclaim_count;
+  for( u_idx = 0; u_idx < u_count; u_idx++ )
+    {
+      list[ u_idx ] = mem_reclaim_list[ u_idx ];
+    }
+  mem_reclaim_active++;
+  _bk_mem_unlock();
+
+  mem_reclaim_busy = true;
+  u_freed = _bk_mem_reclaim_own( ui_wanted );
+  for( u_idx = 0; (u_idx < u_count) && ((ZERO == ui_wanted) || (u_freed < ui_wanted)); u_idx++ )
+    {
+      u_freed += list[ u_idx ].fn( list[ u_idx ].arg,
+				   (ui_wanted > u_freed) ? (ui_wanted - u_freed) : ZERO );
+    }
+  mem_reclaim_busy = false;
+
+  _bk_mem_lock();
+  mem_reclaim_active--;
+  _bk_mem_unlock();
+
+  return( u_freed );
+}
+#endif	/* CONFIG_BK_SYS_MEM_LIMIT */
+
+#if defined(CONFIG_BK_SYS_MEM_PROF)
+/**
+ * @fn void mem_prof_start( t_size ui_rate )
+ * @param ui_rate mean number of bytes allocated between samples,
+ *        0 for BKIT_MEM_PROF_RATE
+ * @brief start sampling allocation sites, clearing the profile
+ * @details
+ * Requests through mem_alloc(), mem_clearalloc(), mem_alloc_aligned()
+ * and mem_alloc_batch() are sampled on every thread and charged to
+ * the address they were called from. The cost outside of a sample
+ * is a thread local subtraction, so the profiler may stay on in
+ * production at the default rate. Works with any callbacks.
+ *
+ * @return Nothing
+ */
+void mem_prof_start( t_size ui_rate )
+{
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  _bk_mem_lock();
+  memset( mem_prof_sites, 0, sizeof(mem_prof_sites) );
+  mem_prof_used  = ZERO;
+  mem_prof_rate  = (ZERO != ui_rate) ? ui_rate : BKIT_MEM_PROF_RATE;
+  mem_prof_epoch++;
+  mem_prof_t0    = _bk_mem_prof_now();
+  mem_prof_t1    = ZERO;
+  mem_prof_on    = 1;
+  _bk_mem_unlock();
+
+  return;
+}
+
+/**
+ * @fn void mem_prof_stop( void )
+ * @brief stop taking samples
+ * @remark the profile is kept, frees still lower its live bytes.
+ * @return Nothing
+ */
+void mem_prof_stop( void )
+{
+  _bk_mem_lock();
+  if( ZERO != mem_prof_on )
+    {
+      mem_prof_on = ZERO;
+      mem_prof_t1 = _bk_mem_prof_now();
+    }
+  _bk_mem_unlock();
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_prof_cmp( const void *a, const void *b )
+ * @brief order sites by live bytes, then by bytes allocated
+ */
+static int _bk_mem_prof_cmp( const void *a, const void *b )
+{
+  const t_memory_prof_site *pa = (const t_memory_prof_site*) a;
+  const t_memory_prof_site *pb = (const t_memory_prof_site*) b;
+
+  if( pa->live_bytes != pb->live_bytes )
+    {
+      return( (pa->live_bytes < pb->live_bytes) ? 1 : -1 );
+    }
+  if( pa->alloc_bytes != pb->alloc_bytes )
+    {
+      return( (pa->alloc_bytes < pb->alloc_bytes) ? 1 : -1 );
+    }
+
+  return( 0 );
+}
+
+/**
+ * @fn t_s32 mem_prof_dump( const char *path )
+ * @param path file to write the report to, NULL for stdout
+ * @brief report the sampled call sites
+ * @details
+ * One line per site, heaviest live set first: estimated live bytes,
+ * sampled blocks still live, estimated bytes allocated and the rate
+ * of allocation since mem_prof_start(), followed by the call site,
+ * named after its symbol where the C library can tell.
+ *
+ * @return 0 on success, -ve on failure
+ */
+t_s32 mem_prof_dump( const char *path )
+{
+  t_memory_prof_site *sites;
+  FILE *fp = stdout;
+  t_u32 u_idx, u_count = 0;
+  t_u64 u_samples = 0;
+  double d_secs, d_live = 0.0, d_alloc = 0.0;
+
+  sites = (t_memory_prof_site*) malloc( sizeof(mem_prof_sites) );
+  if( NULL == sites )
+    {
+      return( -1 );
+    }
+
+  _bk_mem_lock();
+  for( u_idx = 0; u_idx < BKIT_MEM_PROF_SITES; u_idx++ )
+    {
+      if( ZERO != mem_prof_sites[ u_idx ].n_samples )
+	{
+	  sites[ u_count++ ] = mem_prof_sites[ u_idx ];
+	}
+    }
+  d_secs = (double)(((ZERO != mem_prof_t1) ? mem_prof_t1 : _bk_mem_prof_now()) - mem_prof_t0) / 1e9;
+  _bk_mem_unlock();
+
+  if( (NULL != path) && (NULL == (fp = fopen( path, "w" ))) )
+    {
+      free( sites );
+      return( -1 );
+    }
+
+  qsort( sites, u_count, sizeof(t_memory_prof_site), &_bk_mem_prof_cmp );
+  for( u_idx = 0; u_idx < u_count; u_idx++ )
+    {
+      u_samples += sites[ u_idx ].n_samples;
+      d_live    += sites[ u_idx ].live_bytes;
+      d_alloc   += sites[ u_idx ].alloc_bytes;
+    }
+
+  fprintf( fp, "# betakit allocation profile: 1 sample per %llu bytes, %llu samples, %.3f s\n",
+	   (unsigned long long) mem_prof_rate, (unsigned long long) u_samples, d_secs );
+  fprintf( fp, "# total: %.0f bytes live, %.0f bytes allocated, %.0f bytes/s\n",
+	   d_live, d_alloc, (d_secs > 0.0) ? (d_alloc / d_secs) : 0.0 );
+  fprintf( fp, "# %14s %8s %16s %14s  site\n", "live bytes", "blocks", "alloc bytes", "bytes/s" );
+
+  for( u_idx = 0; u_idx < u_count; u_idx++ )
+    {
+      fprintf( fp, "%16.0f %8llu %16.0f %14.0f  ", sites[ u_idx ].live_bytes,
+	       (unsigned long long) sites[ u_idx ].n_live, sites[ u_idx ].alloc_bytes,
+	       (d_secs > 0.0) ? (sites[ u_idx ].alloc_bytes / d_secs) : 0.0 );
+      if( NULL == sites[ u_idx ].site )
+	{
+	  fprintf( fp, "(other sites)\n" );
+	  continue;
+	}
+#if defined(__GLIBC__)
+      fflush( fp );
+      backtrace_symbols_fd( &sites[ u_idx ].site, 1, fileno( fp ) );
+#else
+      fprintf( fp, "%p\n", sites[ u_idx ].site );
+#endif
+    }
+
+  if( stdout != fp )
+    {
+      fclose( fp );
+    }
+  else
+    {
+      fflush( fp );
+    }
+  free( sites );
+
+  return( 0 );
+}
+#endif	/* CONFIG_BK_SYS_MEM_PROF */
+
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+/**
+ * @fn t_s32 mem_trace_start( const char *path )
+ * @param path file to record to, truncated if it exists
+ * @brief record every allocation request from now on
+ * @details
+ * The file holds a t_mem_trace_header followed by one fixed size
+ * t_mem_trace_rec per request, see memory.h; memreplay plays it
+ * back against the available backends. Setting BKIT_MEM_TRACE in
+ * the environment to a path records a whole run, from the first
+ * allocation until exit.
+ *
+ * @warning small blocks are not served from the thread caches
+ *          while recording, timings of a traced run are skewed.
+ *
+ * @return 0 on success, -ve on failure or if already recording
+ */
+t_s32 mem_trace_start( const char *path )
+{
+  t_mem_trace_header hdr;
+  int fd;
+
+  if( NULL == path )
+    {
+      return( -1 );
+    }
+
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if( 0 > fd )
+    {
+      return( -1 );
+    }
+
+  memset( &hdr, 0, sizeof(hdr) );
+  hdr.magic    = BKIT_MEM_TRACE_MAGIC;
+  hdr.version  = BKIT_MEM_TRACE_VERSION;
+  hdr.rec_size = sizeof(t_mem_trace_rec);
+  hdr.start    = (t_u64) time( NULL );
+  if( sizeof(hdr) != write( fd, &hdr, sizeof(hdr) ) )
+    {
+      close( fd );
+      return( -1 );
+    }
+
+  _bk_mem_lock();
+  if( 0 <= mem_trace_fd )
+    {
+      _bk_mem_unlock();
+      close( fd );
+      return( -1 );
+    }
+  mem_trace_t0   = _bk_mem_trace_now();
+  mem_trace_used = ZERO;
+  mem_trace_fd   = fd;
+  _bk_mem_unlock();
+
+  return( 0 );
+}
+
+/**
+ * @fn void mem_trace_stop( void )
+ * @brief write out buffered records and close the trace
+ * @return Nothing
+ */
+void mem_trace_stop( void )
+{
+  int fd;
+
+  _bk_mem_lock();
+  if( (0 <= mem_trace_fd) && (ZERO != mem_trace_used) )
+    {
+      _bk_mem_trace_flush();
+    }
+  fd = mem_trace_fd;
+  mem_trace_fd = -1;
+  _bk_mem_unlock();
+
+  if( 0 <= fd )
+    {
+      close( fd );
+    }
+
+  return;
+}
+#endif	/* CONFIG_BK_SYS_MEM_TRACE */
+
+/**
+ * @fn void _bk_mem_calls( t_memory_calls *calls )
+ * @brief copy out the callbacks currently in use
+ * @remark for allocators in bsys that manage their own blocks
+ *         and must free them with the callback they came from.
+ */
+void _bk_mem_calls( t_memory_calls *calls )
+{
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
+  _bk_mem_lock();
+  *calls = mc;
+  _bk_mem_unlock();
+
+  return;
+}
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+/**
+ * @fn t_s32 _bk_mem_charge( t_size ui_bytes )
+ * @brief count memory taken from the callbacks against the budget
+ * @remark for allocators in bsys whose slabs are not tracked.
+ *         callbacks are not run from here, a soft limit crossed
+ *         is dealt with by the next tracked request.
+ * @return 0 on success, -1 if the hard limit is in the way
+ */
+t_s32 _bk_mem_charge( t_size ui_bytes )
+{
+  t_s32 i_ret;
+
+  _bk_mem_lock();
+  i_ret = _bk_mem_limit_take( ui_bytes );
+  _bk_mem_unlock();
+
+  return( i_ret );
+}
+
+/**
+ * @fn void _bk_mem_uncharge( t_size ui_bytes )
+ * @brief give back bytes counted by _bk_mem_charge()
+ */
+void _bk_mem_uncharge( t_size ui_bytes )
+{
+  _bk_mem_lock();
+  _bk_mem_limit_sub( ui_bytes );
+  _bk_mem_unlock();
+
+  return;
+}
+#endif	/* CONFIG_BK_SYS_MEM_LIMIT */
+
+/**
+ * @struct s_memory_chunk
+ * @brief  header of an arena chunk, blocks follow it
+ */
+struct s_memory_chunk {
+  struct s_memory_chunk *next;
+  t_size size;
+} __attribute__((aligned(BKIT_MEM_ARENA_ALIGN)));
+
+typedef struct s_memory_chunk t_memory_chunk;
+
+/**
+ * @fn _bk_mem_arena_chunk( t_mem_arena *arena, t_size ui_bytes )
+ * @brief make a chunk with room for ui_bytes current
+ * @details
+ * The first spare chunk is reused when it is large enough,
+ * otherwise a new one is taken from the callbacks. Requests
+ * bigger than the chunk size get a chunk of their own.
+ *
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 _bk_mem_arena_chunk( t_mem_arena *arena, t_size ui_bytes )
+{
+  t_memory_chunk *chunk;
+  t_size u_size;
+
+  u_size = sizeof(t_memory_chunk) + ui_bytes;
+  if( u_size < arena->chunk_size )
+    {
+      u_size = arena->chunk_size;
+    }
+
+  chunk = (t_memory_chunk*) arena->spare_list;
+  if( (0 != chunk) && (chunk->size >= u_size) )
+    {
+      arena->spare_list = (t_ptr) chunk->next;
+    }
+  else
+    {
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+      if( 0 > _bk_mem_charge( u_size ) )
+	{
+	  return( -1 );
+	}
+#endif
+      chunk = (t_memory_chunk*) arena->calls.malloc( u_size );
+      if( 0 == chunk )
+	{
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+	  _bk_mem_uncharge( u_size );
+#endif
+	  return( -1 );
+	}
+      chunk->size = u_size;
+      arena->n_chunks++;
+    }
+
+  chunk->next = 0;
+  if( 0 == arena->used_list )
+    {
+      arena->used_list = (t_ptr) chunk;
+    }
+  else
+    {
+      ((t_memory_chunk*) arena->used_tail)->next = chunk;
+    }
+  arena->used_tail = (t_ptr) chunk;
+
+  arena->cur = (t_u8*) chunk + sizeof(t_memory_chunk);
+  arena->end = (t_u8*) chunk + chunk->size;
+
+  return( 0 );
+}
+
+/**
+ * @fn t_mem_arena *mem_arena_create( t_u32 chunk_size )
+ * @brief create a region for allocations that die together
+ * @param chunk_size bytes per chunk, 0 for BKIT_MEM_ARENA_CHUNK
+ * @details
+ * Blocks are carved from chunks by bumping a pointer and are
+ * never freed one by one; mem_arena_reset() releases all of them
+ * at once. Chunks come from the memory callbacks and are not
+ * tracked, so mem_gc() leaves arenas alone.
+ *
+ * @return new arena on success, NULL on failure
+ */
+t_mem_arena *mem_arena_create( t_u32 chunk_size )
+{
+  t_mem_arena *arena;
+  t_memory_calls calls;
+
+  if( ZERO == chunk_size )
+    {
+      chunk_size = BKIT_MEM_ARENA_CHUNK;
+    }
+
+  if( chunk_size < (sizeof(t_memory_chunk) + BKIT_MEM_ARENA_ALIGN) )
+    {
+      return( 0 );
+    }
+
+  _bk_mem_calls( &calls );
+  arena = (t_mem_arena*) calls.malloc( sizeof(t_mem_arena) );
+  if( 0 == arena )
+    {
+      return( 0 );
+    }
+
+  arena->used_list  = 0;
+  arena->used_tail  = 0;
+  arena->spare_list = 0;
+  arena->cur        = 0;
+  arena->end        = 0;
+  arena->chunk_size = chunk_size;
+  arena->n_chunks   = ZERO;
+  arena->n_bytes    = ZERO;
+  arena->calls      = calls;
+
+  return( arena );
+}
+
+/**
+ * @fn t_ptr mem_arena_alloc( t_mem_arena *arena, t_size ui_bytes )
+ * @brief carve a block from an arena
+ * @remark blocks are BKIT_MEM_ARENA_ALIGN aligned and live
+ *         until the next reset or destroy of the arena.
+ * @return block on success, NULL on failure
+ */
+t_ptr mem_arena_alloc( t_mem_arena *arena, t_size ui_bytes )
+{
+  t_ptr ptr_mem;
+
+  if( (0 == arena) || (ZERO == ui_bytes) ||
+      (ui_bytes > ~((t_size) 0) - arena->chunk_size) )
+    {
+      return( 0 );
+    }
+
+  ui_bytes = (ui_bytes + BKIT_MEM_ARENA_ALIGN - 1) & ~(BKIT_MEM_ARENA_ALIGN - 1);
+  if( ((unsigned long)(arena->end - arena->cur) < ui_bytes) &&
+      (0 > _bk_mem_arena_chunk( arena, ui_bytes )) )
+    {
+      return( 0 );
+    }
+
+  ptr_mem     = (t_ptr) arena->cur;
+  arena->cur += ui_bytes;
+  arena->n_bytes += ui_bytes;
+
+  return( ptr_mem );
+}
+
+/**
+ * @fn t_void mem_arena_reset( t_mem_arena *arena )
+ * @brief release every block of an arena at once
+ * @details
+ * Chunks in use are spliced onto the spare list in one step and
+ * handed out again by later allocations, so a reset costs the
+ * same however much was allocated and steady state use of an
+ * arena does not go back to the allocator.
+ */
+t_void mem_arena_reset( t_mem_arena *arena )
+{
+  if( (0 == arena) || (0 == arena->used_list) )
+    {
+      return;
+    }
+
+  ((t_memory_chunk*) arena->used_tail)->next = (t_memory_chunk*) arena->spare_list;
+  arena->spare_list = arena->used_list;
+  arena->used_list  = 0;
+  arena->used_tail  = 0;
+  arena->cur        = 0;
+  arena->end        = 0;
+  arena->n_bytes    = ZERO;
+
+  return;
+}
+
+/**
+ * @fn t_void mem_arena_destroy( t_mem_arena *arena )
+ * @brief release an arena and all of its chunks
+ */
+t_void mem_arena_destroy( t_mem_arena *arena )
+{
+  t_memory_chunk *chunk, *next;
+  t_void (*arena_free)( t_ptr ptr );
+
+  if( 0 == arena )
+    {
+      return;
+    }
+
+  mem_arena_reset( arena );
+  for( chunk = (t_memory_chunk*) arena->spare_list; 0 != chunk; chunk = next )
+    {
+      next = chunk->next;
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+      _bk_mem_uncharge( chunk->size );
+#endif
+      arena->calls.free( (t_ptr) chunk );
+    }
+
+  arena_free = arena->calls.free;
+  arena_free( (t_ptr) arena );
+
+  return;
 }
 
 /**
@@ -464,17 +3857,92 @@ void mem_changecalls( t_memory_calls *new_calls )
   t_s32 err_check = 0;
   mem_gc();
 
+  if( ZERO == mem_init_state )
+    {
+      mem_init( &mc );
+    }
+
   _bk_mem_lock();
   do {
   err_check += (0 != new_calls->malloc) ? (t_s32)(mc.malloc = new_calls->malloc) : 0 ;
   err_check += (0 != new_calls->calloc) ? (t_s32)(mc.calloc = new_calls->calloc) : 0 ;
   err_check += (0 != new_calls->free)   ? (t_s32)(mc.free   = new_calls->free  ) : 0 ;
   err_check += (0 != new_calls->realloc)? (t_s32)(mc.realloc= new_calls->realloc): 0 ;
+  mc.expand = new_calls->expand;	/* @remark only valid with its own backend */
+  mc.alloc_batch = new_calls->alloc_batch;
+  mc.free_sized = new_calls->free_sized; /* @remark same as expand */
+  mc.stats = new_calls->stats;
+  mc.memalign = new_calls->memalign;
   } while(0);
   _bk_mem_unlock();
 
   return;
 }
 
+/**
+ * @remark 32-bit callback shim
+ * backends written against the t_u32 callbacks are called through
+ * these, requests that do not fit 32 bits fail as out of memory.
+ */
+static t_memory_calls_u32 mc_u32;
+
+#define BKIT_MEM_U32_MAX	((t_size) 0xFFFFFFFFu)
+
+static t_ptr _bk_mem_u32_malloc( t_size ubytes )
+{
+  return( (ubytes > BKIT_MEM_U32_MAX) ? NULL : mc_u32.malloc( (t_u32) ubytes ) );
+}
+
+static t_ptr _bk_mem_u32_realloc( t_ptr ptr, t_size ubytes )
+{
+  return( (ubytes > BKIT_MEM_U32_MAX) ? NULL : mc_u32.realloc( ptr, (t_u32) ubytes ) );
+}
+
+static t_ptr _bk_mem_u32_calloc( t_size nmemb, t_size ubytes )
+{
+  if( (nmemb > BKIT_MEM_U32_MAX) || (ubytes > BKIT_MEM_U32_MAX) ||
+      ((ZERO != nmemb) && ((nmemb * ubytes) / nmemb != ubytes)) ||
+      ((nmemb * ubytes) > BKIT_MEM_U32_MAX) )
+    {
+      return( NULL );
+    }
+
+  return( mc_u32.calloc( (t_u32) nmemb, (t_u32) ubytes ) );
+}
+
+/**
+ * @fn void mem_changecalls_u32( t_memory_calls_u32 *old_calls )
+ * @param old_calls callbacks that take 32-bit sizes
+ * @brief compatibility form of mem_changecalls()
+ * @details
+ * For allocators written before betakit sizes became t_size.
+ * The callbacks are wrapped and installed as mem_changecalls()
+ * would, members left NULL keep the callbacks in use.
+ *
+ * @return None
+ */
+void mem_changecalls_u32( t_memory_calls_u32 *old_calls )
+{
+  t_memory_calls new_calls;
+
+  mem_gc();
+  mc_u32 = *old_calls;
+
+  new_calls.malloc     = (0 != old_calls->malloc)  ? &_bk_mem_u32_malloc  : 0;
+  new_calls.calloc     = (0 != old_calls->calloc)  ? &_bk_mem_u32_calloc  : 0;
+  new_calls.realloc    = (0 != old_calls->realloc) ? &_bk_mem_u32_realloc : 0;
+  new_calls.free       = old_calls->free;
+  new_calls.expand     = 0;
+  new_calls.alloc_batch = 0;
+  new_calls.free_sized = 0;
+  new_calls.stats      = 0;
+  new_calls.memalign   = 0;
+  new_calls.alloc_used = ZERO;
+
+  mem_changecalls( &new_calls );
+
+  return;
+}
+
 #endif	/*CONFIG_BK_SYS_MEMORY */
 /* @remark end of file "memory.c" */
@@ -0,0 +1,277 @@
+/**
+ * @file	mempool.c
+ * @author	Sunil Beta <betasam@gmail.com>
+ * @date	2010-2012
+ * @brief	fixed size object pools
+ * @details
+ * A pool hands out objects of one size and alignment from slabs
+ * of BKIT_MEM_POOL_SLAB bytes. Free objects are chained through
+ * their first word, so allocation and release are a pop and a
+ * push on the free list. Slabs are taken straight from the memory
+ * callbacks and are not tracked; they go back in one sweep when
+ * the pool is destroyed, or when an idle pool is reclaimed.
+ *
+ * @warning	objects are not checked for ownership on release.
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_SYS_MEMORY
+
+/* @remark Standard Includes : required for NULL */
+#include <stddef.h>
+
+/* @remark bkit Includes */
+#include <btypes.h>
+#include <bmutex.h>
+
+#include <memory.h>
+
+/**
+ * @fn _bk_mem_pool_slab_bytes( t_mem_pool *pool )
+ * @brief bytes taken from the callbacks for one slab
+ */
+static inline t_size _bk_mem_pool_slab_bytes( t_mem_pool *pool )
+{
+  return( sizeof(t_ptr) + pool->obj_align - 1 + (t_size) pool->obj_size * pool->slab_objs );
+}
+
+/**
+ * @fn _bk_mem_pool_grow( t_mem_pool *pool )
+ * @brief add one slab worth of objects to the free list
+ * @remark caller must hold the pool lock
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 _bk_mem_pool_grow( t_mem_pool *pool )
+{
+  t_u8 *slab, *obj;
+  t_u32 u_idx;
+  unsigned long ul_first;
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+  if( 0 > _bk_mem_charge( _bk_mem_pool_slab_bytes( pool ) ) )
+    {
+      return( -1 );
+    }
+#endif
+
+  slab = (t_u8*) pool->calls.malloc( _bk_mem_pool_slab_bytes( pool ) );
+  if( NULL == slab )
+    {
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+      _bk_mem_uncharge( _bk_mem_pool_slab_bytes( pool ) );
+#endif
+      return( -1 );
+    }
+
+  /* @remark slab header is the link to the next slab */
+  *((t_ptr*) slab) = pool->slab_list;
+  pool->slab_list = (t_ptr) slab;
+  pool->n_slabs++;
+
+  ul_first = ((unsigned long)slab + sizeof(t_ptr) + pool->obj_align - 1) &
+    ~((unsigned long)pool->obj_align - 1);
+
+  for( u_idx = pool->slab_objs; u_idx > 0; u_idx-- )
+    {
+      obj = (t_u8*) ul_first + (u_idx - 1) * pool->obj_size;
+      *((t_ptr*) obj) = pool->free_list;
+      pool->free_list = (t_ptr) obj;
+    }
+
+  return( 0 );
+}
+
+/**
+ * @fn t_mem_pool *mem_pool_create( t_u32 obj_size, t_u32 obj_align )
+ * @brief create a pool of fixed size objects
+ * @param obj_size  size of each object in bytes
+ * @param obj_align alignment, a power of two or 0 for pointer size
+ * @return new pool on success, NULL on failure
+ */
+t_mem_pool *mem_pool_create( t_u32 obj_size, t_u32 obj_align )
+{
+  t_mem_pool *pool;
+  t_memory_calls calls;
+
+  if( ZERO == obj_size )
+    {
+      return( NULL );
+    }
+
+  if( ZERO != (obj_align & (obj_align - 1)) )
+    {
+      return( NULL );		/* @remark not a power of two */
+    }
+
+  if( obj_align < sizeof(t_ptr) )
+    {
+      obj_align = sizeof(t_ptr);
+    }
+
+  _bk_mem_calls( &calls );
+  pool = (t_mem_pool*) calls.malloc( sizeof(t_mem_pool) );
+  if( NULL == pool )
+    {
+      return( NULL );
+    }
+
+  pool->calls     = calls;
+  pool->free_list = NULL;
+  pool->slab_list = NULL;
+  pool->obj_align = obj_align;
+  pool->obj_size  = (obj_size < sizeof(t_ptr)) ? sizeof(t_ptr) : obj_size;
+  pool->obj_size  = (pool->obj_size + obj_align - 1) & ~(obj_align - 1);
+  pool->slab_objs = (BKIT_MEM_POOL_SLAB - sizeof(t_ptr)) / pool->obj_size;
+  if( pool->slab_objs < BKIT_MEM_POOL_MINOBJS )
+    {
+      pool->slab_objs = BKIT_MEM_POOL_MINOBJS;
+    }
+  pool->n_live    = ZERO;
+  pool->n_slabs   = ZERO;
+  bk_mutex_init( &pool->lock );
+
+  return( pool );
+}
+
+/**
+ * @fn t_ptr mem_pool_alloc( t_mem_pool *pool )
+ * @brief take an object from a pool
+ * @remark contents of the object are undefined
+ * @return object on success, NULL on failure
+ */
+t_ptr mem_pool_alloc( t_mem_pool *pool )
+{
+  t_ptr obj;
+
+  if( NULL == pool )
+    {
+      return( NULL );
+    }
+
+  bk_mutex_lock( &pool->lock );
+  if( (NULL == pool->free_list) && (0 > _bk_mem_pool_grow( pool )) )
+    {
+      bk_mutex_unlock( &pool->lock );
+      return( NULL );
+    }
+
+  obj = pool->free_list;
+  pool->free_list = *((t_ptr*) obj);
+  pool->n_live++;
+  bk_mutex_unlock( &pool->lock );
+
+  return( obj );
+}
+
+/**
+ * @fn t_void mem_pool_free( t_mem_pool *pool, t_ptr obj )
+ * @brief return an object to the pool it came from
+ */
+t_void mem_pool_free( t_mem_pool *pool, t_ptr obj )
+{
+  if( (NULL == pool) || (NULL == obj) )
+    {
+      return;
+    }
+
+  bk_mutex_lock( &pool->lock );
+  *((t_ptr*) obj) = pool->free_list;
+  pool->free_list = obj;
+  pool->n_live--;
+  bk_mutex_unlock( &pool->lock );
+
+  return;
+}
+
+/**
+ * @fn _bk_mem_pool_release( t_mem_pool *pool )
+ * @brief give every slab of a pool back to the callbacks
+ * @remark caller must hold the pool lock
+ * @return bytes released
+ */
+static t_size _bk_mem_pool_release( t_mem_pool *pool )
+{
+  t_ptr slab, next;
+  t_size u_bytes;
+
+  for( slab = pool->slab_list; NULL != slab; slab = next )
+    {
+      next = *((t_ptr*) slab);
+      pool->calls.free( slab );
+    }
+
+  u_bytes = pool->n_slabs * _bk_mem_pool_slab_bytes( pool );
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+  _bk_mem_uncharge( u_bytes );
+#endif
+  pool->slab_list = NULL;
+  pool->free_list = NULL;
+  pool->n_slabs   = ZERO;
+
+  return( u_bytes );
+}
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+/**
+ * @fn t_size mem_pool_reclaim( t_ptr pool_arg, t_size ui_wanted )
+ * @brief reclaim callback that empties an idle pool
+ * @details
+ * Releases every slab of a pool that has no objects out, for use
+ * with mem_reclaim_register( mem_pool_reclaim, pool ). A pool in
+ * use, or locked by another thread, is left alone.
+ *
+ * @return bytes released
+ */
+t_size mem_pool_reclaim( t_ptr pool_arg, t_size ui_wanted )
+{
+  t_mem_pool *pool = (t_mem_pool*) pool_arg;
+  t_size u_bytes = ZERO;
+
+  (void) ui_wanted;
+
+  if( (NULL == pool) || (0 > bk_mutex_trylock( &pool->lock )) )
+    {
+      return( ZERO );
+    }
+
+  if( ZERO == pool->n_live )
+    {
+      u_bytes = _bk_mem_pool_release( pool );
+    }
+  bk_mutex_unlock( &pool->lock );
+
+  return( u_bytes );
+}
+#endif	/* CONFIG_BK_SYS_MEM_LIMIT */
+
+/**
+ * @fn t_void mem_pool_destroy( t_mem_pool *pool )
+ * @brief release a pool and every object carved from it
+ * @warning objects still in use become invalid
+ */
+t_void mem_pool_destroy( t_mem_pool *pool )
+{
+  t_void (*pool_free)( t_ptr ptr );
+
+  if( NULL == pool )
+    {
+      return;
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_LIMIT)
+  mem_reclaim_unregister( mem_pool_reclaim, (t_ptr) pool );
+#endif
+
+  bk_mutex_lock( &pool->lock );
+  _bk_mem_pool_release( pool );
+  bk_mutex_unlock( &pool->lock );
+
+  pool_free = pool->calls.free;
+  pool_free( pool );
+
+  return;
+}
+
+#endif	/* CONFIG_BK_SYS_MEMORY */
+/* @remark end of file "mempool.c" */
@@ -0,0 +1,210 @@
+/**
+ * @file bufref.c
+ * @author Sunil Beta <betasam@gmail.com>
+ * @date 2012
+ * @brief checks that buffer bytes live exactly as long as their references.
+ *
+ * A t_bbuf and every slice of it, slices of slices included, share
+ * the bytes of the buffer they were cut from. Each case below takes
+ * references and slices, gives them back in some order and counts
+ * the live blocks of the memory manager after each step: the bytes
+ * must stay readable while any reference is held and be freed with
+ * the last one. The last case hands a slice to an error log, which
+ * holds it until the log is flushed.
+ *
+ * usage: bufref
+ * @return 0 when every count matched, 1 otherwise
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_TEST_BUFREF
+
+/* @remark standard includes */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* @remark betakit includes */
+#include <ops.h>
+#include <btypes.h>
+
+#include <memory.h>
+#include <bbuf.h>
+#include <berror.h>
+
+#define BUFREF_TEXT	"betakit passes bytes by reference\n"
+#define BUFREF_WORD	"bytes"		/* sliced out of "passes bytes" */
+
+static t_s32 i_failed = 0;
+
+/**
+ * @fn bufref_check( const char *name, const char *step, t_s32 i_base, t_s32 i_want )
+ * @brief compare live blocks with what the step should leave
+ * @param i_base live blocks when the case started
+ * @param i_want blocks expected on top of i_base
+ */
+static t_void bufref_check( const char *name, const char *step,
+			    t_s32 i_base, t_s32 i_want )
+{
+  t_s32 i_live;
+
+  i_live = mem_alloc_count() - i_base;
+  printf( "%-8s: %-22s %d blocks live %s\n", name, step, i_live,
+	  (i_want == i_live) ? "ok" : "FAILED" );
+  if( i_want != i_live )
+    {
+      i_failed = 1;
+    }
+}
+
+/**
+ * @fn bufref_same( const char *name, t_bbuf *buf, const char *sz )
+ * @brief check the bytes of buf against sz
+ */
+static t_void bufref_same( const char *name, t_bbuf *buf, const char *sz )
+{
+  if( (NULL == buf) || (strlen( sz ) != bk_buf_len( buf )) ||
+      (0 != memcmp( bk_buf_data( buf ), sz, bk_buf_len( buf ) )) )
+    {
+      printf( "%-8s: bytes differ from \"%s\" FAILED\n", name, sz );
+      i_failed = 1;
+    }
+}
+
+/**
+ * @fn bufref_order( const char *name, t_bool owner_first )
+ * @brief slice a slice, then release the owner first or last
+ * @remark the owner is a header and a data block, slices a header each
+ */
+static t_void bufref_order( const char *name, t_bool owner_first )
+{
+  t_bbuf *buf, *ref, *words, *word;
+  t_s32 i_base;
+
+  i_base = mem_alloc_count();
+
+  buf = bk_buf_from( (t_ptr)BUFREF_TEXT, strlen( BUFREF_TEXT ) );
+  ref = bk_buf_ref( buf );
+  bufref_check( name, "buffer and reference", i_base, 2 );
+
+  /* @remark "passes bytes by reference", then "bytes" out of that */
+  words = bk_buf_slice( ref, 8, 25 );
+  word  = bk_buf_slice( words, 7, 5 );
+  bufref_check( name, "slice of a slice", i_base, 4 );
+  bufref_same( name, word, BUFREF_WORD );
+
+  if( (NULL == word) || (buf != word->owner) )
+    {
+      printf( "%-8s: slice does not hold the owner FAILED\n", name );
+      i_failed = 1;
+    }
+  if( 0 == bk_buf_append( buf, (t_ptr)BUFREF_TEXT, 1 ) )
+    {
+      printf( "%-8s: shared buffer took an append FAILED\n", name );
+      i_failed = 1;
+    }
+
+  if( true == owner_first )
+    {
+      bk_buf_release( buf );
+      bk_buf_release( ref );
+      bufref_check( name, "owner released", i_base, 4 );
+      bufref_same( name, word, BUFREF_WORD );
+
+      bk_buf_release( words );
+      bufref_check( name, "outer slice released", i_base, 3 );
+      bufref_same( name, word, BUFREF_WORD );
+
+      bk_buf_release( word );
+    }
+  else
+    {
+      bk_buf_release( word );
+      bk_buf_release( words );
+      bufref_check( name, "slices released", i_base, 2 );
+
+      bk_buf_release( buf );
+      bufref_check( name, "one reference left", i_base, 2 );
+      bufref_same( name, ref, BUFREF_TEXT );
+
+      bk_buf_release( ref );
+    }
+  bufref_check( name, "last release", i_base, 0 );
+}
+
+#ifdef CONFIG_BK_SYS_ERRORHANDLER
+/**
+ * @fn bufref_log( const char *name )
+ * @brief hand a slice to an error log and flush it through a pipe
+ */
+static t_void bufref_log( const char *name )
+{
+  t_berrorlog log;
+  t_bbuf *buf, *line;
+  t_s32 i_base, fds[2];
+  char text[ sizeof(BUFREF_TEXT) ];
+  ssize_t n_read;
+
+  if( 0 > pipe( fds ) )
+    {
+      printf( "%-8s: no pipe, skipped\n", name );
+      return;
+    }
+
+  memset( &log, 0, sizeof(log) );
+  i_base = mem_alloc_count();
+  if( 0 > berror_log_init( &log, fds[1], BERR_LOG_SIZE, (t_u8)0 ) )
+    {
+      printf( "%-8s: berror_log_init() FAILED\n", name );
+      i_failed = 1;
+      return;
+    }
+  log.pid = 0;			/* @remark no pid prefix, bytes as given */
+
+  buf  = bk_buf_from( (t_ptr)BUFREF_TEXT, strlen( BUFREF_TEXT ) );
+  line = bk_buf_slice( buf, 8, strlen( BUFREF_TEXT ) - 8 );
+  if( 0 > berror_log_buf( &log, line ) )
+    {
+      printf( "%-8s: berror_log_buf() FAILED\n", name );
+      i_failed = 1;
+    }
+  bk_buf_release( line );
+  bk_buf_release( buf );
+  bufref_check( name, "held by the log", i_base, 3 );
+
+  berror_log_flush( &log );
+  bufref_check( name, "log flushed", i_base, 0 );
+
+  n_read = read( fds[0], text, sizeof(text) - 1 );
+  text[ (0 < n_read) ? n_read : 0 ] = '\0';
+  if( 0 != strcmp( text, BUFREF_TEXT + 8 ) )
+    {
+      printf( "%-8s: log wrote \"%s\" FAILED\n", name, text );
+      i_failed = 1;
+    }
+
+  berror_log_free( &log );
+  close( fds[0] );
+  close( fds[1] );
+}
+#endif	/* CONFIG_BK_SYS_ERRORHANDLER */
+
+/**
+ * @fn int main(void)
+ * @brief run the release orders, then the log hand-off
+ */
+int main( void )
+{
+  bufref_order( "owner", true );
+  bufref_order( "slices", false );
+#ifdef CONFIG_BK_SYS_ERRORHANDLER
+  bufref_log( "log" );
+#endif
+
+  return( (0 == i_failed) ? 0 : 1 );
+}
+
+#endif	/* CONFIG_BK_TEST_BUFREF */
+
+/* @remark end of file "bufref.c" */
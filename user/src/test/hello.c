@@ -19,6 +19,8 @@
 
 /* @remark standard includes */
 #include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
 
 /* @remark betakit includes */
 #include <ops.h>
@@ -27,6 +29,7 @@
 #include <berror.h>
 
 #include <memory.h>
+#include <bbuf.h>
 
 /* @remark experimental jemalloc support */
 
@@ -45,7 +48,11 @@
 #define	SZ_BETAKIT_PROMPT	"BetaKit " CONFIG_BK_VERSION "> "
 #define SZ_BETAKIT_HELLO	"Hello Betakit User!"
 
-#define MAX_MENU_ITEMS		8
+#define MAX_MENU_ITEMS		9
+
+/* @remark mem_copy benchmark: bytes moved per block size */
+#define BENCH_COPY_BYTES	(64 _MB)
+#define BENCH_COPY_MAX		(1 _MB)
 
 t_string menu_items[MAX_MENU_ITEMS] = {
   "Calculate Dhrystones",
@@ -55,6 +62,7 @@ t_string menu_items[MAX_MENU_ITEMS] = {
   "Test Queue",
   "Test Numbers",
   "Test Strings",
+  "Benchmark mem_copy",
   "Exit Menu"
 };
 
@@ -62,6 +70,23 @@ t_string menu_items[MAX_MENU_ITEMS] = {
 t_memory_calls jemalloc;
 #endif
 
+#ifdef CONFIG_BK_SYS_BUF
+/* @remark menu_items held once, the menu and queue get slices */
+t_bbuf *menu_text = NULL;
+t_size  menu_offs[MAX_MENU_ITEMS + 1];
+
+/**
+ * @fn t_bbuf *menu_slice( t_s32 idx )
+ * @brief slice of menu_text holding menu item idx
+ * @return new slice, NULL on failure
+ */
+t_bbuf *menu_slice( t_s32 idx )
+{
+  return( bk_buf_slice( menu_text, menu_offs[idx],
+			menu_offs[idx + 1] - menu_offs[idx] ) );
+}
+#endif
+
 
 /**
  * @fn void say_hello(void)
@@ -101,13 +126,19 @@ void say_hello( void )
 void test_strings( void )
 {
 #ifdef CONFIG_BK_DS_STRING
+  t_ptr str_bufs[3];
   t_str str_one, str_two, str_num;
   t_s32 i_strlen;
   t_u32 u_num = BK_NUM_TEST;
 
-  str_one = (t_str) mem_alloc( BK_SZ_LEN );
-  str_two = (t_str) mem_alloc( BK_SZ_LEN );
-  str_num = (t_str) mem_alloc( BK_SZ_LEN );
+  if( 0 == mem_alloc_batch( BK_SZ_LEN, str_bufs, BKIT_ARRAY_SIZE(str_bufs) ) )
+    {
+      printf("%s: unable to allocate strings\n", __FUNCTION__ );
+      return;
+    }
+  str_one = (t_str) str_bufs[0];
+  str_two = (t_str) str_bufs[1];
+  str_num = (t_str) str_bufs[2];
   
   bk_strcpy( str_one, SZ_BETAKIT_HELLO );
   bk_strrev( str_two, str_one );
@@ -133,9 +164,7 @@ void test_strings( void )
   bk_trstr( str_two, 2 );
   printf("%s: rot2 string: \"%s\"\n", __FUNCTION__, str_two );
 
-  mem_free( str_one );
-  mem_free( str_num );
-  mem_free( str_two );
+  mem_free_batch( str_bufs, BKIT_ARRAY_SIZE(str_bufs) );
 #else
   printf("%s: library support for string/bstring (DS) disabled.\n", __FUNCTION__ );
 #endif	/* CONFIG_BK_DS_STRING */
@@ -190,7 +219,7 @@ void test_stack( void )
 void test_queue( void )
 {
 #ifdef CONFIG_BK_DS_QUEUE
-  t_str str_ptr;
+  t_ptr item_ptr;
   t_s32 idx;
   t_queue_ptr queue_ptr;
 
@@ -204,13 +233,23 @@ void test_queue( void )
 
   for( idx = 0; idx < MAX_MENU_ITEMS; idx++ )
     {
-      if( 0 > queue_add( queue_ptr, (t_ptr)menu_items[ idx ] ) )
+#ifdef CONFIG_BK_SYS_BUF
+      item_ptr = (t_ptr)menu_slice( idx );
+#else
+      item_ptr = (t_ptr)menu_items[ idx ];
+#endif
+      if( 0 > queue_add( queue_ptr, item_ptr ) )
 	{
 	  printf("%s: error adding item to queue (%d)\n", __FUNCTION__,
 		 idx );
+#ifdef CONFIG_BK_SYS_BUF
+	  bk_buf_release( (t_bbuf*)item_ptr );
+#endif
 	}
     }
 
+  /* @remark a circular queue drops what it overwrites, slices are queued once */
+#ifndef CONFIG_BK_SYS_BUF
   for( idx = 0; idx < MAX_MENU_ITEMS; idx++ )
     {
       if( 0 > queue_add( queue_ptr, (t_ptr)menu_items[ idx ] ) )
@@ -219,16 +258,24 @@ void test_queue( void )
 		 idx );
 	}
     }
+#endif
 
   printf("%s: queue has %d items\n", __FUNCTION__, queue_items( queue_ptr ));
 
   for( idx = 0; idx < MAX_MENU_ITEMS; idx++ )
     {
-      str_ptr = queue_get( queue_ptr );
-      if( NULL != str_ptr )
+      item_ptr = queue_get( queue_ptr );
+      if( NULL != item_ptr )
 	{
+#ifdef CONFIG_BK_SYS_BUF
+	  printf("%s: queue read [%d] := %.*s\n", __FUNCTION__, idx,
+		 (int)bk_buf_len( (t_bbuf*)item_ptr ),
+		 (const char*)bk_buf_data( (t_bbuf*)item_ptr ) );
+	  bk_buf_release( (t_bbuf*)item_ptr );
+#else
 	  printf("%s: queue read [%d] := %s\n", __FUNCTION__,
-		 idx, str_ptr );
+		 idx, (t_str)item_ptr );
+#endif
 	}
       else
 	{
@@ -238,6 +285,12 @@ void test_queue( void )
     }
   printf("%s: queue has %d items\n", __FUNCTION__, queue_items( queue_ptr ));
 
+#ifdef CONFIG_BK_SYS_BUF
+  while( 0 < queue_items( queue_ptr ) )
+    {
+      bk_buf_release( (t_bbuf*)queue_get( queue_ptr ) );
+    }
+#endif
 
   queue_clean( queue_ptr );
 #else
@@ -331,6 +384,94 @@ void measure_whetstones( void )
   return;
 }
 
+/**
+ * @fn double bench_time( void )
+ * @brief wall clock in seconds for the copy benchmark
+ */
+double bench_time( void )
+{
+  struct timeval tv;
+
+  gettimeofday( &tv, NULL );
+  return( tv.tv_sec + (tv.tv_usec * 1.0e-06) );
+}
+
+/**
+ * @fn void measure_memcopy( void )
+ * @brief compares mem_copy and mem_move against libc memcpy
+ * @remark copies from a misaligned source to check results
+ *         before timing each block size.
+ */
+void measure_memcopy( void )
+{
+#ifdef CONFIG_BK_SYS_MEMORY
+  t_u32 sizes[] = { 16, 64, 256, 1 _KB, 4 _KB, 64 _KB, 1 _MB };
+  t_u8 *src, *dst;
+  t_u32 idx, u_size, u_loops, u_loop;
+  double d_start, d_bk, d_libc;
+
+  src = (t_u8*) mem_alloc( BENCH_COPY_MAX + 64 );
+  dst = (t_u8*) mem_alloc( BENCH_COPY_MAX + 64 );
+  if( (NULL == src) || (NULL == dst) )
+    {
+      printf("%s: unable to allocate buffers\n", __FUNCTION__ );
+      mem_free( src );
+      mem_free( dst );
+      return;
+    }
+
+  for( idx = 0; idx < BENCH_COPY_MAX + 64; idx++ )
+    {
+      src[idx] = (t_u8)(idx * 7);
+    }
+
+  printf("%10s %14s %14s\n", "bytes", "mem_copy MB/s", "memcpy MB/s" );
+  for( idx = 0; idx < BKIT_ARRAY_SIZE(sizes); idx++ )
+    {
+      u_size  = sizes[idx];
+      u_loops = BENCH_COPY_BYTES / u_size;
+
+      mem_copy( dst + 1, src + 3, u_size );
+      if( 0 != memcmp( dst + 1, src + 3, u_size ) )
+	{
+	  printf("%s: mem_copy mismatch at %u bytes\n", __FUNCTION__, u_size );
+	}
+
+      d_start = bench_time();
+      for( u_loop = 0; u_loop < u_loops; u_loop++ )
+	{
+	  mem_copy( dst, src + (u_loop & 31), u_size );
+	}
+      d_bk = bench_time() - d_start;
+
+      d_start = bench_time();
+      for( u_loop = 0; u_loop < u_loops; u_loop++ )
+	{
+	  memcpy( dst, src + (u_loop & 31), u_size );
+	  __asm__ volatile( "" ::: "memory" );
+	}
+      d_libc = bench_time() - d_start;
+
+      printf("%10u %14.0f %14.0f\n", u_size,
+	     (BENCH_COPY_BYTES / 1.0e+06) / (d_bk   > 0.0 ? d_bk   : 1.0e-06),
+	     (BENCH_COPY_BYTES / 1.0e+06) / (d_libc > 0.0 ? d_libc : 1.0e-06) );
+    }
+
+  /* @remark overlapping move, upwards then back down */
+  mem_copy( dst, src, 4 _KB );
+  mem_move( dst + 5, dst, 4 _KB );
+  mem_move( dst, dst + 5, 4 _KB );
+  printf("%s: mem_move overlap check %s\n", __FUNCTION__,
+	 (0 == memcmp( dst, src, 4 _KB )) ? "passed" : "FAILED" );
+
+  mem_free( src );
+  mem_free( dst );
+#else
+  printf("%s: library support for memory (SYS) disabled.\n", __FUNCTION__ );
+#endif	/* CONFIG_BK_SYS_MEMORY */
+  return;
+}
+
 /**
  * @fn t_s32 hello_menu( t_s32 choice )
  * @brief callback function for CLI menu interface
@@ -385,6 +526,12 @@ t_s32 hello_menu( t_s32 choice )
 	retval = choice;
       }
       break;
+    case 8:
+      {
+	measure_memcopy();
+	retval = choice;
+      }
+      break;
     case MAX_MENU_ITEMS:
       {
 	retval = CLI_EXIT_ACTION;
@@ -411,15 +558,34 @@ void init_menu( void )
 {
 #ifdef CONFIG_BK_UI_CLI
   t_menu_ptr main_menu;
+#ifdef CONFIG_BK_SYS_BUF
+  t_bbuf *item;
+  t_s32 idx;
+#endif
   main_menu = cli_menu_init();
 
   printf("%s: init_menu called\n", __FUNCTION__ );
 
+#ifdef CONFIG_BK_SYS_BUF
+  for( idx = 0; idx < MAX_MENU_ITEMS; idx++ )
+    {
+      item = menu_slice( idx );
+      if( NULL == item )
+	{
+	  cli_menu_additem( main_menu, menu_items[ idx ] );
+	  continue;
+	}
+      cli_menu_additem_buf( main_menu, item );
+      bk_buf_release( item );
+    }
+#else
   cli_menu_addlist( main_menu, menu_items, MAX_MENU_ITEMS );
+#endif
   cli_menu_callback( main_menu, &hello_menu );
   cli_set_prompt((t_str)SZ_BETAKIT_PROMPT);
 
   cli_menu_user( main_menu );
+  cli_menu_free( main_menu );
   return;
 #else
   printf("%s: test requires CONFIG_BK_UI_CLI to be set.\n", __FUNCTION__ );
@@ -432,6 +598,10 @@ void init_menu( void )
  */
 void __ctor_main( void )
 {
+#ifdef CONFIG_BK_SYS_BUF
+  t_s32 idx;
+#endif
+
 #ifdef CONFIG_BK_SYS_JEMALLOC
   bk_jemalloc_calls( &jemalloc );
 #endif
@@ -441,6 +611,16 @@ void __ctor_main( void )
 #else
   printf("%s: WARNING! SERIOUS! library does not have error handler.\n", __FUNCTION__ );
 #endif
+
+#ifdef CONFIG_BK_SYS_BUF
+  menu_text = bk_buf_new( ZERO );
+  for( idx = 0; idx < MAX_MENU_ITEMS; idx++ )
+    {
+      menu_offs[idx] = (NULL == menu_text) ? ZERO : bk_buf_len( menu_text );
+      bk_buf_append( menu_text, (t_ptr)menu_items[idx], strlen( menu_items[idx] ) );
+    }
+  menu_offs[MAX_MENU_ITEMS] = (NULL == menu_text) ? ZERO : bk_buf_len( menu_text );
+#endif
 }
 
 /**
@@ -459,6 +639,11 @@ void __dtor_main( void )
   _bk_errlog_free();
 #endif
 
+#ifdef CONFIG_BK_SYS_BUF
+  bk_buf_release( menu_text );
+  menu_text = NULL;
+#endif
+
 #ifdef CONFIG_BK_SYS_MEMORY
   mem_gc();			/* @remark garbage collect */
 #endif	/* CONFIG_BK_SYS_MEMORY */
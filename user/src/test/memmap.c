@@ -0,0 +1,140 @@
+/**
+ * @file memmap.c
+ * @author Sunil Beta <betasam@gmail.com>
+ * @date 2012
+ * @brief checks that large allocations give their mappings back.
+ *
+ * Blocks of mem_mmap_threshold bytes or more are anonymous mappings
+ * that go to a small cache when freed, and a cached mapping serves a
+ * later request of half its length or more. Each case below reuses
+ * a mapping for a smaller block, releases everything and calls
+ * mem_gc(), then looks for any part of the original range still
+ * listed in /proc/self/maps.
+ *
+ * usage: memmap
+ * @return 0 when every range was unmapped, 1 otherwise
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_TEST_MEMMAP
+
+/* @remark standard includes */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* @remark betakit includes */
+#include <ops.h>
+#include <btypes.h>
+
+#include <memory.h>
+
+/* @remark first request, and what reuses its mapping afterwards */
+#define MEMMAP_FIRST	(1024 _KB)
+#define MEMMAP_REUSE	(520 _KB)
+#define MEMMAP_GROW	(600 _KB)
+
+/**
+ * @fn memmap_mapped( t_ptr ptr_map, t_size u_length )
+ * @brief bytes of [ptr_map, ptr_map + u_length) still mapped
+ */
+static t_size memmap_mapped( t_ptr ptr_map, t_size u_length )
+{
+  FILE *fp;
+  unsigned long ul_start, ul_end, ul_lo, ul_hi;
+  t_size u_mapped = 0;
+  char line[ 512 ];
+
+  ul_lo = (unsigned long) ptr_map;
+  ul_hi = ul_lo + (unsigned long) u_length;
+
+  fp = fopen( "/proc/self/maps", "r" );
+  if( NULL == fp )
+    {
+      return( 0 );
+    }
+  while( NULL != fgets( line, sizeof(line), fp ) )
+    {
+      if( 2 != sscanf( line, "%lx-%lx", &ul_start, &ul_end ) )
+	{
+	  continue;
+	}
+      if( (ul_start < ul_hi) && (ul_end > ul_lo) )
+	{
+	  u_mapped += (t_size) (((ul_end < ul_hi) ? ul_end : ul_hi) -
+				((ul_start > ul_lo) ? ul_start : ul_lo));
+	}
+    }
+  fclose( fp );
+
+  return( u_mapped );
+}
+
+/**
+ * @fn memmap_case( const char *name, t_size ui_resize )
+ * @brief map, reuse the mapping for a smaller block, release all
+ * @param ui_resize size the reusing block is reallocated to, 0 for none
+ * @return 0 if nothing of the mappings is left, -1 otherwise
+ */
+static t_s32 memmap_case( const char *name, t_size ui_resize )
+{
+  t_ptr ptr_first, ptr_block, ptr_new;
+  t_size u_left;
+
+  ptr_first = mem_alloc( MEMMAP_FIRST );
+  if( NULL == ptr_first )
+    {
+      printf( "%-8s: allocation failed\n", name );
+      return( -1 );
+    }
+  mem_free( ptr_first );
+
+  ptr_block = mem_alloc( MEMMAP_REUSE );
+  if( NULL == ptr_block )
+    {
+      printf( "%-8s: allocation failed\n", name );
+      return( -1 );
+    }
+  if( ptr_block != ptr_first )
+    {
+      printf( "%-8s: mapping was not reused\n", name );
+    }
+  if( (ZERO != ui_resize) && (NULL != (ptr_new = mem_realloc( ptr_block, ui_resize ))) )
+    {
+      ptr_block = ptr_new;
+    }
+  mem_free( ptr_block );
+  mem_gc();
+
+  /* @remark a moved block leaves the first range, check both */
+  u_left = memmap_mapped( ptr_first, MEMMAP_FIRST );
+  if( ptr_block != ptr_first )
+    {
+      u_left += memmap_mapped( ptr_block, MEMMAP_FIRST );
+    }
+  printf( "%-8s: %lu bytes still mapped after mem_gc() %s\n", name,
+	  (unsigned long) u_left, (0 == u_left) ? "ok" : "FAILED" );
+
+  return( (0 == u_left) ? 0 : -1 );
+}
+
+/**
+ * @fn int main(void)
+ * @brief run every case on normal pages
+ * @remark huge pages are off so lengths round to BK_PAGESIZE only
+ */
+int main( void )
+{
+  t_s32 i_failed = 0;
+
+  mem_mmap_config( BKIT_MEM_MMAP_THRESHOLD, ZERO );
+
+  i_failed |= memmap_case( "free", 0 );
+  i_failed |= memmap_case( "realloc", MEMMAP_GROW );
+
+  return( (0 == i_failed) ? 0 : 1 );
+}
+
+#endif	/* CONFIG_BK_TEST_MEMMAP */
+
+/* @remark end of file "memmap.c" */
@@ -0,0 +1,476 @@
+/**
+ * @file memreplay.c
+ * @author Sunil Beta <betasam@gmail.com>
+ * @date 2012
+ * @brief replays an allocation trace against memory backends.
+ *
+ * Reads a trace recorded by mem_trace_start(), or by running a
+ * program with BKIT_MEM_TRACE set to a file name, and performs the
+ * same requests on every backend named on the command line. For
+ * each backend it reports requests per second, the peak resident
+ * set above the starting point and fragmentation, the share of
+ * that peak not explained by the peak of live data.
+ *
+ * Every backend runs in a child process of its own so heaps and
+ * resident sets do not mix. Requests of all recorded threads are
+ * replayed from one thread in the order they were recorded, and
+ * every page of a new block is written once, as a program would.
+ *
+ * usage: memreplay <trace> [libc] [betakit] [jemalloc]
+ */
+
+#include <bkconfig.h>
+
+#ifdef CONFIG_BK_TEST_MEMREPLAY
+
+/* @remark standard includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/* @remark betakit includes */
+#include <ops.h>
+#include <btypes.h>
+
+#include <memory.h>
+
+/* @remark resident set is sampled every so many requests */
+#define REPLAY_SAMPLE		1024
+/* @remark and after every request at least this large */
+#define REPLAY_SAMPLE_BYTES	(256 _KB)
+
+/**
+ * @struct	s_replay_block
+ * @brief	a live block of the replay, indexed by trace id
+ */
+struct s_replay_block {
+  t_ptr ptr;
+  t_size size;
+};
+
+/**
+ * @struct	s_replay_backend
+ * @brief	a backend that can be named on the command line
+ */
+struct s_replay_backend {
+  const char *name;
+  t_void (*setup)( t_memory_calls *calls );
+};
+
+typedef struct s_replay_block   t_replay_block;
+typedef struct s_replay_backend t_replay_backend;
+
+/* @remark the trace, loaded once before any backend runs */
+static t_mem_trace_rec *trace_recs = NULL;
+static t_size trace_count = 0;
+static t_u32  trace_max_id = 0;
+
+/**
+ * @fn replay_rss( void )
+ * @brief resident set of this process in bytes
+ */
+static t_size replay_rss( void )
+{
+  FILE *fp;
+  unsigned long ul_size = 0, ul_resident = 0;
+
+  fp = fopen( "/proc/self/statm", "r" );
+  if( NULL == fp )
+    {
+      return( 0 );
+    }
+  if( 2 != fscanf( fp, "%lu %lu", &ul_size, &ul_resident ) )
+    {
+      ul_resident = 0;
+    }
+  fclose( fp );
+
+  return( (t_size) ul_resident * (t_size) sysconf( _SC_PAGESIZE ) );
+}
+
+/**
+ * @fn replay_time( void )
+ * @brief wall clock in seconds
+ */
+static double replay_time( void )
+{
+  struct timeval tv;
+
+  gettimeofday( &tv, NULL );
+
+  return( (double) tv.tv_sec + (double) tv.tv_usec / 1e6 );
+}
+
+/**
+ * @fn replay_touch( t_u8 *ptr, t_size u_from, t_size u_to )
+ * @brief write one byte in every page of a block range
+ */
+static void replay_touch( t_u8 *ptr, t_size u_from, t_size u_to )
+{
+  for( ; u_from < u_to; u_from += BK_PAGESIZE )
+    {
+      ptr[ u_from ] = 1;
+    }
+
+  return;
+}
+
+/* @remark libc backend */
+static t_ptr replay_libc_memalign( t_size alignment, t_size ubytes )
+{
+  t_ptr ptr = NULL;
+
+  if( 0 != posix_memalign( &ptr, alignment, ubytes ) )
+    {
+      return( NULL );
+    }
+
+  return( ptr );
+}
+
+static t_void replay_libc( t_memory_calls *calls )
+{
+  calls->malloc   = &malloc;
+  calls->calloc   = &calloc;
+  calls->realloc  = &realloc;
+  calls->free     = &free;
+  calls->memalign = &replay_libc_memalign;
+  return;
+}
+
+/* @remark betakit backend, mem_* over the default callbacks */
+static t_ptr replay_bk_calloc( t_size nmemb, t_size ubytes )
+{
+  return( mem_clearalloc( nmemb * ubytes ) );
+}
+
+static t_void replay_betakit( t_memory_calls *calls )
+{
+  calls->malloc   = &mem_alloc;
+  calls->calloc   = &replay_bk_calloc;
+  calls->realloc  = &mem_realloc;
+  calls->free     = &mem_free;
+  calls->memalign = &mem_alloc_aligned;
+  return;
+}
+
+#if defined(CONFIG_BK_SYS_JEMALLOC)
+/* @remark jemalloc backend, straight through its callbacks */
+static t_void replay_jemalloc( t_memory_calls *calls )
+{
+  bk_jemalloc_calls( calls );
+  return;
+}
+#endif	/* CONFIG_BK_SYS_JEMALLOC */
+
+static t_replay_backend replay_backends[] = {
+  { "libc",     &replay_libc },
+  { "betakit",  &replay_betakit },
+#if defined(CONFIG_BK_SYS_JEMALLOC)
+  { "jemalloc", &replay_jemalloc },
+#endif
+};
+
+/**
+ * @fn replay_load( const char *path )
+ * @brief read a trace file into trace_recs
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 replay_load( const char *path )
+{
+  FILE *fp;
+  t_mem_trace_header hdr;
+  long l_bytes;
+  t_size u_idx;
+
+  fp = fopen( path, "rb" );
+  if( NULL == fp )
+    {
+      perror( path );
+      return( -1 );
+    }
+
+  if( (1 != fread( &hdr, sizeof(hdr), 1, fp )) ||
+      (BKIT_MEM_TRACE_MAGIC != hdr.magic) ||
+      (BKIT_MEM_TRACE_VERSION != hdr.version) ||
+      (sizeof(t_mem_trace_rec) != hdr.rec_size) )
+    {
+      fprintf( stderr, "%s: not a betakit allocation trace\n", path );
+      fclose( fp );
+      return( -1 );
+    }
+
+  fseek( fp, 0, SEEK_END );
+  l_bytes = ftell( fp ) - (long) sizeof(hdr);
+  fseek( fp, sizeof(hdr), SEEK_SET );
+
+  trace_count = (t_size) l_bytes / sizeof(t_mem_trace_rec);
+  trace_recs  = (t_mem_trace_rec*) malloc( (trace_count + 1) * sizeof(t_mem_trace_rec) );
+  if( (NULL == trace_recs) ||
+      (trace_count != fread( trace_recs, sizeof(t_mem_trace_rec), trace_count, fp )) )
+    {
+      fprintf( stderr, "%s: could not read the trace\n", path );
+      fclose( fp );
+      return( -1 );
+    }
+  fclose( fp );
+
+  for( u_idx = 0; u_idx < trace_count; u_idx++ )
+    {
+      if( trace_recs[ u_idx ].id > trace_max_id )
+	{
+	  trace_max_id = trace_recs[ u_idx ].id;
+	}
+    }
+
+  return( 0 );
+}
+
+/**
+ * @fn replay_run( t_replay_backend *backend )
+ * @brief perform the trace on one backend and print the results
+ * @remark runs in a child process, the heap is thrown away after
+ * @return 0 on success, -ve on failure
+ */
+static t_s32 replay_run( t_replay_backend *backend )
+{
+  t_memory_calls calls;
+  t_replay_block *blocks, *blk;
+  t_mem_trace_rec *rec;
+  t_ptr ptr;
+  t_size u_idx, u_live = 0, u_peak_live = 0, u_base, u_rss, u_peak_rss = 0;
+  t_size u_failed = 0;
+  double d_start, d_time, d_frag;
+
+  memset( &calls, 0, sizeof(calls) );
+  backend->setup( &calls );
+
+  blocks = (t_replay_block*) calloc( trace_max_id + 1, sizeof(t_replay_block) );
+  if( NULL == blocks )
+    {
+      return( -1 );
+    }
+
+  /* @remark fault the table in now, it is not part of the backend */
+  for( u_idx = 0; u_idx < (trace_max_id + 1) * sizeof(t_replay_block); u_idx += BK_PAGESIZE )
+    {
+      ((volatile t_u8*) blocks)[ u_idx ] = 0;
+    }
+
+  u_base  = replay_rss();
+  d_start = replay_time();
+
+  for( u_idx = 0; u_idx < trace_count; u_idx++ )
+    {
+      rec = &trace_recs[ u_idx ];
+      blk = &blocks[ rec->id ];
+
+      switch( rec->op )
+	{
+	case BKIT_MEM_TRACE_ALLOC:
+	case BKIT_MEM_TRACE_CALLOC:
+	case BKIT_MEM_TRACE_ALIGNED:
+	  if( NULL != blk->ptr )
+	    {
+	      break;		/* @remark id reused after a wrap */
+	    }
+	  if( BKIT_MEM_TRACE_ALLOC == rec->op )
+	    {
+	      ptr = calls.malloc( rec->size );
+	    }
+	  else if( BKIT_MEM_TRACE_CALLOC == rec->op )
+	    {
+	      ptr = calls.calloc( 1, rec->size );
+	    }
+	  else
+	    {
+	      ptr = calls.memalign( (t_size) 1 << rec->align_shift, rec->size );
+	    }
+	  if( NULL == ptr )
+	    {
+	      u_failed++;
+	      break;
+	    }
+	  replay_touch( (t_u8*) ptr, 0, rec->size );
+	  blk->ptr  = ptr;
+	  blk->size = rec->size;
+	  u_live   += rec->size;
+	  break;
+
+	case BKIT_MEM_TRACE_REALLOC:
+	  if( NULL == blk->ptr )
+	    {
+	      break;
+	    }
+	  ptr = calls.realloc( blk->ptr, rec->size );
+	  if( NULL == ptr )
+	    {
+	      u_failed++;
+	      break;
+	    }
+	  if( rec->size > blk->size )
+	    {
+	      replay_touch( (t_u8*) ptr, blk->size, rec->size );
+	    }
+	  u_live   += rec->size - blk->size;
+	  blk->ptr  = ptr;
+	  blk->size = rec->size;
+	  break;
+
+	case BKIT_MEM_TRACE_FREE:
+	  if( NULL == blk->ptr )
+	    {
+	      break;
+	    }
+	  calls.free( blk->ptr );
+	  u_live   -= blk->size;
+	  blk->ptr  = NULL;
+	  blk->size = 0;
+	  break;
+
+	default:
+	  break;
+	}
+
+      if( u_live > u_peak_live )
+	{
+	  u_peak_live = u_live;
+	}
+
+      if( (0 == (u_idx % REPLAY_SAMPLE)) || (rec->size >= REPLAY_SAMPLE_BYTES) )
+	{
+	  u_rss = replay_rss();
+	  if( u_rss > u_peak_rss )
+	    {
+	      u_peak_rss = u_rss;
+	    }
+	}
+    }
+
+  d_time = replay_time() - d_start;
+  u_rss  = replay_rss();
+  if( u_rss > u_peak_rss )
+    {
+      u_peak_rss = u_rss;
+    }
+  u_peak_rss = (u_peak_rss > u_base) ? (u_peak_rss - u_base) : 0;
+
+  d_frag = 0.0;
+  if( u_peak_rss > u_peak_live )
+    {
+      d_frag = 100.0 * (double)(u_peak_rss - u_peak_live) / (double) u_peak_rss;
+    }
+
+  printf( "%-10s %12.0f req/s  peak rss %9.2f MB  peak live %9.2f MB  fragmentation %5.1f%%",
+	  backend->name, (d_time > 0.0) ? ((double) trace_count / d_time) : 0.0,
+	  (double) u_peak_rss / (1 _MB), (double) u_peak_live / (1 _MB), d_frag );
+  if( 0 != u_failed )
+    {
+      printf( "  (%lu requests failed)", (unsigned long) u_failed );
+    }
+  printf( "\n" );
+
+  for( u_idx = 0; u_idx <= trace_max_id; u_idx++ )
+    {
+      if( NULL != blocks[ u_idx ].ptr )
+	{
+	  calls.free( blocks[ u_idx ].ptr );
+	}
+    }
+  free( blocks );
+
+  return( 0 );
+}
+
+/**
+ * @fn main( int argc, char **argv )
+ * @brief replay a trace on the backends given, or on all of them
+ */
+int main( int argc, char **argv )
+{
+  t_u32 u_backend, u_threads = 0;
+  t_s32 i_arg, i_ran = 0;
+  t_size u_idx;
+  pid_t pid;
+  int status;
+
+  if( argc < 2 )
+    {
+      fprintf( stderr, "usage: %s <trace> [backend ...]\nbackends:", argv[0] );
+      for( u_backend = 0; u_backend < BKIT_ARRAY_SIZE(replay_backends); u_backend++ )
+	{
+	  fprintf( stderr, " %s", replay_backends[ u_backend ].name );
+	}
+      fprintf( stderr, "\n" );
+      return( 1 );
+    }
+
+#if defined(CONFIG_BK_SYS_MEM_TRACE)
+  mem_trace_stop();		/* @remark do not trace the replay */
+#endif
+
+  if( 0 > replay_load( argv[1] ) )
+    {
+      return( 1 );
+    }
+
+  for( u_idx = 0; u_idx < trace_count; u_idx++ )
+    {
+      if( trace_recs[ u_idx ].thread > u_threads )
+	{
+	  u_threads = trace_recs[ u_idx ].thread;
+	}
+    }
+  printf( "%s: %lu requests, %u blocks, %u threads, %.3f s recorded\n", argv[1],
+	  (unsigned long) trace_count, trace_max_id, u_threads,
+	  (0 != trace_count) ? ((double) trace_recs[ trace_count - 1 ].time / 1e9) : 0.0 );
+
+  for( u_backend = 0; u_backend < BKIT_ARRAY_SIZE(replay_backends); u_backend++ )
+    {
+      if( argc > 2 )
+	{
+	  for( i_arg = 2; i_arg < argc; i_arg++ )
+	    {
+	      if( 0 == strcmp( argv[ i_arg ], replay_backends[ u_backend ].name ) )
+		{
+		  break;
+		}
+	    }
+	  if( i_arg == argc )
+	    {
+	      continue;
+	    }
+	}
+
+      fflush( stdout );
+      pid = fork();
+      if( 0 > pid )
+	{
+	  perror( "fork" );
+	  return( 1 );
+	}
+      if( 0 == pid )
+	{
+	  exit( (0 == replay_run( &replay_backends[ u_backend ] )) ? 0 : 1 );
+	}
+      waitpid( pid, &status, 0 );
+      i_ran++;
+    }
+
+  if( 0 == i_ran )
+    {
+      fprintf( stderr, "%s: no such backend\n", argv[0] );
+      return( 1 );
+    }
+
+  free( trace_recs );
+
+  return( 0 );
+}
+
+#endif	/* CONFIG_BK_TEST_MEMREPLAY */
+
+/* @remark end of file "memreplay.c" */
@@ -4,7 +4,6 @@
  * @date   2008-2012
  * @brief  Command Line Interface Abstraction
  *
- * @todo  Destructor for Menu Structure 
  * @todo  Abstract support for sub-menus 
  */
 
@@ -75,6 +74,9 @@ t_menu *cli_menu_init( void )
   menu_ptr->menu_title = (t_string)(mem_alloc( BKIT_SZLEN_DEFAULT ));
 
   strcpy( menu_ptr->menu_title, (t_string)" Main Menu ");
+#ifdef CONFIG_BK_SYS_BUF
+  menu_ptr->menu_title_buf = NULL;
+#endif
 
   retval++;
 
@@ -111,34 +113,21 @@ t_s32 cli_menu_title( t_menu *menu_ptr, t_string new_title )
 }
 
 /**
- * @fn cli_menu_additem( t_menu_ptr menu_ptr, t_string new_item )
- * @brief add an item to the menu for the CLI
- * @param menu_ptr pointer to cli menu
- * @param new_item SZ string with entry to be added to menu
- * @return 0 on success, -ve on failure
+ * @fn _cli_menu_addnode( t_menu_ptr menu_ptr, t_list_ptr new_menu_item )
+ * @brief append a list node holding an item to the menu
+ * @return index of the item on success, -ve on failure
  */
-t_s32 cli_menu_additem( t_menu_ptr menu_ptr, t_string new_item )
+static t_s32 _cli_menu_addnode( t_menu_ptr menu_ptr, t_list_ptr new_menu_item )
 {
   t_list_ptr cur_menu_item = (t_list_ptr)0;
-  t_list_ptr new_menu_item = (t_list_ptr)0;
-  t_s32 retval = -2;
+  t_s32 retval = 0;
   t_s32 counter = 0;
 
-  if( 0 == menu_ptr )
-    {
-      return( retval );
-    }
-  retval++;
-
-  if( 0 == (t_ptr)new_item )
+  if( 0 == new_menu_item )
     {
-      return( retval );
+      return( retval = -1 );
     }
 
-  retval++;
-
-  new_menu_item = (t_list*)list_create_node( (t_ptr) new_item );
-  
   if( ((t_ptr)0 == (t_ptr)menu_ptr->menu_count) )
     {
       menu_ptr->menu_choices = (t_ptr) new_menu_item;
@@ -166,6 +155,99 @@ t_s32 cli_menu_additem( t_menu_ptr menu_ptr, t_string new_item )
   return( retval );
 }
 
+/**
+ * @fn cli_menu_additem( t_menu_ptr menu_ptr, t_string new_item )
+ * @brief add an item to the menu for the CLI
+ * @param menu_ptr pointer to cli menu
+ * @param new_item SZ string with entry to be added to menu
+ * @return 0 on success, -ve on failure
+ */
+t_s32 cli_menu_additem( t_menu_ptr menu_ptr, t_string new_item )
+{
+  t_s32 retval = -2;
+
+  if( 0 == menu_ptr )
+    {
+      return( retval );
+    }
+  retval++;
+
+  if( 0 == (t_ptr)new_item )
+    {
+      return( retval );
+    }
+
+  retval = _cli_menu_addnode( menu_ptr,
+			      (t_list*)list_create_node( (t_ptr) new_item ) );
+  return( retval );
+}
+
+#ifdef CONFIG_BK_SYS_BUF
+/**
+ * @fn cli_menu_additem_buf( t_menu_ptr menu_ptr, t_bbuf *new_item )
+ * @brief add an item held in a buffer or slice to the menu
+ * @param new_item buffer with the text of the entry, no terminator
+ * @remark the menu keeps a reference to new_item in the metadata of
+ *         its node until cli_menu_free(); nothing is copied.
+ * @return 0 on success, -ve on failure
+ */
+t_s32 cli_menu_additem_buf( t_menu_ptr menu_ptr, t_bbuf *new_item )
+{
+  t_list_ptr new_menu_item;
+  t_s32 retval = -2;
+
+  if( 0 == menu_ptr )
+    {
+      return( retval );
+    }
+  retval++;
+
+  if( 0 == new_item )
+    {
+      return( retval );
+    }
+
+  new_menu_item = (t_list*)list_create_node( (t_ptr) bk_buf_data( new_item ) );
+  if( 0 == new_menu_item )
+    {
+      return( retval );
+    }
+  new_menu_item->metadata = (t_ptr) bk_buf_ref( new_item );
+
+  retval = _cli_menu_addnode( menu_ptr, new_menu_item );
+  return( retval );
+}
+
+/**
+ * @fn cli_menu_title_buf( t_menu_ptr menu_ptr, t_bbuf *new_title )
+ * @brief set the menu title from a buffer or slice
+ * @remark takes a reference to new_title in place of a copy, and
+ *         gives back the one to any title set before.
+ * @return 0 on success, -ve on failure
+ */
+t_s32 cli_menu_title_buf( t_menu_ptr menu_ptr, t_bbuf *new_title )
+{
+  t_s32 retval = -2;
+
+  if( 0 == menu_ptr )
+    {
+      return( retval );
+    }
+  retval++;
+
+  if( 0 == new_title )
+    {
+      return( retval );
+    }
+  retval++;
+
+  bk_buf_release( menu_ptr->menu_title_buf );
+  menu_ptr->menu_title_buf = bk_buf_ref( new_title );
+
+  return( retval );
+}
+#endif	/* CONFIG_BK_SYS_BUF */
+
 
 /**
  * @fn cli_menu_dadlist( t_menu_ptr menu_ptr, t_str *menuitem_list, t_s32 count )
@@ -264,11 +346,30 @@ t_s32 cli_show_menu( t_menu *menu_ptr )
     }
   retval++;
 
+#ifdef CONFIG_BK_SYS_BUF
+  if( 0 != menu_ptr->menu_title_buf )
+    {
+      printf("%s %.*s %s\n\n", BK_MENU_HEADER_PRE,
+	     (int) bk_buf_len( menu_ptr->menu_title_buf ),
+	     (const char*) bk_buf_data( menu_ptr->menu_title_buf ),
+	     BK_MENU_HEADER_AFT);
+    }
+  else
+#endif
   printf("%s %s %s\n\n", BK_MENU_HEADER_PRE, menu_ptr->menu_title,
 	 BK_MENU_HEADER_AFT);
 
   for( curitem = 0; curitem < count; curitem++ )
     {
+#ifdef CONFIG_BK_SYS_BUF
+      if( 0 != menuitem_ptr->metadata )
+	{
+	  printf("(%2d) %.*s \n", (curitem+1),
+		 (int) bk_buf_len( (t_bbuf*) menuitem_ptr->metadata ),
+		 (const char*) bk_buf_data( (t_bbuf*) menuitem_ptr->metadata ));
+	}
+      else
+#endif
       printf("(%2d) %s \n", (curitem+1), (t_string)(menuitem_ptr->data));
       menuitem_ptr = menuitem_ptr->next;
       if( 0 == menuitem_ptr )
@@ -340,6 +441,42 @@ t_s32 cli_menu_user( t_menu* menu_ptr )
   return( retval );
 }
 
+/**
+ * @fn cli_menu_free( t_menu *menu_ptr )
+ * @brief release a menu made by cli_menu_init()
+ * @remark string items belong to the caller and are left alone,
+ *         buffer items and titles have their references given back.
+ * @return Nothing
+ */
+t_void cli_menu_free( t_menu *menu_ptr )
+{
+  t_list_ptr menuitem_ptr, nextitem_ptr;
+
+  if( NULL == menu_ptr )
+    {
+      return;
+    }
+
+  menuitem_ptr = menu_ptr->menu_choices;
+  while( 0 != menuitem_ptr )
+    {
+      nextitem_ptr = menuitem_ptr->next;
+#ifdef CONFIG_BK_SYS_BUF
+      bk_buf_release( (t_bbuf*) menuitem_ptr->metadata );
+#endif
+      list_free_node( menuitem_ptr );
+      menuitem_ptr = nextitem_ptr;
+    }
+
+#ifdef CONFIG_BK_SYS_BUF
+  bk_buf_release( menu_ptr->menu_title_buf );
+#endif
+  mem_free( menu_ptr->menu_title );
+  mem_free( menu_ptr );
+
+  return;
+}
+
 #endif	/* CONFIG_BK_UI_CLI */
 
 /** @remark end of file "cli.c" */